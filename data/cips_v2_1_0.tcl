@@ -110,12 +110,14 @@ proc xgen_opts_file {libhandle} {
     set recv_buf_size [xget_value $libhandle "PARAMETER" "recv_buf_size"]
     set network_mtu [xget_value $libhandle "PARAMETER" "network_mtu"]
     set max_udp [xget_value $libhandle "PARAMETER" "max_udp"]
+    set max_udp_cyclic [xget_value $libhandle "PARAMETER" "max_udp_cyclic"]
     set max_tcp [xget_value $libhandle "PARAMETER" "max_tcp"]
     set max_tcp_seg [xget_value $libhandle "PARAMETER" "max_tcp_seg"]
     set max_net_adapter [xget_value $libhandle "PARAMETER" "max_net_adapter"]
     puts $config_file "\#define RECV_BUF_SIZE                   $recv_buf_size"
     puts $config_file "\#define NETWORK_MTU                     $network_mtu"
     puts $config_file "\#define MAX_UDP                         $max_udp"
+    puts $config_file "\#define MAX_UDP_CYCLIC                  $max_udp_cyclic"
     puts $config_file "\#define MAX_TCP                         $max_tcp"
     puts $config_file "\#define MAX_TCP_SEG                 $max_tcp_seg"
     puts $config_file "\#define MAX_NET_ADAPTER                 $max_net_adapter"
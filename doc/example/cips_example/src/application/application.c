@@ -39,6 +39,7 @@
 ***************************************************/
 
 /* libc Includes */
+#include <string.h> //for memcpy, memmove
 
 /* TCP-IP Includes */
 #include "cips.h"
@@ -77,11 +78,17 @@ static const u32_t CHECK_CONNECTION_PERIOD = 60; //!< In seconds. It is indirect
 #define UDP_CONNECT_TICKS  500 //!< The application sends a ping to the peer device every 10s.
 #define PING_PEER_DEVICE_TICKS    1000 //!< The timer ticks every 10 ms. 1000 x 10 ms = 10000 ms = 10s. The application sends a ping to the peer device every 10s.
 
+#define ECHO_PENDING_SIZE (2 * TCP_MSS) //!< Bytes of an echo waiting for room in the send ring of the connection.
+
 //!Define the structure passed as an argument to the tcp callbacks.
 typedef struct {
-  //empty for that example.
+  TCP_T* tcp_c; //!< Connection echoed. NULL if the structure is free.
+  u32_t pending_length; //!< Bytes in "pending".
+  u8_t pending[ECHO_PENDING_SIZE]; //!< Part of the echo that tcp_write() could not take yet (send ring full).
 } WSCM_TCP_ARG_T;
 
+static WSCM_TCP_ARG_T echo_tcp_args[MAX_TCP * MAX_NET_ADAPTER]; //!< One per echo connection.
+
 /*!The application decides how often it wants to check whether the tcp_c's connection <br>
 has been inactive. The application specifies the period in second . CIPS deals with <br>
 tick numbers of 500ms. CHECK_CONNECTION_PERIOD_TO_NUMBER() does the convertion from <br>
@@ -93,6 +100,8 @@ static err_t echo_udp_recv(void *arg, UDP_T *udp_cb, void* pdata, u32_t data_len
 static err_t echo_tcp_accept(void *arg, TCP_T *new_tcp_c);
 static err_t echo_tcp_recv(void *arg, TCP_T *tcp_c, void* data, u32_t data_length);
 static err_t echo_tcp_check_connection(void *arg, TCP_T *tcp_c);
+static err_t echo_tcp_sent(void *arg, TCP_T *tcp_c, u32_t space);
+static err_t echo_tcp_closed(void *arg, TCP_T *tcp_c, err_t err);
 //Example static err_t tcp_client_recv(void *arg, TCP_T *pcb, void* data, u32_t data_length);
 //static err_t tcp_client_check_connection(void* arg, TCP_T* pcb);
 
@@ -158,14 +167,72 @@ static err_t echo_tcp_check_connection(void *arg, TCP_T *tcp_c)
  * The TCP server creates a child controller. But the child is not 
  * connected to the application. echo_tcp_accept() links the child to the 
  * application. The application configures the child connection.
- * To do so, it will call tcp_recv(), tcp_check_connection() and 
+ * To do so, it will call tcp_recv(), tcp_check_connection(), tcp_sent() and 
  * tcp_closed() in echo_tcp_accept().
  * *******************************************************************/
 static err_t echo_tcp_accept(void *arg, TCP_T *new_tcp_c)
+{
+  err_t err = ERR_APP; //No free WSCM_TCP_ARG_T: cIPS resets the peer device.
+  u32_t i;
+
+  for( i = 0; i < sizeof(echo_tcp_args)/sizeof(echo_tcp_args[0]); i++)
+  {
+    if( echo_tcp_args[i].tcp_c == NULL )
+    {
+      echo_tcp_args[i].tcp_c = new_tcp_c;
+      echo_tcp_args[i].pending_length = 0;
+      (void)tcp_arg(new_tcp_c, &echo_tcp_args[i]);
+      (void)tcp_recv(new_tcp_c, echo_tcp_recv);
+      (void)tcp_sent(new_tcp_c, echo_tcp_sent);
+      (void)tcp_closed(new_tcp_c, echo_tcp_closed);
+      (void)tcp_check_connection(new_tcp_c, echo_tcp_check_connection, CHECK_CONNECTION_PERIOD_TO_NUMBER( CHECK_CONNECTION_PERIOD ));
+      err = ERR_OK;
+      break;
+    }
+  }
+  return err;
+}
+
+/*!
+ * Function name: echo_tcp_closed
+ * \return ERR_OK
+ * \param arg : [in/out] WSCM_TCP_ARG_T of the connection.
+ * \param tcp_c : [in] TCP context block.
+ * \param err : [in] reason of the closure.
+ * \brief The connection is closed: free its WSCM_TCP_ARG_T.
+ * *******************************************************************/
+static err_t echo_tcp_closed(void *arg, TCP_T *tcp_c, err_t err)
+{
+  WSCM_TCP_ARG_T* echo = (WSCM_TCP_ARG_T*)arg;
+  if( echo != NULL )
+  {
+    echo->tcp_c = NULL;
+    echo->pending_length = 0;
+  }
+  return ERR_OK;
+}
+
+/*!
+ * Function name: echo_tcp_sent
+ * \return "tcp_write" error code that will be caught by netif_dispatch().
+ * \param arg : [in/out] WSCM_TCP_ARG_T of the connection.
+ * \param tcp_c : [in] TCP context block.
+ * \param space : [in] free bytes of the send ring.
+ * \brief The peer device has acknowledged some data: write the rest of 
+ * the echo.
+ * *******************************************************************/
+static err_t echo_tcp_sent(void *arg, TCP_T *tcp_c, u32_t space)
 {
   err_t err = ERR_OK;
-  (void)tcp_recv(new_tcp_c, echo_tcp_recv);
-  (void)tcp_check_connection(new_tcp_c, echo_tcp_check_connection, CHECK_CONNECTION_PERIOD_TO_NUMBER( CHECK_CONNECTION_PERIOD ));
+  WSCM_TCP_ARG_T* echo = (WSCM_TCP_ARG_T*)arg;
+  u32_t written;
+
+  if( echo->pending_length != 0 )
+  {
+    written = tcp_write(tcp_c, echo->pending, echo->pending_length, &err);
+    echo->pending_length -= written;
+    memmove(echo->pending, echo->pending + written, echo->pending_length);
+  }
   return err;
 }
 
@@ -177,11 +244,30 @@ static err_t echo_tcp_accept(void *arg, TCP_T *new_tcp_c)
  * \param tcp_c : [in] TCP context block.
  * \param data: [in] buffer received.
  * \param data_length: [in] length of "data".
- * \brief Echo a TCP frame.
+ * \brief Echo a TCP frame. When the send ring is full, the rest of the 
+ * echo waits in "pending" and echo_tcp_sent() writes it.
  * *******************************************************************/
 static err_t echo_tcp_recv(void *arg, TCP_T *tcp_c, void* data, u32_t data_length)
 {
-  err_t err = tcp_write(tcp_c, data, data_length); //Echo the incoming data
+  err_t err = ERR_OK;
+  WSCM_TCP_ARG_T* echo = (WSCM_TCP_ARG_T*)arg;
+  u32_t written = 0;
+  u32_t rest;
+
+  if( echo->pending_length == 0 ) //Keep the order of the bytes: "pending" goes first.
+  { written = tcp_write(tcp_c, data, data_length, &err);} //Echo the incoming data
+  rest = data_length - written;
+  if( rest != 0 )
+  {
+    if( rest <= ECHO_PENDING_SIZE - echo->pending_length )
+    {
+      memcpy(echo->pending + echo->pending_length, (u8_t*)data + written, rest);
+      echo->pending_length += rest;
+      err = ERR_OK;
+    }
+    else if( !err )
+    { err = ERR_CUR_SEG_MEM;} //The peer device sends faster than it acknowledges: the rest of the echo is lost.
+  }
   return err;
 }
 
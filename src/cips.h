@@ -74,7 +74,9 @@ the dev-C++ project provided or use the Makefile to compile).</li>
 <li> The maximum number of connections is configurable.</li>
 <li> The traces are readable and are an option. However, there is also an error report strategy (see 3.2 Error reporting)</li>
 <li> Data are separated from the processing.</li>
-<li> Does not perform any dynamic memory allocation.</li>
+<li> Does not perform any dynamic memory allocation. The TCP connections of an adapter
+share pools of frames (TCP_FRAME_POOL), send rings (TCP_SND_RING_POOL) and receive 
+rings (TCP_RCV_RING_POOL): an idle connection holds none of them.</li>
 <li> Fully tested on a big-endian platform. However swapping macros for
 little-endian platforms are presents.</li>
 </ul>
@@ -177,6 +179,53 @@ To address that case, set the "reuse" of udp_send() to TRUE.
 err = udp_send( udp_c, NULL, sizeof(MEASUREMENT_T),  TRUE)
 \endcode
 
+<h3>4.4 Cyclic UDP streams</h3>
+When the application polls its timer and calls udp_send() itself, the send jitter
+depends on how busy the main loop is. A cyclic stream is registered once with a
+period and a phase (in ticks of the application timer) and udp_cyclic_timer() sends
+it from the timer tick. The frame is built once and reused, so each period only costs
+the data fill, the UDP checksum and the device driver call.
+\code
+u32_t fill(void* arg, UDP_T* udp_c, u8_t* app_data, u32_t max_length)
+{
+  update((MEASUREMENT_T*)app_data);
+  return sizeof(MEASUREMENT_T);
+}
+...
+err = udp_cyclic_register(udp_c, 1, 0, 0, fill, NULL); //every tick (1ms)
+...
+//application_options.h: no driver call or stream update is interrupted by the timer ISR.
+#define NETIF_LOCK()   timer_interrupt_disable()
+#define NETIF_UNLOCK() timer_interrupt_enable()
+...
+volatile u32_t tick;
+
+void timer_ISR(void* arg)
+{
+  tick++;
+  (void)udp_cyclic_timer(netif_adapter, tick);
+}
+\endcode
+With NETIF_LOCK() and NETIF_UNLOCK() defined, the release times do not depend on the
+main loop. The ISR only reuses the frame of the stream: the application registers the
+stream once the socket is connected, and does not call udp_send() on it while it is
+registered. Without them (the default), udp_cyclic_timer() is called from the main loop
+when the tick has elapsed, like udp_send().
+If "fill" is NULL, the application writes the data through udp_get_data_pointer().
+udp_cyclic_statistics() reports the frames sent, the release times missed and
+the worst lateness observed.
+
+<h3>4.5 Checksum</h3>
+Every frame sent or received is summed by ip_checksum(). netif_init() calls 
+ip_checksum_init() which selects the fastest kernel available: AVX2 or SSE2 on x86, 
+NEON on ARM and a word-wide sum otherwise (MicroBlaze). A kernel is only selected if it
+gives the same checksums as the 16-bit reference on a set of lengths and alignments.
+Set IP_CHECKSUM_SIMD to 0 to keep the word-wide sum.
+"make check" compiles test/ip_checksum_test.c on the host and compares every kernel and 
+ip_copy_checksum() to the reference for all lengths up to 2KB and every byte alignment.
+It also runs test/tcp_test.c: the sequence number arithmetic around the roll-over (with 
+the u32_t of the host and with a 32-bit one) and the SYN cookie round trip of a server.
+
 <h3>4.6 Point to point</h3>
 Application data are protected by check sums at three levels: Ethernet, IP and UDP.<br>
 In a point to point configuration, the UDP check sum is redundant and its 
@@ -187,6 +236,83 @@ To inhibit the UDP check sum generation, set the point_to_point parameter of udp
   //UDP_T * udp_new( u32_t ipaddr, u16_t port, u32_t point_to_point);
   udp_cb = udp_new(ip_addr, port, TRUE);
 \endcode
+
+<h3>4.7 TCP congestion control</h3>
+tcp_write() sends the segments that fit in the window of the peer device and in the 
+congestion window. The congestion window follows NewReno (default) or CUBIC. 
+CUBIC recovers faster after a loss on links with a long round trip time.
+\code
+  tcp_congestion_control(tcp_c, &tcp_cc_cubic); //before tcp_connect() or in the tcp_accept() callback
+\endcode
+Set TCP_CC_DEFAULT to change the algorithm of all the connections.
+When the peer device reports a lost segment with TCP_DUPACK_THRESHOLD duplicate ACKs, 
+cIPS retransmits it at once (fast retransmit) and keeps the data flowing during the 
+recovery (fast recovery) rather than waiting for tcp_timer().
+If the peer device supports selective acknowledgments (TCP_SACK, RFC 2018), it reports the 
+segments received after a hole and cIPS retransmits only the missing ones.
+
+<h3>4.8 TCP retransmission timer</h3>
+cIPS measures the round trip time of each connection and retransmits a lost segment after 
+the smoothed round trip time plus four times its variation (RFC 6298), at least TCP_MIN_RTO.
+By default, the TCP clock advances by TCP_TIMER_PERIOD each time tcp_timer() is called. 
+On a fast network, give cIPS a millisecond clock so that a retransmission does not wait for 
+the next tcp_timer():
+\code
+while(1)
+{
+    err = netif_dispatch(netif_adapter);
+    err = tcp_fast_timer(netif_adapter, get_time_ms());
+    ....
+}
+\endcode
+If the peer device supports the timestamps option (TCP_TIMESTAMPS, RFC 7323), every ACK 
+measures the round trip time, retransmissions included. The clock given to tcp_fast_timer()
+must not go back in time.
+The timers of the connections (retransmission, delayed ACK, state time outs, inactivity check)
+wait in a timer wheel of TCP_TIMER_WHEEL_SIZE slots: tcp_timer() and tcp_fast_timer() only 
+visit the timers due since their last call, whatever the number of connections.
+
+<h3>4.9 TCP acknowledgments and small writes</h3>
+cIPS delays the acknowledgment of the data received so that the next tcp_write() carries it.
+If the application does not write, cIPS acknowledges every second segment or after 
+TCP_DELAYED_ACK_TIMEOUT (at the resolution of the TCP clock, see 4.8). tcp_ack() sends it at once.
+An application that writes a few bytes at a time can set the Nagle algorithm (RFC 896): the small 
+writes wait for the ACK of the data in flight and leave together in one segment.
+\code
+  tcp_options(tcp_c, tcp_nagle);
+\endcode
+tcp_write() copies the data into the send ring of the connection (TCP_SND_BUF bytes) and 
+returns the number of bytes it has taken: less than requested when the ring is full. 
+The tcp_sent() callback reports the room freed by the ACKs of the peer device, so a 
+producer writes the rest without polling:
+\code
+static err_t app_sent(void *arg, TCP_T *tcp_c, u32_t space)
+{
+  err_t err = ERR_OK;
+  APP_STREAM_T *stream = (APP_STREAM_T *)arg;
+  stream->offset += tcp_write(tcp_c, stream->data + stream->offset, stream->length - stream->offset, &err);
+  return err;
+}
+  ...
+  tcp_arg(tcp_c, &stream);
+  tcp_sent(tcp_c, app_sent);
+\endcode
+
+<h3>4.10 TCP servers and connection requests</h3>
+A TCP server answers a SYN without allocating a TCP controller: the request waits in a 
+backlog of TCP_SYN_BACKLOG entries per adapter. The tcp_accept() callback is called when the 
+peer device acknowledges the SYN|ACK; if it returns an error, the peer device is reset.
+When the backlog is full, cIPS encodes the request in the sequence number of its SYN|ACK 
+(SYN cookie, TCP_SYN_COOKIES) so that a flood of SYNs does not lock the clients out. A 
+connection opened with a cookie keeps the MSS of the peer device but neither the window 
+scale, SACK nor timestamps options.
+The cookies must not be guessed: cIPS only answers them once the application has keyed
+them with a random value (hardware random generator...). Otherwise, the SYNs that do not
+fit in the backlog are dropped.
+\code
+  netif_adapter = na_new(...);
+  netif_syn_secret(netif_adapter, random32());
+\endcode
 <h2>5. Device driver API requirements</h2>
 
 cIPS is compatible with device drivers that respect the following interface:
@@ -197,6 +323,22 @@ cIPS is compatible with device drivers that respect the following interface:
 </ul>
 Otherwise an adaptation layer is needed.
 
+A device driver able to queue several frames in one call (a DMA ring for example) can 
+be plugged with netif_driver_send_batch():
+<ul>
+<li> u32_t driver_send_batch(void* pDriver_arg, u8_t **eth_frames, u32_t *byte_counts, u32_t frame_nb);</li>
+</ul>
+tcp_write() then hands all the segments that fit in the window of the peer device in one call.
+
+An adapter that verifies or inserts checksums declares it with netif_checksum_offload():
+<ul>
+<li> NETIF_CHECKSUM_RX_IP, NETIF_CHECKSUM_RX_TCP, NETIF_CHECKSUM_RX_UDP: the adapter verifies the
+received checksums. driver_receive() returns the frame length in its low 16 bits and the flags of
+the checksums it found good in the bits above NETIF_RX_CHECKSUM_SHIFT. cIPS skips only these checksums.</li>
+<li> NETIF_CHECKSUM_TX_TCP, NETIF_CHECKSUM_TX_UDP: the adapter inserts the TCP/UDP checksum. cIPS
+leaves the field at zero.</li>
+</ul>
+
 Example of adaptation layer:
 <A HREF="../../example/web_server/network_adapter/network_adapter.c">network_adapter.c</A>,
 <A HREF="../../example/web_server/network_adapter/network_adapter.h">network_adapter.h</A>
@@ -130,6 +130,13 @@
   #define FALSE 0
 #endif
 
+/*!"a" comes before "b" on a 32-bit counter that rolls over (sequence numbers, clock ticks),
+even where u32_t is wider than 32 bits: the sign of the 32-bit difference. */
+#define U32_BEFORE(a,b) (((u32_t)((a) - (b)) & 0x80000000UL) != 0)
+
+/*!Distance from "b" to "a" on a 32-bit counter that rolls over (a clock elapsed time). */
+#define U32_DIFF(a,b) ((u32_t)((a) - (b)) & 0xFFFFFFFFUL)
+
 /*!Definition of err_t */
 #ifndef err_t
   #define err_t  u32_t /*!<typedef u32_t err_t;*/
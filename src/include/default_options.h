@@ -58,17 +58,103 @@
 #define MAX_UDP                4
 #endif
 
+/* MAX_UDP_CYCLIC: Max nb of cyclic UDP streams per network adapter. */
+#ifndef MAX_UDP_CYCLIC
+#define MAX_UDP_CYCLIC                4
+#endif
+
+/* NETIF_LOCK, NETIF_UNLOCK: Critical section around the device driver calls 
+and the cyclic UDP stream updates. They are empty by default: udp_cyclic_timer() 
+is then called from the main loop like udp_send(). To call it from the timer ISR, 
+define them to mask the timer interrupt (or to take the driver lock) and restore it. */
+#ifndef NETIF_LOCK
+#define NETIF_LOCK()
+#endif
+#ifndef NETIF_UNLOCK
+#define NETIF_UNLOCK()
+#endif
+
 /* MAX_TCP: Max nb of TCP controllers. */
 #ifndef MAX_TCP
 #define MAX_TCP                20
 #endif
 
+/* TCP_HASH_SIZE: Nb of buckets of the table that links an incoming segment
+to its connection, hashed on (remote IP, remote port, local port). Power of 2.
+About MAX_TCP / 2 keeps the chains short. */
+#ifndef TCP_HASH_SIZE
+#define TCP_HASH_SIZE                16
+#endif
+
+/* TCP_LISTEN_HASH_SIZE: Nb of buckets of the table of the TCP servers, 
+hashed on their port. Power of 2. */
+#ifndef TCP_LISTEN_HASH_SIZE
+#define TCP_LISTEN_HASH_SIZE                4
+#endif
+
+/* TCP_TIMER_WHEEL_SIZE: Nb of slots of the wheel holding the TCP timers 
+(retransmission, delayed ACK, state time outs, inactivity check). Power of 2.
+tcp_timer() and tcp_fast_timer() only visit the slots elapsed since their last call. */
+#ifndef TCP_TIMER_WHEEL_SIZE
+#define TCP_TIMER_WHEEL_SIZE                64
+#endif
+
+/* TCP_TIMER_WHEEL_SLOT: Nb of milliseconds covered by one slot of the TCP 
+timer wheel. Power of 2. The timers longer than TCP_TIMER_WHEEL_SIZE x 
+TCP_TIMER_WHEEL_SLOT go round the wheel. It does not change the resolution
+of the timers: it is the one of the TCP clock. */
+#ifndef TCP_TIMER_WHEEL_SLOT
+#define TCP_TIMER_WHEEL_SLOT                8
+#endif
+
+/* TCP_SYN_BACKLOG: Nb of connection requests (SYN received, SYN|ACK sent) 
+that the TCP servers of an adapter hold until the final ACK. A request takes 
+a few bytes: the TCP controller (MAX_TCP) is only allocated once the peer 
+device completes the handshake. At least 1. */
+#ifndef TCP_SYN_BACKLOG
+#define TCP_SYN_BACKLOG                8
+#endif
+
+/* TCP_SYN_COOKIES: 1 to answer with a SYN cookie once the SYN backlog is 
+full: the request is encoded in the sequence number of the SYN|ACK and no 
+option but the MSS is negotiated. 0 to drop the SYN. The cookies are only 
+answered once the application has given a random secret to the adapter 
+with netif_syn_secret(). */
+#ifndef TCP_SYN_COOKIES
+#define TCP_SYN_COOKIES                1
+#endif
+
 
 /* MAX_TCP_SEG: Max nb of outgoing segments per TCP controller. */
 #ifndef MAX_TCP_SEG
 #define MAX_TCP_SEG                10
 #endif
 
+/* TCP_FRAME_POOL: Nb of frames (NETWORK_MTU bytes) shared by the TCP 
+controllers of an adapter. The data segments borrow them only while they 
+are built and handed to the device driver (MAX_TCP_SEG at most at a time): 
+they are reused once "driver_send" or "driver_send_batch" returns, so the 
+driver copies or sends them before returning. A SYN or a FIN keeps its 
+frame until the peer device acknowledges it: an idle connection holds none.
+At least 1. */
+#ifndef TCP_FRAME_POOL
+#define TCP_FRAME_POOL                (MAX_TCP + MAX_TCP_SEG)
+#endif
+
+/* TCP_RCV_RING_POOL: Nb of receive rings (TCP_WND bytes) shared by the TCP 
+controllers of an adapter. A controller borrows one, at most, while segments
+wait out of order. At least 1. */
+#ifndef TCP_RCV_RING_POOL
+#define TCP_RCV_RING_POOL                ((MAX_TCP + 3) / 4)
+#endif
+
+/* TCP_SND_RING_POOL: Nb of send rings (TCP_SND_BUF bytes) shared by the TCP 
+controllers of an adapter. A controller borrows one while the data it has 
+written are unsent or unacknowledged. At least 1. */
+#ifndef TCP_SND_RING_POOL
+#define TCP_SND_RING_POOL                ((MAX_TCP + 1) / 2)
+#endif
+
 /* ---------- ARP options ---------- */
 
 /*Max nb of hardware address IP address pairs cached.*/
@@ -77,10 +163,22 @@
 #endif
 
 
+/* ---------- IP options ---------- */
+
+/* IP_CHECKSUM_SIMD: 1 to let ip_checksum_init() select the SSE2, AVX2 or NEON
+checksum when the compiler and the processor support it (host port).
+0 keeps the portable word-wide checksum (MicroBlaze). */
+#ifndef IP_CHECKSUM_SIMD
+#define IP_CHECKSUM_SIMD                1
+#endif
+
 /* ---------- TCP options ---------- */
 
+/* TCP_WND: size of the receive ring of each TCP controller, advertised as 
+   the receive window. Above 65535 bytes, cIPS scales the window if the peer 
+   device supports it (RFC 7323). */
 #ifndef TCP_WND
-#define TCP_WND                         16 * 1024
+#define TCP_WND                         (16 * 1024)
 #endif
 
 /* TCP Maximum segment size. */
@@ -88,6 +186,43 @@
 #define TCP_MSS                         1460
 #endif
 
+/* TCP_SND_BUF: size of the send ring of each TCP controller: the bytes 
+   written by tcp_write() and not acknowledged yet. The segments are cut 
+   from it when they leave, so small writes share full segments. */
+#ifndef TCP_SND_BUF
+#define TCP_SND_BUF                     (MAX_TCP_SEG * TCP_MSS)
+#endif
+
+/* MAX_TCP_OUT_OF_ORDER: Max nb of incoming segments received out of order per TCP controller. */
+#ifndef MAX_TCP_OUT_OF_ORDER
+#define MAX_TCP_OUT_OF_ORDER            MAX_TCP_SEG
+#endif
+
+/* TCP_DUPACK_THRESHOLD: number of duplicate ACKs that trigger a fast retransmission. */
+#ifndef TCP_DUPACK_THRESHOLD
+#define TCP_DUPACK_THRESHOLD            3
+#endif
+
+/* TCP_SACK: 1 to negotiate selective acknowledgments (RFC 2018). The 
+peer device reports the segments received after a hole, and cIPS 
+retransmits only the missing ones. */
+#ifndef TCP_SACK
+#define TCP_SACK                        1
+#endif
+
+/* TCP_TIMESTAMPS: 1 to negotiate the timestamps option (RFC 7323). Each 
+segment carries the TCP clock: every ACK measures the round trip time, 
+retransmissions included, and old duplicate segments are discarded (PAWS). */
+#ifndef TCP_TIMESTAMPS
+#define TCP_TIMESTAMPS                  1
+#endif
+
+/* TCP_CC_DEFAULT: congestion control of the new connections, tcp_cc_newreno 
+or tcp_cc_cubic. tcp_congestion_control() changes it per connection. */
+#ifndef TCP_CC_DEFAULT
+#define TCP_CC_DEFAULT                  tcp_cc_newreno
+#endif
+
 
 /* ---------- Debug options ---------- */
 
@@ -45,10 +45,11 @@ extern "C" {
  * \return ERR_CHECKSUM, ERR_OK, ERR_CHECKSUM or ERR_DEVICE_DRIVER
  * \param eth_frame : [in] Ethernet frame.
  * \param eth_frame_length : [in] Ethernet frame length.
+ * \param rx_checksum : [in] NETIF_CHECKSUM_RX_* checksums already verified by the adapter.
  * \param net_adapter : [in] Adpater providing the frame.
  * \brief Parse the IP frame.
  * *******************************************************************/
-  err_t ip_parse(u8_t* eth_frame, u32_t eth_frame_length, struct NETIF_S *net_adapter);
+  err_t ip_parse(u8_t* eth_frame, u32_t eth_frame_length, u32_t rx_checksum, struct NETIF_S *net_adapter);
 
 /*!
  * Function name: eth_build_ip_request
@@ -63,6 +64,16 @@ extern "C" {
  * *******************************************************************/
  void eth_build_ip_request( const u32_t dest_ip_addr, const u32_t source_ip_addr, u8_t* const ip_output_frame, const u32_t transport_length, const u8_t protocol, const bool_t reuse);
 
+/*!
+ * Function name: ip_update_length
+ * \return nothing.
+ * \param ip_output_frame : [in/out] Frame starting at the IP header. Its header is complete.
+ * \param transport_length : [in] New length of Udp (or TCP) header and app data.
+ * \brief Change the length of a complete IP header and update its 
+ * checksum incrementally instead of recalculating it.
+ * *******************************************************************/
+void ip_update_length( u8_t* const ip_output_frame, const u32_t transport_length);
+
 /*!
  * Function name: eth_build_pseudo_header
  * \return Sum of the speudo header elts (in big endian).
@@ -79,6 +90,30 @@ extern "C" {
  * *******************************************************************/
  u16_t eth_build_pseudo_header( const u32_t dest_ip_addr, const u32_t source_ip_addr,const u32_t data_size, const u32_t proto_length, const u8_t protocol); 
 
+/*!
+ * Function name: ip_pseudo_header_sum
+ * \return Sum of the addresses and protocol of the speudo header (in the endianness of the platform).
+ * \param dest_ip_addr : [in] Destination IP address.
+ * \param source_ip_addr : [in] Source IP address.
+ * \param protocol : [in] IP_UDP or IP_TCP.
+ * \brief The addresses and the protocol of a speudo header are constant for the
+ * life of a connection. cIPS sums them once when it sets up the connection and
+ * only adds the length with ip_pseudo_header_length() for each frame.
+ * \note The sum is the same whatever the direction: the source and destination 
+ * addresses can be swapped.
+ * *******************************************************************/
+u32_t ip_pseudo_header_sum( const u32_t dest_ip_addr, const u32_t source_ip_addr, const u8_t protocol);
+
+/*!
+ * Function name: ip_pseudo_header_length
+ * \return Sum of the speudo header elts (in big endian).
+ * \param pseudo_sum : [in] Return of ip_pseudo_header_sum().
+ * \param transport_length : [in] Length of the UDP (or TCP) header and app data.
+ * \brief Complete the sum of a speudo header with the only field that 
+ * changes from a frame to another: the length.
+ * *******************************************************************/
+u16_t ip_pseudo_header_length( const u32_t pseudo_sum, const u32_t transport_length);
+
 
 /*!
  * Function name: ip_checksum
@@ -93,6 +128,51 @@ extern "C" {
  * *******************************************************************/
 u16_t ip_checksum(const u16_t *ipHeader, u32_t byte_nb);
 
+/*!
+ * Function name: ip_copy_checksum
+ * \return checksum value of the copied data (in big endian).
+ * \param output : [out] buffer to copy into. 16-bit aligned.
+ * \param input : [in] buffer to copy.
+ * \param byte_nb : [in] Size in "bytes" of "input". Less than 128KB.
+ * \brief Copy "input" into "output" and compute the 16-bit one's 
+ * complement checksum of the data in the same pass. The result is the 
+ * one of ip_checksum( output, byte_nb).
+ * \note the complement is not done and should done outside if needed.
+ * *******************************************************************/
+u16_t ip_copy_checksum(u8_t* output, const u8_t* input, u32_t byte_nb);
+
+/*!
+ * Function name: ip_checksum_update16
+ * \return the new checksum (in big endian).
+ * \param checksum : [in] checksum field of the header (in big endian).
+ * \param old_value : [in] 16-bit field before the change (as in the frame).
+ * \param new_value : [in] 16-bit field after the change (as in the frame).
+ * \brief Update a checksum when one 16-bit field of a header changes,
+ * without summing the header and the data again (RFC1624).
+ * *******************************************************************/
+u16_t ip_checksum_update16(const u16_t checksum, const u16_t old_value, const u16_t new_value);
+
+/*!
+ * Function name: ip_checksum_update32
+ * \return the new checksum (in big endian).
+ * \param checksum : [in] checksum field of the header (in big endian).
+ * \param old_value : [in] 32-bit field before the change (as in the frame).
+ * \param new_value : [in] 32-bit field after the change (as in the frame).
+ * \brief Same as ip_checksum_update16() for a 32-bit field (sequence 
+ * number, IP address...).
+ * *******************************************************************/
+u16_t ip_checksum_update32(const u16_t checksum, const u32_t old_value, const u32_t new_value);
+
+/*!
+ * Function name: ip_checksum_init
+ * \return nothing.
+ * \brief Select the fastest checksum kernel available (SSE2, AVX2, NEON or
+ * portable word-wide) for ip_checksum(). Each kernel must give the same
+ * result as the 16-bit reference on a set of lengths and alignments 
+ * before being selected. Called by netif_init().
+ * *******************************************************************/
+void ip_checksum_init(void);
+
 /*!
  * Function name: icmp_ping
  * \return ERR_OK, ERR_VAL or ERR_MAC_ADDR_UNKNOWN.
@@ -42,6 +42,19 @@ extern "C" {
 #include "tcp.h"
 
 #define MAC_ADDRESS_LENGTH 6
+
+//! Checksum offload: capabilities of the network adapter (see netif_checksum_offload()).
+#define NETIF_CHECKSUM_RX_IP  0x01UL //!< The adapter verifies the IPv4 header checksum of the incoming frames.
+#define NETIF_CHECKSUM_RX_TCP 0x02UL //!< The adapter verifies the TCP checksum of the incoming frames.
+#define NETIF_CHECKSUM_RX_UDP 0x04UL //!< The adapter verifies the UDP checksum of the incoming frames.
+#define NETIF_CHECKSUM_RX (NETIF_CHECKSUM_RX_IP | NETIF_CHECKSUM_RX_TCP | NETIF_CHECKSUM_RX_UDP)
+#define NETIF_CHECKSUM_TX_TCP 0x10UL //!< The adapter inserts the TCP checksum of the outgoing frames.
+#define NETIF_CHECKSUM_TX_UDP 0x20UL //!< The adapter inserts the UDP checksum of the outgoing frames.
+//! The RX descriptor: "driver_recv" returns the frame length in the low 16 bits and, 
+//! shifted by NETIF_RX_CHECKSUM_SHIFT, the NETIF_CHECKSUM_RX_* checksums the adapter 
+//! verified as correct for that frame. Drivers without offload return the length only.
+#define NETIF_RX_CHECKSUM_SHIFT 16
+#define NETIF_RX_LENGTH_MASK 0xFFFFUL
 #define UNUSED (~0) //!< Value indicating that a resource is not used
 //! MTU_STORAGE: The Maximum Transfer Unit is the largest block of data that 
 //! the network adapter exchange. The typical value is 1518. 
@@ -69,9 +82,11 @@ typedef struct NETIF_S {
   u32_t subnetwork; //!<Prefix address defining the subnetwork and introduced to avoid recalculation. It is defined as (ip_addr & netmask).
   err_t (*ping_received)(struct NETIF_S *netif_ptr, void *arg, u8_t *icmp_data, u32_t icmp_data_length); //!<Callback when a ping is received.
   err_t (*ping_reply_received)(struct NETIF_S *netif_ptr, void *arg, u8_t *icmp_data, u32_t icmp_data_length); //!<Callback when a response to a ping is received.
-  u32_t (*driver_recv)(void* pDriver_arg, u8_t *eth_frame); //!<The device driver link for reception (XEmacLite_Recv)
-  err_t (*driver_send)(void* pDriver_arg, u8_t *eth_frame, u32_t byte_count); //!<The link to the device driver (XEmacLite_Send)
+  u32_t (*driver_recv)(void* pDriver_arg, u8_t *eth_frame); //!<The device driver link for reception (XEmacLite_Recv). See NETIF_RX_CHECKSUM_SHIFT.
+  err_t (*driver_send)(void* pDriver_arg, u8_t *eth_frame, u32_t byte_count); //!<The link to the device driver (XEmacLite_Send). The frame is reused as soon as it returns: the driver copies it or has sent it.
+  err_t (*driver_send_batch)(void* pDriver_arg, u8_t **eth_frames, u32_t *byte_counts, u32_t frame_nb); //!<Optional link to a device driver queuing several frames in one call. NULL if the driver does not support it. Same contract as "driver_send": the frames are reused as soon as it returns.
   void* pDriver_arg; //!< Backup of the first argument to use with "(*driver_send)".
+  u32_t checksum_offload; //!< NETIF_CHECKSUM_* flags: checksums verified or inserted by the adapter.
   u8_t mac_address[MAC_ADDRESS_LENGTH];
   char name[3]; //!< last character in the end of string character.
   u32_t num; //!<  number of this interface or UNUSED if not used.
@@ -79,11 +94,30 @@ typedef struct NETIF_S {
 
   //Receiving queue
   u8_t ethernet_frame_list[RECV_BUF_SIZE][MTU_STORAGE];//!<circular buffer of all ethernet frames received
+  u32_t rx_checksum_list[RECV_BUF_SIZE]; //!<NETIF_CHECKSUM_RX_* checksums verified by the adapter for each frame of ethernet_frame_list.
   u8_t control_buffer[MTU_STORAGE];
   u32_t rcv_pos_insert; //!<index related to ethernet_frame_list only.
   u32_t rcv_pos_remove; //!<index related to filtered_ethernet_frame_list only.
   u32_t ISR_rcv_nb; //!<number of frames received in netif_ISR (and inserted into the circular buffer).
   u32_t processed_nb; //!<number of frames processed in netif_dispatch() (from the circular buffer).
+  u32_t unmatched_nb; //!<number of TCP and UDP frames dropped because no controller (or server) accepts them. Their checksum is not verified.
+  u32_t tcp_clock; //!<time in ms seen by TCP. tcp_timer() advances it by TCP_TIMER_PERIOD unless the application calls tcp_fast_timer().
+  bool_t tcp_fine_clock; //!<TRUE once the application drives "tcp_clock" with tcp_fast_timer().
+  TCP_TIMER_T *tcp_wheel[TCP_TIMER_WHEEL_SIZE]; //!< Timer wheel of the TCP controllers: an armed timer waits in the slot of its expiry, (expiry / TCP_TIMER_WHEEL_SLOT) modulo TCP_TIMER_WHEEL_SIZE.
+  u32_t tcp_wheel_time; //!< "tcp_clock" when the wheel was last visited.
+  TCP_SYN_T tcp_syn_list[TCP_SYN_BACKLOG]; //!< Connection requests of the TCP servers waiting for the final ACK (SYN backlog).
+  TCP_SYN_T *tcp_syn_cs; //!< Requests of "tcp_syn_list" in use.
+  TCP_SYN_T *tcp_syn_free; //!< Requests of "tcp_syn_list" not used.
+  u32_t tcp_syn_secret; //!< Secret of the SYN cookies and of the initial sequence numbers of the servers (see netif_syn_secret()).
+  bool_t tcp_syn_seeded; //!< TRUE once the application has given a random "tcp_syn_secret": cIPS only answers with SYN cookies then.
+  u8_t tcp_syn_frame[TCP_SYN_FRAME_LENGTH]; //!< Frame of the SYN|ACK of the requests (see tcp_listen_syn()).
+  TCP_FRAME_T tcp_frames[TCP_FRAME_POOL]; //!< Frames of the outgoing segments while they are built and sent, shared by the TCP controllers.
+  TCP_FRAME_T *tcp_frame_free; //!< Frames of "tcp_frames" not borrowed.
+  u32_t tcp_frame_free_nb; //!< Number of frames in "tcp_frame_free".
+  TCP_RCV_RING_T tcp_rcv_rings[TCP_RCV_RING_POOL]; //!< Receive rings of the segments received out of order, shared by the TCP controllers.
+  TCP_RCV_RING_T *tcp_rcv_ring_free; //!< Rings of "tcp_rcv_rings" not borrowed.
+  TCP_SND_RING_T tcp_snd_rings[TCP_SND_RING_POOL]; //!< Send rings of the data written by the applications, shared by the TCP controllers.
+  TCP_SND_RING_T *tcp_snd_ring_free; //!< Rings of "tcp_snd_rings" not borrowed.
   bool_t optimized; //!<flag indicating the level of filtering and whether UDP should be processed in the ISR.
   //Icmp arg
   void *callback_arg;
@@ -91,15 +125,20 @@ typedef struct NETIF_S {
   //!tcp_c_list[] holds all the tcp connectors. The tcp connectors can be servers, inherited from a server, clients or not used.
   //!tcp_server_cs is the start of a link-list. It links elements of tcp_c_list[].
   //!It links all the TCP controllers that are in a LISTEN state (i.e servers).
-  //!The link list isolates a subset of connectors but also sorts them. As a result, cIPS goes fast through the connectors of interest.
+  //!The link list isolates a subset of connectors. As a result, cIPS goes fast through the connectors of interest.
   TCP_T *tcp_server_cs;
   TCP_T *tcp_active_cs; //!< tcp_active_cs has the same function as tcp_server_cs but for all the TCP controllers that are in a state in which they accept or send data (i.e inherited from a server and clients).The "active" name comes from the "active OPEN" transission in the RFC973.
+  TCP_T *tcp_free_cs; //!< Controllers of tcp_c_list[] not used. The lists are doubly linked: a controller joins or leaves a list in O(1).
+  TCP_T *tcp_hash[TCP_HASH_SIZE]; //!< Controllers of "tcp_active_cs" hashed on (remote IP, remote port, local port): tcp_demultiplex() finds a connection without browsing the list.
+  TCP_T *tcp_listen_hash[TCP_LISTEN_HASH_SIZE]; //!< Controllers of "tcp_server_cs" hashed on their local port.
   //!udp_c_list[] holds all the udp connectors. The udp connectors can be used or not.
   //!udp_cs is the start of a link-list. It links elements of udp_c_list[].
   //!It links all the UDP controllers that are used.
   UDP_T *udp_cs;
+  UDP_T *udp_free_cs; //!< Controllers of udp_c_list[] not used.
   TCP_T tcp_c_list[MAX_TCP]; //!< TCP resource (see comment above)
   UDP_T udp_c_list[MAX_UDP]; //!< UDP resource (see comment above)
+  UDP_CYCLIC_T udp_cyclic_list[MAX_UDP_CYCLIC]; //!< Cyclic UDP streams sent by udp_cyclic_timer().
   u8_t garbage_buffer[MTU_STORAGE]; //!< If netif cannot keep up with incoming frame interruption then they are put in this buffer and ignored
 } NETIF_T;
 
@@ -127,7 +166,8 @@ void netif_init(void);
  * \param driver_recv : [in] Pointer of function to the device driver
  * receive function(XEmacLite_Recv).
  * \param driver_send : [in] interrupt ID related to the ethenet 
- * HW number "emac_deviceId"
+ * HW number "emac_deviceId". When it returns, cIPS reuses the frame: the 
+ * driver has sent it or has copied it (into its DMA ring for example).
  * \param pDriver_arg : [in] Device driver object (which is only 
  * stored in netif for reference).
  * \param err : [out] ERR_MEM if more than MAX_NET_ADAPTER already 
@@ -201,6 +241,63 @@ err_t netif_dispatch(NETIF_T *netif_ptr);
  * *******************************************************************/
 err_t netif_send(NETIF_T* netif_ptr, u8_t* frame, u32_t frame_length);
 
+/*!
+ * Function name: netif_send_batch
+ * \return ERR_OK or ERR_DEVICE_DRIVER
+ * \param pnetif : [in] network adapter.
+ * \param frames : [in] ethernet frames.
+ * \param frame_lengths : [in] ethernet frame lengths.
+ * \param frame_nb : [in] number of frames.
+ * \brief Forward several ethernet frames to the device driver in one call
+ * if the driver supports it (see netif_driver_send_batch()), one by one
+ * with netif_send() otherwise.
+ * *******************************************************************/
+err_t netif_send_batch(NETIF_T* netif_ptr, u8_t** frames, u32_t* frame_lengths, u32_t frame_nb);
+
+/*!
+ * Function name: netif_checksum_offload
+ * \return nothing.
+ * \param adapter : [out] adapter of interest.
+ * \param capabilities : [in] NETIF_CHECKSUM_* flags.
+ * \brief Declare the checksums that the adapter verifies (RX) or inserts 
+ * (TX) in hardware. cIPS does not calculate them anymore: 
+ * - RX: a frame is trusted if "driver_recv" reports that checksum as 
+ * verified (see NETIF_RX_CHECKSUM_SHIFT). Otherwise cIPS verifies it.
+ * - TX: the checksum field is left to zero for the adapter to fill in.
+ * *******************************************************************/
+void netif_checksum_offload (NETIF_T* adapter, u32_t capabilities);
+
+/*!
+ * Function name: netif_driver_send_batch
+ * \return nothing.
+ * \param adapter : [out] adapter of interest.
+ * \param driver_send_batch : [in] device driver function queuing several
+ * frames in one call (with the same "pDriver_arg" as "driver_send").
+ * \brief Some device drivers (DMA rings...) send a batch of frames for
+ * the cost of one. TCP hands the segments of a tcp_write() to the driver 
+ * in one batch when the application plugs such a function.
+ * \note The frames go back to the TCP frame pool (TCP_FRAME_POOL) as soon
+ * as "driver_send_batch" returns, and the next segments overwrite them. A
+ * driver that queues the frames copies them into its own buffers (its DMA
+ * ring) before it returns, or waits for their transmission.
+ * *******************************************************************/
+void netif_driver_send_batch (NETIF_T* adapter, err_t (* driver_send_batch)(void* pDriver_arg, u8_t** eth_frames, u32_t* byte_counts, u32_t frame_nb));
+
+/*!
+ * Function name: netif_syn_secret
+ * \return nothing.
+ * \param adapter : [out] adapter of interest.
+ * \param random_seed : [in] 32 random bits (hardware random generator, 
+ * noise of an ADC...).
+ * \brief Key the SYN cookies and the initial sequence numbers of the TCP
+ * servers with a secret that a peer device cannot guess. Until the 
+ * application calls netif_syn_secret(), the secret is derived from the 
+ * addresses of the adapter and the TCP servers drop the SYNs that do not 
+ * fit in the SYN backlog instead of answering with a SYN cookie (which
+ * could be forged).
+ * *******************************************************************/
+void netif_syn_secret (NETIF_T* adapter, u32_t random_seed);
+
 
 
 /*!
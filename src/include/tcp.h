@@ -40,6 +40,7 @@
 #define __TCP_H__
 
 #include "arch.h"
+#include "tcp_cc.h"
 
 #ifndef TCP_TIMER_PERIOD
 #define TCP_TIMER_PERIOD  500  /*TCP timer period in milliseconds. */
@@ -47,14 +48,31 @@
 
 #define TCP_FIN_WAIT_TIMEOUT 4000 /* milliseconds */
 #define TCP_SYN_RCVD_TIMEOUT 10000 /* milliseconds */
-#define TCP_RETRANSMISSION_TIMEOUT 3000 /* milliseconds */
+#ifndef TCP_RETRANSMISSION_TIMEOUT
+#define TCP_RETRANSMISSION_TIMEOUT 3000 /* milliseconds without acknowledgment before cIPS resets the connection. */
+#endif
+#ifndef TCP_INITIAL_RTO
+#define TCP_INITIAL_RTO 1000 /* milliseconds. Retransmission time out until the round trip time is measured (RFC 6298). */
+#endif
+#ifndef TCP_MIN_RTO
+#define TCP_MIN_RTO 200 /* milliseconds. Lower bound of the retransmission time out. */
+#endif
+#ifndef TCP_MAX_RTO
+#define TCP_MAX_RTO 60000 /* milliseconds. Upper bound of the retransmission time out (back-off included). */
+#endif
+#ifndef TCP_DELAYED_ACK_TIMEOUT
+#define TCP_DELAYED_ACK_TIMEOUT 200 /* milliseconds. Longest delay of an ACK that no data segment carries (RFC 1122 allows up to 500 ms). */
+#endif
+#define TCP_SYN_FRAME_LENGTH 80 /* bytes. Ethernet, IP and TCP headers of a SYN|ACK with its options (78 bytes at most). */
+#define TCP_CONTROL_FRAME_LENGTH 96 /* bytes. Ethernet, IP and TCP headers with 40 bytes of options at most, or an ARP request. */
+#define TCP_SEQ_MASK 0xFFFFFFFFUL /* Sequence numbers are 32-bit, u32_t may be wider. */
 
 //! The application can configure a connection with the following options
 //! and tcp_options().
  typedef enum{
   tcp_no_options = 0,
-  tcp_delay_ack_reply = 1, //Bit 0: ACK delayed (set), immediate otherwise.
-  tcp_option1 = (1<<1), //Bit 1: for future usage.
+  tcp_delay_ack_reply = 1, //Bit 0: kept for compatibility. cIPS always delays the ACK (see tcp_ack()).
+  tcp_nagle = (1<<1), //Bit 1: Nagle algorithm (RFC 896). The small writes wait for the ACK of the data in flight and are coalesced.
   tcp_option2 = (1<<2), //Bit 2: for future usage.
 } TCP_OPTIONS_T;
 
@@ -83,66 +101,166 @@ typedef enum{
 
 /*!TCP must keep track of the frames it sends. So TCP has a pool of sending segments with a state
 TCP_SEG_UNUSED: the segment is free.
-TCP_SEG_UNSENT: the segment contains a frame that has not been sent yet.
-TCP_SEG_UNACKED: the segment contains a frame that has been sent but not acknowledged yet.*/
+TCP_SEG_UNACKED: the segment describes bytes of "snd_ring" (or the SYN) that have been sent but not acknowledged yet.
+The bytes that have not been sent yet wait in "snd_ring" (see "snd_queued"): no segment describes them.*/
 typedef enum {
   TCP_SEG_UNUSED = 0,
-  TCP_SEG_UNSENT = 1,
-  TCP_SEG_UNACKED = 2,
+  TCP_SEG_UNACKED = 1,
   TCP_SEG_NB
 } seg_state;
 
 struct NETIF_S;
 
+//! Frame of the pool of the adapter ("netif->tcp_frames"). A segment borrows it while it is built and sent, the SYN until it is acknowledged.
+typedef struct TCP_FRAME_S {
+  struct TCP_FRAME_S *next; //!< Next frame of "netif->tcp_frame_free".
+  u8_t frame[NETWORK_MTU]; //!< Ethernet frame.
+} TCP_FRAME_T;
+
+//! Receive ring of the pool of the adapter ("netif->tcp_rcv_rings"). A controller borrows it while segments wait out of order.
+typedef struct TCP_RCV_RING_S {
+  struct TCP_RCV_RING_S *next; //!< Next ring of "netif->tcp_rcv_ring_free".
+  u8_t data[TCP_WND]; //!< Data received after a hole, at their distance from "remote_seqno".
+} TCP_RCV_RING_T;
+
+//! Send ring of the pool of the adapter ("netif->tcp_snd_rings"). A controller borrows it while data are unacknowledged or unsent.
+typedef struct TCP_SND_RING_S {
+  struct TCP_SND_RING_S *next; //!< Next ring of "netif->tcp_snd_ring_free".
+  u8_t data[TCP_SND_BUF]; //!< Byte stream of the application, at their distance from "snd_ring_base".
+} TCP_SND_RING_T;
+
 //< This structure is used to repressent TCP segments when queued.
 typedef struct TCP_SENDING_SEG_S {
-  seg_state state; //!< TCP_SEG_UNUSED, TCP_SEG_UNSENT or TCP_SEG_UNACKED.
+  seg_state state; //!< TCP_SEG_UNUSED or TCP_SEG_UNACKED.
   u32_t ack_no; //!< acknowlegement number expected when an ACK is received.
-  u8_t frame[NETWORK_MTU]; //!< buffer containing the entire ethernet frame.
+  u8_t *frame; //!< buffer containing the entire ethernet frame: "buffer->frame", or "control_frame" of the controller for its control segment. NULL if none.
+  TCP_FRAME_T *buffer; //!< Frame borrowed from the pool of the adapter while the segment is built and sent, or while the SYN is unacknowledged. NULL otherwise: the data are in "snd_ring".
   bool_t frame_initialized; //!< Flag indicating whether the constant fields have been set in "frame" (TRUE if set).
+  bool_t header_only; //!< TRUE if "frame" holds a complete TCP header without options nor data. Its checksum can be updated incrementally.
+  bool_t sacked; //!< TRUE if the peer device reported the segment in a SACK block: cIPS does not retransmit it.
+  bool_t retransmitted; //!< TRUE if the segment has been retransmitted during the current loss episode.
   u16_t len; //!< the Ethernet length of this segment.
   TCP_HEADER_T *tcphdr; //!< the TCP header.
-  u32_t retransmission_timer_slice; //!< retransmission timer slice for this segment. The application calls tcp_timer() every 500ms but the TCP retransmission is 3s. retransmission_timer_slice is a counter adapting one period (500ms) to the other (3s). tcp_timer() increments retransmission_timer_slice until it reaches 3s.
 } TCP_SENDING_SEG_T;
 
+//! Segment received after a hole, waiting in "rcv_ring" (see tcp_store_out_of_order()).
+typedef struct TCP_OUT_OF_ORDER_S {
+  u32_t seqno; //!< Sequence number of the first byte.
+  u32_t length; //!< Number of bytes.
+} TCP_OUT_OF_ORDER_T;
+
+//! Timers of a TCP controller. They wait in the timer wheel of the adapter (see tcp_timer()).
+typedef enum {
+  TCP_TIMER_RTO = 0, //!< Retransmission time out ("rto_expiry").
+  TCP_TIMER_DELAYED_ACK = 1, //!< Delayed ACK ("ack_deadline").
+  TCP_TIMER_STATE = 2, //!< Time out of SYN_RCVD, FIN_WAIT_1, FIN_WAIT_2, CLOSING, LAST_ACK and TIME_WAIT.
+  TCP_TIMER_CHECK = 3, //!< Inactivity check (see tcp_check_connection()).
+  TCP_TIMER_NB
+} tcp_timer_kind;
+
+struct TCP_S;
+
+//! Timer of a TCP controller, linked in a slot of the timer wheel of the adapter ("tcp_wheel") while it is armed.
+typedef struct TCP_TIMER_S {
+  struct TCP_TIMER_S *next; //!< Next timer of the slot.
+  struct TCP_TIMER_S **pprev; //!< Link pointing to this timer. NULL if the timer is not armed.
+  u32_t expiry; //!< Time (ms) when the timer expires.
+  u32_t timeout; //!< Duration (ms) the timer has been armed for.
+  struct TCP_S *tcp_c; //!< Controller of the timer.
+  tcp_timer_kind kind; //!< Event of the timer.
+} TCP_TIMER_T;
+
+//! Connection request received by a TCP server: the SYN|ACK has been sent, the final ACK has not 
+//! arrived yet. The request waits in the SYN backlog of the adapter, the TCP controller is only
+//! allocated with the final ACK (see tcp_listen_syn()).
+typedef struct TCP_SYN_S {
+  struct TCP_SYN_S *next; //!< Next request of "netif->tcp_syn_cs" or "netif->tcp_syn_free".
+  struct TCP_S *server; //!< Server that the peer device connects to.
+  u32_t remote_ip; //!< IP address of the peer device.
+  u16_t remote_port; //!< TCP port of the peer device.
+  u8_t remote_mac[MAC_ADDRESS_LENGTH]; //!< MAC address the SYN came from.
+  u32_t irs; //!< Sequence number of the SYN of the peer device.
+  u32_t iss; //!< Sequence number of the SYN|ACK.
+  u32_t remote_wnd; //!< Window of the SYN (never scaled).
+  u32_t remote_mss; //!< MSS option of the SYN, 0 if none.
+  u32_t peer_options; //!< Options of the SYN that cIPS offers too (TCP_PEER_* bits).
+  u8_t snd_wnd_scale; //!< Window scale option of the SYN.
+  u32_t ts_recent; //!< Timestamp of the SYN.
+  u32_t expiry; //!< Time (ms) when the request can be dropped (TCP_SYN_RCVD_TIMEOUT).
+} TCP_SYN_T;
+
 //< TCP control
 typedef struct TCP_S {
   u32_t local_ip; //!<CIPS ip address
   u32_t remote_ip; //!<The ip address of the peer device that cIPS communicates with.
   u16_t local_port; //!<CIPS TCP port
   u16_t remote_port; //!<The TCP port of the peer device that cIPS communicates with.
+  u32_t pseudo_sum; //!< Addresses and protocol part of the speudo header sum (ip_pseudo_header_sum()). Constant for the life of the connection, set by segment_init_connection().
   struct TCP_S *next; //!< for the linked list
+  struct TCP_S *prev; //!< Previous controller in the list, NULL for the first one.
+  struct TCP_S **list; //!< Head of the list holding the controller ("tcp_server_cs", "tcp_active_cs" or "tcp_free_cs" of the adapter). NULL if none.
+  struct TCP_S *hash_next; //!< Next controller in the same bucket of "netif->tcp_hash" or "netif->tcp_listen_hash".
+  struct TCP_S **hash_bucket; //!< Bucket holding the controller. NULL if the controller is not hashed (see tcp_register()).
   struct NETIF_S *netif; //!< network interface for this packet
   enum tcp_state state; //!< TCP state. See "TCP Connection State Diagram" of the RFC793.
   TCP_SENDING_SEG_T control_segment; //!< buffer containing the entire ethernet frame used to send an ACK
+  u32_t control_frame[(TCP_CONTROL_FRAME_LENGTH + sizeof(u32_t) - 1) / sizeof(u32_t)]; //!< Storage of "control_segment.frame", aligned on 4 bytes.
   //! remote_ACK_counter: The peer device sends a TCP frame to cIPS, then cIPS must 
-  //! acknowledge it. The acknowledgment is not always right away. It can be 
+  //! acknowledge it. The acknowledgment is not always right away. It is 
   //! delayed and multiplexed with the next outgoing data (tcp_write()).
-  //! "remote_ACK_counter" is associated with tcp_options() and tcp_ack()
+  //! "remote_ACK_counter" is associated with tcp_ack() and "ack_deadline".
   //! 0 means that cIPS has no acknowledgment to send. Greater than zero represents 
-  //! the amount of ACK received since the last sent. "remote_ACK_counter" acknowledges "remote_seqno".
+  //! the amount of segments received since the last ACK sent. "remote_ACK_counter" acknowledges "remote_seqno".
   u32_t remote_ACK_counter;
+  u32_t ack_deadline; //!< Time (ms) when the delayed ACK leaves if no data segment has carried it (see TCP_DELAYED_ACK_TIMEOUT).
   void *callback_arg;
   // receiver variables
   u32_t remote_seqno; //!< next seqno expected
-  u16_t remote_wnd; //!< caller window
+  u32_t remote_wnd; //!< caller window in bytes, "snd_wnd_scale" applied.
   u32_t remote_mss; //!< caller mss
   // Timers
-  u32_t timer; //!< counter to manage the time out.
-  u32_t counter_of_500ms; //!< The application calls tcp_timer() every 500ms and increments "counter_of_500ms" until "nb_of_500ms". Then the application checks whether the connection has been inactive.
+  TCP_TIMER_T timers[TCP_TIMER_NB]; //!< Protocol timers, armed in the timer wheel of the adapter.
+  u32_t activity; //!< Time (ms) of the last segment received while ESTABLISHED. The inactivity check starts from it.
   u32_t nb_of_500ms; //!< The application decides how often it wants to check whether the tcp_c's connection has been inactive. The application checks the inactivity every "nb_of_500ms x 500" ms.
   
   u32_t local_mss; //!< maximum segment size
-  u16_t local_wnd; //!< local window
-  u32_t retransmission_time_out; //!< The retransmission time out is a counter representing time. It is the maximum amount of fraction of TCP_TIMER_PERIOD to reach TCP_RETRANSMISSION_TIMEOUT.
-  u32_t local_seqno; //!< Sequence number of next byte to be buffered.
-  u32_t seg_nb[TCP_SEG_NB]; //!<Number of segments of "segment[MAX_TCP_SEG]" in the state "UNUSED", "UNSENT","UNACKED".
-  TCP_SENDING_SEG_T segment[MAX_TCP_SEG]; //!< buffer holding the outgoing frames to the peer device.
-  u32_t last_ack_no; //!< cIPS acknowleges segments with an ack_no number lower than the one received. But the received ack_no rolls over when it is bigger than 0xFFFFFFFF. last_ack_no handles the rollover situation.
-  u8_t incoming_stream[TCP_MSS * MAX_TCP_SEG]; //!< buffer holding incoming stream from the peer device.
-  u8_t* stream_position; //!<End of incoming stream in "incoming_stream".
-  u32_t stream_sequence; //!<Nb of incoming packets related to a stream.
-  u32_t seqno_ori; //!<initial seq no of a stream.
+  u32_t local_wnd; //!< local window in bytes: free space of "rcv_ring" after "remote_seqno".
+  u8_t snd_wnd_scale; //!< Shift applied to the window received from the peer device (RFC 7323). 0 if not negotiated.
+  u8_t rcv_wnd_scale; //!< Shift applied to "local_wnd" in the window field sent. 0 if not negotiated.
+  u32_t peer_options; //!< Options negotiated in the SYNs (TCP_PEER_* bits): the peer device sent them and cIPS offers them.
+  u32_t options_length; //!< Length of the options of every segment after the SYNs: the timestamps if negotiated, 0 otherwise.
+  u32_t ts_recent; //!< Last timestamp of the peer device, echoed in each segment (RFC 7323).
+  u32_t srtt; //!< Smoothed round trip time in ms, scaled by 8. 0 means no measure yet.
+  u32_t rttvar; //!< Round trip time variation in ms, scaled by 4.
+  u32_t rto; //!< Retransmission time out in ms, back-off included (RFC 6298).
+  u32_t rto_expiry; //!< Time (ms) when the oldest unacknowledged segment is retransmitted if "rto_running".
+  u32_t rto_stall; //!< Time (ms) of the last progress of the peer device acknowledgments. See TCP_RETRANSMISSION_TIMEOUT.
+  u32_t rto_backoff; //!< Number of retransmission time outs in a row.
+  bool_t rto_running; //!< TRUE if the retransmission timer runs.
+  u32_t rtt_seq; //!< Acknowledgment number ending the round trip time measure.
+  u32_t rtt_start; //!< Time (ms) the measured segment was sent.
+  bool_t rtt_timing; //!< TRUE if a round trip time is being measured. Retransmitted segments are not measured (Karn's algorithm).
+  u32_t local_seqno; //!< Sequence number of next byte to be buffered. Once the FIN is queued, it follows the FIN.
+  u32_t snd_una; //!< Oldest sequence number sent and not acknowledged yet.
+  u32_t snd_nxt; //!< Sequence number of the next byte to send. The bytes from "snd_nxt" to "local_seqno" wait in "snd_ring" (then the FIN). The control frames carry it.
+  u32_t snd_queued; //!< Number of bytes of "snd_ring" written by the application and not sent yet, from "snd_nxt".
+  bool_t snd_fin; //!< TRUE once cIPS closes its side: the FIN takes the sequence number after the last byte written and leaves once "snd_queued" is 0 (see tcp_send_fin()).
+  TCP_SND_RING_T *snd_ring; //!< Circular send buffer borrowed from the pool of the adapter while data are unacknowledged or unsent. NULL otherwise.
+  u32_t snd_ring_base; //!< Sequence number stored at the index 0 of "snd_ring": "snd_una" when the ring was borrowed, then moved by whole rings as "snd_una" advances.
+  u32_t cwnd; //!< Congestion window in bytes. tcp_output() keeps (snd_nxt - snd_una) within the smallest of "remote_wnd" and "cwnd".
+  u32_t ssthresh; //!< Slow start threshold in bytes.
+  u32_t recover; //!< "snd_nxt" when the last loss was detected. The congestion window is reduced once per loss episode.
+  u32_t dupacks; //!< Number of duplicate ACKs received in a row (see tcp_duplicate_ack()).
+  bool_t fast_recovery; //!< TRUE from the fast retransmission until "recover" is acknowledged (RFC 6582).
+  const TCP_CC_T* cc; //!< Congestion control algorithm (see tcp_congestion_control()).
+  TCP_CC_STATE_T cc_state; //!< State of the congestion control algorithm.
+  u32_t seg_nb[TCP_SEG_NB]; //!<Number of segments of "segment[MAX_TCP_SEG]" in the state "UNUSED", "UNACKED".
+  TCP_SENDING_SEG_T segment[MAX_TCP_SEG]; //!< Segments sent to the peer device and not acknowledged yet. Their frames are built from "snd_ring" when they leave.
+  TCP_RCV_RING_T *rcv_ring; //!< Circular receive buffer borrowed from the pool of the adapter while "out_of_order_nb" is not 0. NULL otherwise.
+  u32_t rcv_ring_start; //!< Index of "rcv_ring" matching "remote_seqno".
+  TCP_OUT_OF_ORDER_T out_of_order[MAX_TCP_OUT_OF_ORDER]; //!< Segments received after a hole. Their data are in "rcv_ring".
+  u32_t out_of_order_nb; //!< Number of segments in "out_of_order".
+  u32_t sack_recent; //!< Sequence number of the last segment stored in "out_of_order". The first SACK block reports it (RFC 2018).
   TCP_OPTIONS_T options; //! The application can configure a connection with options (see TCP_OPTIONS_T)
 
   err_t (* recv)(void *arg, struct TCP_S *tcp_c, void* data, u32_t data_length);//!< Callback when data have been received
@@ -150,6 +268,7 @@ typedef struct TCP_S {
   err_t (* accept)(void *arg, struct TCP_S *newtcp_c);//!< Callback when the socket accepts a client
   err_t (* periodic_connection_check)(void *arg, struct TCP_S *tcp_c);//!< Callback when no activity is detected for the socket for a certain amount of time
   err_t (* closed)(void *arg, struct TCP_S *tcp_c, err_t err);//!< Callback after closure.
+  err_t (* sent)(void *arg, struct TCP_S *tcp_c, u32_t space);//!< Callback when acknowledged data have freed "space" bytes of the send ring.
 
   s32_t id;  //!< ID: Unused or used. Make the difference between the controllers available and the ones that the application is using.
   u32_t type;  //!< type: TCP_PERSISTENT or TCP_NON_PERSISTENT. See TCP_CATEGORY.
@@ -227,18 +346,25 @@ err_t tcp_close (TCP_T *tcp_c);
 
 /*!
  * Function name: tcp_write
- * \return ERR_OK, 
- * ERR_SEG_MEM if the application sends too much data in one call or 
- * ERR_APP if the application uses tcp_write() when it is not connected.
+ * \return the number of bytes queued: "app_len", or less if the send ring
+ * is full.
  * \param tcp_c: [in/out]connection of interest.
  * \param app_data: [in]Application data in "unsigned char".
  * \param app_len: [in]Application data length in bytes.
+ * \param err: [out] ERR_OK, 
+ * ERR_CUR_SEG_MEM if the send ring is full (TCP_SND_BUF): no byte is queued,
+ * ERR_SEG_MEM if no send ring is left (TCP_SND_RING_POOL),
+ * ERR_APP if the application uses tcp_write() when it is not connected.
  * \brief Write some data to a TCP connection.
- * \note send the first elt (or multiplex with an ACK) and then put 
- * the other segments in the unsent queue. The ACK of the first 
- * segment is going to trigger the sending of the second and so on.
+ * \note The data are copied into the send ring of the connection: the 
+ * application can reuse its buffer at once. The segments that fit in the
+ * send window leave (multiplexed with the ACK), the ACKs of the peer 
+ * device release the others.
+ * \note tcp_write() takes as much as the send ring can hold. The 
+ * application writes the rest from the tcp_sent() callback, when the ACKs
+ * of the peer device free some room.
  * *******************************************************************/
-err_t tcp_write (TCP_T *tcp_c, const void *app_data, u32_t app_len);
+u32_t tcp_write (TCP_T *tcp_c, const void *app_data, u32_t app_len, err_t* err);
 
 /*!
  * Function name: tcp_arg
@@ -263,6 +389,10 @@ void tcp_arg (TCP_T *tcp_c, void *arg);
  * But the child is not connected to the application. tcp_accept() links 
  * the child to the application. The application configures the child connection.
  * To do so, it will call tcp_recv(), tcp_check_connection() and tcp_closed() in tcp_accept().
+ * \note The child is created once the peer client completes the handshake
+ * (final ACK). Until then, its request only takes an entry of the SYN 
+ * backlog (TCP_SYN_BACKLOG). If the accept callback returns an error, 
+ * cIPS resets the connection.
  * *******************************************************************/
 void tcp_accept (TCP_T *tcp_c, err_t (* accept)(void *arg, TCP_T *newtcp_c));
 
@@ -275,6 +405,9 @@ void tcp_accept (TCP_T *tcp_c, err_t (* accept)(void *arg, TCP_T *newtcp_c));
  * application. tcp_recv() makes the link between cIPS and the 
  * application. It specifies which application function cIPS should 
  * call when it receives TCP data for this tcp_c.
+ * \note TCP is a byte stream: cIPS calls "recv" as soon as data are in 
+ * order, the PSH flag does not delimit them. A message of the peer device
+ * can arrive in several calls and must be consumed by each call.
  * *******************************************************************/
 void tcp_recv (TCP_T *tcp_c, err_t (* recv)(void *arg, TCP_T *tcp_c, void* data, u32_t data_length));
 
@@ -311,6 +444,30 @@ void tcp_check_connection(TCP_T *tcp_c, err_t (*periodic_connection_check)(void
  * *******************************************************************/
 void tcp_closed (TCP_T *tcp_c, err_t (* closed)(void *arg, TCP_T *tcp_c, err_t err));
 
+ /*!
+ * Function name: tcp_sent
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param sent : [in] Sent callback. "space" is the number of bytes that 
+ * tcp_write() accepts.
+ * \brief The peer device acknowledges data: room frees up in the send 
+ * ring. tcp_sent() sets the application function that cIPS calls then, 
+ * so that a producer keeps the connection busy without polling.
+ * *******************************************************************/
+void tcp_sent (TCP_T *tcp_c, err_t (* sent)(void *arg, TCP_T *tcp_c, u32_t space));
+
+ /*!
+ * Function name: tcp_congestion_control
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param cc : [in] &tcp_cc_newreno or &tcp_cc_cubic.
+ * \brief Select the congestion control algorithm of a connection. 
+ * The connections use TCP_CC_DEFAULT unless the application calls 
+ * tcp_congestion_control() before tcp_connect() or, for a server, in tcp_accept().
+ * The children of a server inherit its algorithm.
+ * *******************************************************************/
+void tcp_congestion_control (TCP_T *tcp_c, const TCP_CC_T* cc);
+
  /*!
  * Function name: tcp_abort
  * \return nothing.
@@ -325,9 +482,11 @@ void tcp_closed (TCP_T *tcp_c, err_t (* closed)(void *arg, TCP_T *tcp_c, err_t e
  * \param tcp_c : [in/out] tcp_c of interest.
  * \param options : [in/out] controller option. See TCP_OPTIONS_T for detail.
  * \brief The application calls tcp_options() in order to configure a 
- * connection. One possible configuration is to delay the incoming
- * frames acknowledgment. If the application sets the ACK dalay then
- * the application should look at tcp_ack().
+ * connection. tcp_nagle holds the small writes while data are in flight 
+ * (RFC 896): they are coalesced into one segment that leaves with the next
+ * ACK of the peer device or once it is full. It saves frames when the 
+ * application writes a few bytes at a time, but it delays a write that
+ * follows another one when the peer device delays its ACKs.
  * *******************************************************************/
 err_t tcp_options(TCP_T *tcp_c, TCP_OPTIONS_T options);
 
@@ -337,14 +496,13 @@ err_t tcp_options(TCP_T *tcp_c, TCP_OPTIONS_T options);
  * \param tcp_c : [in/out] tcp_c of interest.
  * \brief The TCP protocol is connection oriented. The protocol 
  * acknowledges each incoming frame.
- * cIPS acknowledges an incoming frame as soon as the application completes 
- * its processing. (FYI:in addition, if the application uses tcp_write() 
- * then cIPS multiplexes the acknowledgment with the outgoing frame). 
- * The consequence is that when the peer device receives the acknowledgment,
- * it can send its next frame. The result is very fast. The peer device receives 
- * the acknowledgment much sooner than the 200 milliseconds allowed for an ACK.
- * But in one situation, the fast speed can increase the traffic network.
- * The situation is: cIPS initiates a dialogue with the peer device
+ * cIPS delays the acknowledgment of an incoming frame (RFC 1122): if 
+ * the application uses tcp_write() then cIPS multiplexes the acknowledgment
+ * with the outgoing frame. Otherwise cIPS acknowledges every second segment
+ * received, or once TCP_DELAYED_ACK_TIMEOUT has expired (see tcp_timer() and
+ * tcp_fast_timer()). A segment out of order or filling a hole is 
+ * acknowledged at once. The delay matters in the following situation:
+ * cIPS initiates a dialogue with the peer device
  * cIPS periodically sends data to the peer device, the period is less than 
  * 200 milliseconds and the peer device replies with some data.
  *
@@ -359,13 +517,8 @@ err_t tcp_options(TCP_T *tcp_c, TCP_OPTIONS_T options);
  *       ...
  * cIPS can multiplex the two frames ACK(frame(M)) and PSH(frame(N+1)) 
  * into one frame ACK(frame(M)),PSH(frame(N+1)). To do so, cIPS delays 
- * the ACK(frame(M)). But as cIPS does not know that the application 
- * would send a frame after 1ms but before 200ms, the cIPS default 
- * behavior is to acknowledge immediately unless the application
- * configures the connection in order not to do it.
- * The application configures the delay by calling 
- * tcp_options(tcp_delay_ack_reply). Then tcp_write() would acknowledge 
- * the previous incoming frame or the application can force it by 
+ * the ACK(frame(M)) up to TCP_DELAYED_ACK_TIMEOUT. If the application 
+ * knows that it will not write soon, it can send the ACK at once by 
  * calling tcp_ack().
  * *******************************************************************/
 err_t tcp_ack(TCP_T *tcp_c);
@@ -409,12 +562,31 @@ void tcp_init (void);
  * \return ERR_OK or ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER, ERR_RST
  * \param net_adapter : [in/out] adapter of interest.
  * \brief
- * Called every 500 ms and implements the retransmission and timeout
- * timer. It also increments various timers such as the inactivity 
- * timer in each controller.
+ * Called every 500 ms: it advances the TCP clock by TCP_TIMER_PERIOD and
+ * fires the timers of the controllers that have expired (retransmission,
+ * delayed ACK, state time outs and inactivity check). The timers wait in
+ * a timer wheel: the cost depends on the timers that expire, not on the
+ * number of connections.
  * *******************************************************************/
 err_t tcp_timer (struct NETIF_S* net_adapter);
 
+/*!
+ * Function name: tcp_fast_timer
+ * \return ERR_OK or ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER, ERR_RST
+ * \param net_adapter : [in/out] adapter of interest.
+ * \param now : [in] Current time of the application in milliseconds (it may roll over).
+ * \brief Drive the TCP clock with a millisecond clock and fire the 
+ * timers that have expired (see tcp_timer()). Call it as often as 
+ * possible (for example next to netif_dispatch()): tcp_timer() is not
+ * needed anymore.
+ * \note Without tcp_fast_timer(), tcp_timer() advances the TCP clock
+ * by TCP_TIMER_PERIOD: the timers have that resolution.
+ * \note The TCP clock stamps the segments (TCP_TIMESTAMPS): "now" must 
+ * not go back in time, or the peer device discards the segments as old 
+ * duplicates.
+ * *******************************************************************/
+err_t tcp_fast_timer (struct NETIF_S* net_adapter, u32_t now);
+
 /* Lower layer interface to TCP: */
 
 /*!
@@ -422,13 +594,17 @@ err_t tcp_timer (struct NETIF_S* net_adapter);
  * \return ERR_CHECKSUM or ERR_OK
  * \param ip_frame : [in] IP frame.
  * \param ip_frame_length : [in] Length of IP header + TCP header + app_data.
+ * \param rx_checksum : [in] NETIF_CHECKSUM_RX_* checksums already verified by the adapter.
  * \param net_adapter : [in/out] network adapter.
  * \brief The IP layer (ip_parse()) identifies a TCP frame and forwards it to 
  * the TCP layer by calling tcp_demultiplex(). tcp_demultiplex() links 
  * the frame to its TCP controller. The TCP can be a TCP client, a
  * TCP server listening or might not exist.
+ * \note The lookup only reads the headers. The checksum is verified after
+ * it, so a frame that no controller accepts is dropped without being summed
+ * (and counted in net_adapter->unmatched_nb).
  * *******************************************************************/
-err_t tcp_demultiplex(u8_t* ip_frame, u32_t ip_frame_length, struct NETIF_S *net_adapter);
+err_t tcp_demultiplex(u8_t* ip_frame, u32_t ip_frame_length, u32_t rx_checksum, struct NETIF_S *net_adapter);
 
 #ifdef __cplusplus
 }
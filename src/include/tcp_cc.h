@@ -0,0 +1,76 @@
+/* Copyright (c) 2010,  Jean-Marc David
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without 
+* modification, are permitted provided that the following conditions 
+* are met:
+*  * Redistributions of source code must retain the above copyright 
+* notice, this list of conditions and the following disclaimer.
+*  * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the 
+* documentation and/or other materials provided with the distribution.
+*  * Neither the name of the author nor the names of its contributors 
+* may be used to endorse or promote products derived from this software
+* without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR 
+* IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+* OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+* IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, 
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+*  AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+* Author: Jean-Marc David jmdavid1789<at>googlemail.com
+* http://sourceforge.net/projects/cipsuite/ <br>
+*/
+#ifndef __TCP_CC_H__
+#define __TCP_CC_H__
+
+#include "arch.h"
+
+struct TCP_S;
+
+//! State of the congestion control algorithms (see TCP_CC_T). Each algorithm uses the fields it needs.
+typedef struct TCP_CC_STATE_S {
+  u32_t bytes_acked; //!< Bytes acknowledged since the last increase of the congestion window (congestion avoidance).
+  u32_t w_max; //!< CUBIC: congestion window (bytes) just before the last reduction.
+  u32_t origin; //!< CUBIC: congestion window (bytes) at the plateau of the cubic function.
+  u32_t k; //!< CUBIC: time (in 10 ms) the cubic function takes to reach "origin".
+  u32_t epoch_start; //!< CUBIC: time (in ms) the current congestion avoidance epoch started. 0 means no epoch.
+  u32_t w_est; //!< CUBIC: congestion window (bytes) that NewReno would have reached (TCP friendly region).
+} TCP_CC_STATE_T;
+
+//! Congestion control algorithm. The TCP layer calls the hooks, the hooks update tcp_c->cwnd and tcp_c->ssthresh.
+typedef struct TCP_CC_S {
+  const s8_t* name; //!< Name of the algorithm (debug).
+  void (*init)(struct TCP_S* tcp_c); //!< The connection is established: set the initial window.
+  void (*on_ack)(struct TCP_S* tcp_c, u32_t acked, u32_t now); //!< "acked" new bytes are acknowledged at "now" (ms).
+  void (*on_loss)(struct TCP_S* tcp_c); //!< A loss is detected by duplicate ACKs (fast retransmit).
+  void (*on_rto)(struct TCP_S* tcp_c); //!< The retransmission timer expires.
+} TCP_CC_T;
+
+extern const TCP_CC_T tcp_cc_newreno; //!< NewReno (RFC 5681, RFC 6582).
+extern const TCP_CC_T tcp_cc_cubic; //!< CUBIC (RFC 9438).
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Function name: tcp_cc_mss
+ * \return the segment size (in bytes) the congestion window counts in.
+ * \param tcp_c : [in] tcp_c of interest.
+ * \brief The MSS of the peer device or TCP_MSS if the peer device did not 
+ * send one.
+ * *******************************************************************/
+u32_t tcp_cc_mss(const struct TCP_S* const tcp_c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TCP_CC_H__ */
@@ -41,18 +41,38 @@ typedef struct UDP_S {
   u16_t local_port; //!<CIPS TCP port
   u16_t remote_port; //!<The peer TCP port
   struct UDP_S *next; //!< for the linked list
+  struct UDP_S *prev; //!< Previous controller in the list, NULL for the first one.
+  struct UDP_S **list; //!< Head of the list holding the controller ("udp_cs" or "udp_free_cs" of the adapter).
   struct NETIF_S *netif; //!< network interface for this packet
   u32_t state;  //!< State: UDP_UNUSED, UDP_KNOWN_TARGET, UDP_ANY_TARGET
   u8_t frame[NETWORK_MTU]; //!< ethernet frame.*/
   bool_t point_to_point; //!< Flag. If TRUE, the link is point to point and no UDP checksum is processed. The ethernet and IP checksums are enough to guaranty the integrity of the frame.
   u8_t target_mac_addr[MAC_ADDRESS_LENGTH];
   u16_t chksum_len; //!< Spseudo-checksum length used when the frame is re-used.
+  u32_t pseudo_sum; //!< Addresses and protocol part of the speudo header sum (ip_pseudo_header_sum()). Set by udp_init_connection().
   u8_t* app_data; //!< pointer to the application section within the ethernet frame "frame".
   bool_t frame_initialized; //!< In a situation where a UDP socket only sends frames of fix size, the length and the pseudo-checksum is constant so do not recaluclate it each time. TRUE means initailized.
   err_t (*recv)(void *arg, struct UDP_S *udp_c, void* data, u32_t data_length); //!< Callback when data have been received
   void *recv_arg; //!< argument associated to the "recv" callback.
 } UDP_T;
 
+//! Cyclic UDP stream: udp_cyclic_timer() sends the frame of "udp_c" every "period" ticks.
+typedef struct UDP_CYCLIC_S {
+  UDP_T *udp_c; //!< UDP controller sending the stream. NULL means that the entry is free.
+  u32_t period; //!< Period of the stream in ticks of the application timer (see udp_cyclic_timer()).
+  u32_t phase; //!< Offset in ticks of the release times: the stream is due at every tick "t" such as (t % period) == phase.
+  u32_t next_release; //!< Tick at which the next frame is due.
+  bool_t armed; //!< FALSE until udp_cyclic_timer() has aligned "next_release" on the phase.
+  u32_t data_length; //!< Length of the application data when "fill" is NULL (data written through udp_get_data_pointer()).
+  u32_t last_length; //!< Length of the last frame sent. The frame is reused as long as its length is unchanged.
+  u32_t (*fill)(void *arg, UDP_T *udp_c, u8_t *app_data, u32_t max_length); //!< Callback filling the application data in place and returning its length.
+  void *fill_arg; //!< argument associated to the "fill" callback.
+  u32_t sent_nb; //!< Number of frames sent.
+  u32_t missed_nb; //!< Number of release times skipped because udp_cyclic_timer() was called too late.
+  u32_t last_lateness; //!< Lateness in ticks of the last frame sent.
+  u32_t max_lateness; //!< Worst lateness in ticks observed since the stream was registered (send jitter).
+} UDP_CYCLIC_T;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -146,6 +166,68 @@ UDP_T* udp_new( u32_t ipaddr, u16_t port, bool_t point_to_point, err_t* err);
  * *******************************************************************/
   u8_t* udp_get_data_pointer( UDP_T* udp_c );
 
+/*!
+ * Function name: udp_cyclic_register
+ * \return ERR_OK, ERR_VAL if the period is zero or ERR_UDP_MEM if more
+ * than MAX_UDP_CYCLIC streams already exist on the adapter.
+ * \param udp_c : [in/out] udp_c sending the stream. It must be connected (see udp_connect()).
+ * \param period : [in] Period of the stream in ticks of the application timer.
+ * \param phase : [in] Offset of the stream in ticks (phase < period). Streams
+ * with the same period and different phases do not fire on the same tick.
+ * \param data_length : [in] Length of the application data when "fill" is NULL.
+ * \param fill : [in] Callback filling the application data in place. It
+ * receives udp_get_data_pointer() and returns the data length. If set to
+ * NULL, the application writes the data through udp_get_data_pointer()
+ * and cIPS sends "data_length" bytes.
+ * \param fill_arg : [in] argument associated to the "fill" callback.
+ * \brief Register a time-triggered UDP stream. udp_cyclic_timer()
+ * sends it from the application timer tick. A socket has at most one
+ * stream: registering it again updates the stream. If udp_c is connected,
+ * its frame is built here, in the main loop.
+ * *******************************************************************/
+  err_t udp_cyclic_register( UDP_T* udp_c, u32_t period, u32_t phase, u32_t data_length,
+      u32_t (* fill)(void *arg, UDP_T* udp_c, u8_t* app_data, u32_t max_length), void* fill_arg);
+
+/*!
+ * Function name: udp_cyclic_remove
+ * \return nothing.
+ * \param udp_c : [in/out] udp_c of interest.
+ * \brief Stop the cyclic stream of udp_c if any.
+ * *******************************************************************/
+  void udp_cyclic_remove( UDP_T* udp_c);
+
+/*!
+ * Function name: udp_cyclic_timer
+ * \return ERR_OK, ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER.
+ * \param net_adapter : [in/out] adapter of interest.
+ * \param now : [in] Current tick of the application timer (it may roll over).
+ * \brief Send the cyclic UDP streams that are due. The application calls
+ * udp_cyclic_timer() from its timer ISR if it defines NETIF_LOCK() and
+ * NETIF_UNLOCK() (see default_options.h): the release times then do not
+ * depend on the main loop. Otherwise it calls it from the main loop when
+ * its timer tick has elapsed. The frames are prebuilt by udp_cyclic_register()
+ * so only the application data and the UDP checksum are processed.
+ * \note From the ISR, the "fill" callbacks run in the ISR too and the
+ * application does not call udp_send() or udp_connect() on a socket while
+ * its stream is registered.
+ * \note If a call comes late, the lateness is recorded in the stream
+ * statistics (see udp_cyclic_statistics()). If it comes more than one
+ * period late, the missed release times are counted and skipped rather
+ * than sent in a burst.
+ * *******************************************************************/
+  err_t udp_cyclic_timer( struct NETIF_S* net_adapter, u32_t now);
+
+/*!
+ * Function name: udp_cyclic_statistics
+ * \return ERR_OK or ERR_VAL if udp_c has no cyclic stream.
+ * \param udp_c : [in] udp_c of interest.
+ * \param sent_nb : [out] Number of frames sent.
+ * \param missed_nb : [out] Number of release times skipped.
+ * \param max_lateness : [out] Worst lateness in ticks (send jitter).
+ * \brief Report the timing of a cyclic UDP stream.
+ * *******************************************************************/
+  err_t udp_cyclic_statistics( UDP_T* udp_c, u32_t* sent_nb, u32_t* missed_nb, u32_t* max_lateness);
+
 /* UDP management. */
 
 /*!
@@ -153,12 +235,13 @@ UDP_T* udp_new( u32_t ipaddr, u16_t port, bool_t point_to_point, err_t* err);
  * \return ERR_OK or ERR_CHECKSUM.
  * \param ip_frame : [in] IP frame.
  * \param ip_frame_length : Value of (IP header + UDP header + app_data).
+ * \param rx_checksum : [in] NETIF_CHECKSUM_RX_* checksums already verified by the adapter.
  * \param net_adapter : [in] network adapter.
  * \brief The application opens some UDP ports (see udp_new()).
  * An UDP frame comes in, udp_parse() looks for the open port matching
  * the incoming frame.
  * *******************************************************************/
-  err_t udp_parse(u8_t* ip_frame, u32_t ip_frame_length, struct NETIF_S *net_adapter);
+  err_t udp_parse(u8_t* ip_frame, u32_t ip_frame_length, u32_t rx_checksum, struct NETIF_S *net_adapter);
 
 
 #ifdef __cplusplus
@@ -45,6 +45,21 @@
 #include "debug.h"
 #include "ip.h"
 
+#if IP_CHECKSUM_SIMD
+#  if defined(__SSE2__)
+#    include <emmintrin.h>
+#    define IP_CHECKSUM_SSE2
+#  endif
+#  if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__clang__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#    include <immintrin.h>
+#    define IP_CHECKSUM_AVX2
+#  endif
+#  if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#    include <arm_neon.h>
+#    define IP_CHECKSUM_NEON
+#  endif
+#endif /* IP_CHECKSUM_SIMD */
+
 static const u8_t IP_TTL = 255; //!< IP time_to_live field.
 static err_t ip_parse_icmp(u8_t* eth_frame, u32_t eth_frame_length, NETIF_T *net_adapter);
 static u32_t eth_build_icmp_echo_request(unsigned char* const output_frame, const u8_t* const app_data, const u32_t app_data_length);
@@ -52,6 +67,24 @@ static u32_t eth_build_icmp_response(u8_t* const io_frame, const u32_t app_lengt
 static err_t icmp_build_echo_reply_frame (u8_t* eth_frame, NETIF_T *net_adapter);
 static void eth_swap(unsigned char* const io_frame, NETIF_T *net_adapter);
 static void eth_memcpy(u8_t* output, const u8_t* input);
+static u16_t ip_checksum_reference(const u16_t *big_endian_frame, u32_t byte_nb);
+static u16_t ip_checksum_word(const u16_t *big_endian_frame, u32_t byte_nb);
+static u32_t ip_checksum_tail(const u16_t *big_endian_frame, u32_t byte_nb);
+static bool_t ip_checksum_check(u16_t (*kernel)(const u16_t*, u32_t));
+#if IP_DEBUG
+static bool_t ip_copy_checksum_check(void);
+#endif
+#ifdef IP_CHECKSUM_SSE2
+static u16_t ip_checksum_sse2(const u16_t *big_endian_frame, u32_t byte_nb);
+#endif
+#ifdef IP_CHECKSUM_AVX2
+static u16_t ip_checksum_avx2(const u16_t *big_endian_frame, u32_t byte_nb);
+#endif
+#ifdef IP_CHECKSUM_NEON
+static u16_t ip_checksum_neon(const u16_t *big_endian_frame, u32_t byte_nb);
+#endif
+//! Checksum kernel used by ip_checksum(). ip_checksum_init() selects the fastest.
+static u16_t (*ip_checksum_kernel)(const u16_t *big_endian_frame, u32_t byte_nb) = ip_checksum_word;
 #if IP_DEBUG
 static void ip_debug_print_src_dst(NETIF_T *net_adapter, u32_t src, u32_t dest);
 #else
@@ -64,10 +97,11 @@ static void ip_debug_print_src_dst(NETIF_T *net_adapter, u32_t src, u32_t dest);
  * \return ERR_CHECKSUM, ERR_OK, ERR_CHECKSUM or ERR_DEVICE_DRIVER
  * \param eth_frame : [in] Ethernet frame.
  * \param eth_frame_length : [in] Ethernet frame length.
+ * \param rx_checksum : [in] NETIF_CHECKSUM_RX_* checksums already verified by the adapter.
  * \param net_adapter : [in] Adpater providing the frame.
  * \brief Parse the IP frame.
  * *******************************************************************/
-err_t ip_parse(u8_t* eth_frame, u32_t eth_frame_length, NETIF_T *net_adapter)
+err_t ip_parse(u8_t* eth_frame, u32_t eth_frame_length, u32_t rx_checksum, NETIF_T *net_adapter)
 {
   u16_t checksum;
   IP_HEADER_T* iphdr; 
@@ -79,16 +113,16 @@ err_t ip_parse(u8_t* eth_frame, u32_t eth_frame_length, NETIF_T *net_adapter)
 
   if(IP_CHECK_IP_VERSION(iphdr) == IP_VERSION){
     u32_t ip_header_length = IP_GET_HEADER_LENGTH(iphdr);
-    //Verify IP checksum.
-    checksum = ip_checksum((const u16_t*)iphdr, ip_header_length);
+    //Verify IP checksum (unless the adapter did it).
+    checksum = (rx_checksum & NETIF_CHECKSUM_RX_IP)? CHECKSUM_OK : ip_checksum((const u16_t*)iphdr, ip_header_length);
 
     if( checksum == CHECKSUM_OK ) {
       switch(iphdr->protocol) {
         case IP_UDP:
-          err = udp_parse((u8_t*)iphdr, eth_frame_length - sizeof(ETHER_HEADER_T), net_adapter);
+          err = udp_parse((u8_t*)iphdr, eth_frame_length - sizeof(ETHER_HEADER_T), rx_checksum, net_adapter);
           break;
         case IP_TCP:
-          err = tcp_demultiplex((u8_t*)iphdr, eth_frame_length - sizeof(ETHER_HEADER_T), net_adapter);
+          err = tcp_demultiplex((u8_t*)iphdr, eth_frame_length - sizeof(ETHER_HEADER_T), rx_checksum, net_adapter);
           break;
         case IP_ICMP: //if ICMP (AKA ping) is for us
           T_DEBUGF(IP_DEBUG, ("%s: ICMP (ping)\r\n",net_adapter->name));
@@ -177,21 +211,21 @@ static err_t icmp_build_echo_reply_frame (u8_t* eth_frame, NETIF_T *net_adapter)
   iphdr = (IP_HEADER_T *)(eth_frame + sizeof(ETHER_HEADER_T));
   ip_header_length = IP_GET_HEADER_LENGTH(iphdr);
   app_length = ntohs(iphdr->length) - (ip_header_length + sizeof(ICMP_HEADER_T));
-  length = eth_build_icmp_response(eth_frame + sizeof(ETHER_HEADER_T) + sizeof(IP_HEADER_T),app_length);
 
-  //If the incoming frame had ip options then shift the application data part because the reply will not have ip options.
+  //If the incoming frame had ip options then shift the ICMP part because the reply will not have ip options.
   if( ip_header_length != sizeof(IP_HEADER_T))
   {
     u32_t i;
     u8_t* src;
     u8_t* dst;
-    src = eth_frame + sizeof(ETHER_HEADER_T) + ip_header_length + sizeof(ICMP_HEADER_T);
-    dst = eth_frame + sizeof(ETHER_HEADER_T) + sizeof(IP_HEADER_T) + sizeof(ICMP_HEADER_T);
-    for (i=0; i< app_length ; i++)
+    src = eth_frame + sizeof(ETHER_HEADER_T) + ip_header_length;
+    dst = eth_frame + sizeof(ETHER_HEADER_T) + sizeof(IP_HEADER_T);
+    for (i=0; i< sizeof(ICMP_HEADER_T) + app_length ; i++)
     {
       dst[i] = src[i];
     }
   }
+  length = eth_build_icmp_response(eth_frame + sizeof(ETHER_HEADER_T) + sizeof(IP_HEADER_T),app_length);
   //3.Fill in IP part
   (void)eth_build_ip_request( htonl(iphdr->source_addr), htonl(iphdr->dest_addr), 
     eth_frame + sizeof(ETHER_HEADER_T), length, IP_ICMP, 0 /*reuse*/);
@@ -214,12 +248,15 @@ static u32_t eth_build_icmp_response(u8_t* const io_frame, const u32_t app_lengt
   ICMP_HEADER_T* icmp;
   u32_t length;
 
+  u16_t type_code;
+
   //Move to the ICMP portion of the packet and populate it appropriately
   icmp = (ICMP_HEADER_T*)(io_frame);
-  icmp->type = ICMP_ECHOREPLY; // type of message
-  icmp->cksum = 0; //Reset before scanning the reused frame
   length= sizeof(ICMP_HEADER_T) + app_length;
-  icmp->cksum = ~ip_checksum((const u16_t*)icmp, length); // ones complement cksum of struct
+  //The reply is the request with another type: only update the checksum of the request.
+  type_code = *(u16_t*)icmp;
+  icmp->type = ICMP_ECHOREPLY; // type of message
+  icmp->cksum = ip_checksum_update16(icmp->cksum, type_code, *(u16_t*)icmp);
 
   return length;
 }
@@ -365,18 +402,48 @@ static void eth_memcpy(u8_t* output, const u8_t* input)
 u16_t eth_build_pseudo_header( const u32_t dest_ip_addr, const u32_t source_ip_addr,
   const u32_t data_size, const u32_t proto_length, const u8_t protocol)
 {
-  TRANSPORT_PSEUDO_HEADER_T tp; //!< transport_protocol : UDP or TCP
+  return ip_pseudo_header_length( ip_pseudo_header_sum( dest_ip_addr, source_ip_addr, protocol), data_size + proto_length);
+}
+
+/*!
+ * Function name: ip_pseudo_header_sum
+ * \return Sum of the addresses and protocol of the speudo header (in the endianness of the platform).
+ * \param dest_ip_addr : [in] Destination IP address.
+ * \param source_ip_addr : [in] Source IP address.
+ * \param protocol : [in] IP_UDP or IP_TCP.
+ * \brief The addresses and the protocol of a speudo header are constant for the
+ * life of a connection. cIPS sums them once when it sets up the connection and
+ * only adds the length with ip_pseudo_header_length() for each frame.
+ * \note The sum is the same whatever the direction: the source and destination 
+ * addresses can be swapped.
+ * *******************************************************************/
+u32_t ip_pseudo_header_sum( const u32_t dest_ip_addr, const u32_t source_ip_addr, const u8_t protocol)
+{
   u32_t cksum;
 
-  tp.ip_src = source_ip_addr; //source address
-  tp.ip_dst = dest_ip_addr; //dest address
-  tp.zero = 0; //fixed to zero
-  tp.proto = protocol; 
-  tp.ulen = data_size + proto_length;
+  cksum = ((u16_t)(source_ip_addr >> 16)) + ((u16_t)source_ip_addr);
+  cksum += ((u16_t)(dest_ip_addr >> 16)) + ((u16_t)dest_ip_addr);
+  cksum += (u16_t)protocol; //the "zero" byte adds nothing.
 
-  cksum = ((u16_t)(tp.ip_src >> 16)) + ((u16_t)tp.ip_src);
-  cksum += ((u16_t)(tp.ip_dst >> 16)) + ((u16_t)tp.ip_dst);
-  cksum += ((u16_t)tp.proto) + tp.ulen;
+  //Fold 32-bit sum to 16 bits
+  while( cksum >> 16) {
+    cksum = (cksum & 0xFFFF) + (cksum >> 16);
+  }
+
+  return cksum;
+}
+
+/*!
+ * Function name: ip_pseudo_header_length
+ * \return Sum of the speudo header elts (in big endian).
+ * \param pseudo_sum : [in] Return of ip_pseudo_header_sum().
+ * \param transport_length : [in] Length of the UDP (or TCP) header and app data.
+ * \brief Complete the sum of a speudo header with the only field that 
+ * changes from a frame to another: the length.
+ * *******************************************************************/
+u16_t ip_pseudo_header_length( const u32_t pseudo_sum, const u32_t transport_length)
+{
+  u32_t cksum = pseudo_sum + transport_length;
 
   //Fold 32-bit sum to 16 bits
   while( cksum >> 16) {
@@ -397,8 +464,164 @@ u16_t eth_build_pseudo_header( const u32_t dest_ip_addr, const u32_t source_ip_a
  * \param byte_nb : [in] Size in "bytes" of "big_endian_frame".
  * \brief Compute the 16-bit one's complement checksum
  * \note the complement is not done and should done outside if needed.
+ * \note The work is done by the kernel selected by ip_checksum_init().
  * *******************************************************************/
 u16_t ip_checksum(const u16_t *big_endian_frame, u32_t byte_nb)
+{
+  return ip_checksum_kernel(big_endian_frame, byte_nb);
+}
+
+/*!
+ * Function name: ip_checksum_init
+ * \return nothing.
+ * \brief Select the fastest checksum kernel that gives the same result
+ * as ip_checksum_reference().
+ * *******************************************************************/
+void ip_checksum_init(void)
+{
+  //From the fastest to the slowest.
+  static u16_t (* const kernels[])(const u16_t*, u32_t) = {
+#ifdef IP_CHECKSUM_AVX2
+    ip_checksum_avx2,
+#endif
+#ifdef IP_CHECKSUM_SSE2
+    ip_checksum_sse2,
+#endif
+#ifdef IP_CHECKSUM_NEON
+    ip_checksum_neon,
+#endif
+    ip_checksum_word
+  };
+  u32_t i;
+
+  ip_checksum_kernel = ip_checksum_reference;
+  for( i = 0; i < sizeof(kernels)/sizeof(kernels[0]); i++)
+  {
+#ifdef IP_CHECKSUM_AVX2
+    if( (kernels[i] == ip_checksum_avx2) && !__builtin_cpu_supports("avx2") )
+    { continue; } //The processor does not support it.
+#endif
+    if( ip_checksum_check(kernels[i]) )
+    {
+      ip_checksum_kernel = kernels[i];
+      break;
+    }
+    T_ERROR(("%s#%d: checksum kernel #%ld differs from the reference. Skipped.\r\n", __func__, __LINE__, i));
+  }
+#if IP_DEBUG
+  T_ASSERT(("%s#%d: ip_copy_checksum() differs from the reference.\r\n", __func__, __LINE__), ip_copy_checksum_check());
+#endif
+  return;
+}
+
+/*!
+ * Function name: ip_checksum_check
+ * \return TRUE if "kernel" gives the same checksum as ip_checksum_reference().
+ * \param kernel : [in] checksum kernel to check.
+ * \brief Compare "kernel" to the reference for every length up to 
+ * 256 bytes and for each 16-bit alignment of a 16-byte line.
+ * *******************************************************************/
+static bool_t ip_checksum_check(u16_t (*kernel)(const u16_t*, u32_t))
+{
+  static u16_t pattern[(256 + 16) / sizeof(u16_t)];
+  u32_t seed = 0x12345678;
+  u32_t offset;
+  u32_t length;
+  u32_t i;
+
+  //Pseudo random pattern with some 0xFFFF to check the carries.
+  for( i = 0; i < sizeof(pattern)/sizeof(u16_t); i++)
+  {
+    seed = seed * 1103515245UL + 12345UL;
+    pattern[i] = (i % 7)? (u16_t)(seed >> 16) : (u16_t)0xFFFF;
+  }
+
+  for( offset = 0; offset < 16 / sizeof(u16_t); offset++)
+  {
+    for( length = 0; length <= 256; length++)
+    {
+      if( kernel(pattern + offset, length) != ip_checksum_reference(pattern + offset, length) )
+      {
+        return FALSE;
+      }
+    }
+  }
+  return TRUE;
+}
+
+#if IP_DEBUG
+/*!
+ * Function name: ip_copy_checksum_check
+ * \return TRUE if ip_copy_checksum() copies and gives the same checksum 
+ * as ip_checksum_reference().
+ * \brief Check every length up to 128 bytes for each byte alignment of 
+ * the input and each 16-bit alignment of the output.
+ * *******************************************************************/
+static bool_t ip_copy_checksum_check(void)
+{
+  static u8_t pattern[128 + 8];
+  static u16_t copy[(128 + 8) / sizeof(u16_t) + 4];
+  u32_t in_offset;
+  u32_t out_offset;
+  u32_t length;
+  u32_t i;
+
+  for( i = 0; i < sizeof(pattern); i++)
+  {
+    pattern[i] = (i % 5)? (u8_t)(i * 37 + 11) : (u8_t)0xFF;
+  }
+
+  for( in_offset = 0; in_offset < 8; in_offset++)
+  {
+    for( out_offset = 0; out_offset < 4; out_offset++)
+    {
+      for( length = 0; length <= 128; length++)
+      {
+        if( ip_copy_checksum((u8_t*)(copy + out_offset), pattern + in_offset, length) != ip_checksum_reference(copy + out_offset, length) )
+        {
+          return FALSE;
+        }
+        for( i = 0; i < length; i++)
+        {
+          if( ((u8_t*)(copy + out_offset))[i] != pattern[in_offset + i] ) { return FALSE; }
+        }
+      }
+    }
+  }
+  return TRUE;
+}
+#endif /* IP_DEBUG */
+
+/*!
+ * Function name: ip_checksum_reference
+ * \return checksum value (in big endian).
+ * \param big_endian_frame : [in] Pointer to a big endian buffer.
+ * \param byte_nb : [in] Size in "bytes" of "big_endian_frame".
+ * \brief Compute the 16-bit one's complement checksum one 16-bit word 
+ * at a time. The other kernels must give the same result.
+ * *******************************************************************/
+static u16_t ip_checksum_reference(const u16_t *big_endian_frame, u32_t byte_nb)
+{
+  u32_t cksum = ip_checksum_tail(big_endian_frame, byte_nb);
+
+  //Fold 32-bit sum to 16 bits
+  while( cksum >> 16) {
+    cksum = (cksum & 0xFFFF) + (cksum >> 16);
+  }
+
+  //Return the 16-bit result in big endian.
+  return ((u16_t)cksum);
+}
+
+/*!
+ * Function name: ip_checksum_tail
+ * \return the unfolded sum of the 16-bit words of the buffer.
+ * \param big_endian_frame : [in] Pointer to a big endian buffer.
+ * \param byte_nb : [in] Size in "bytes" of "big_endian_frame". Less than 128KB.
+ * \brief Add the buffer one 16-bit word at a time. The kernels use it for
+ * the head and the tail of the buffer that do not fill a full word.
+ * *******************************************************************/
+static u32_t ip_checksum_tail(const u16_t *big_endian_frame, u32_t byte_nb)
 {
   u32_t cksum = 0;
 
@@ -417,15 +640,305 @@ u16_t ip_checksum(const u16_t *big_endian_frame, u32_t byte_nb)
     cksum += (*big_endian_frame) & 0x00FF; //Keep MSB of an unsigned short big endian.
 #endif
   }
+  return cksum;
+}
+
+/*!
+ * Function name: ip_checksum_word
+ * \return checksum value (in big endian).
+ * \param big_endian_frame : [in] Pointer to a big endian buffer.
+ * \param byte_nb : [in] Size in "bytes" of "big_endian_frame".
+ * \brief Compute the 16-bit one's complement checksum one "u32_t" word
+ * at a time.
+ * \note The one's complement sum of 32-bit words folded to 16 bits is 
+ * the sum of the 16-bit words, whatever the endianness. The carry of 
+ * each addition is added back (end-around carry).
+ * *******************************************************************/
+static u16_t ip_checksum_word(const u16_t *big_endian_frame, u32_t byte_nb)
+{
+  u32_t cksum = 0;
+  u32_t word;
+  const u32_t* p;
+
+  //Align on a word: the MicroBlaze does not load unaligned words.
+  while( (((u32_t)big_endian_frame) & (sizeof(u32_t) - 1)) && (byte_nb > 1) )
+  {
+    cksum += *big_endian_frame++;
+    byte_nb -= sizeof(u16_t);
+  }
+
+  p = (const u32_t*)big_endian_frame;
+  while( byte_nb >= 4 * sizeof(u32_t) )
+  {
+    word = p[0]; cksum += word; cksum += (cksum < word);
+    word = p[1]; cksum += word; cksum += (cksum < word);
+    word = p[2]; cksum += word; cksum += (cksum < word);
+    word = p[3]; cksum += word; cksum += (cksum < word);
+    p += 4;
+    byte_nb -= 4 * sizeof(u32_t);
+  }
+  while( byte_nb >= sizeof(u32_t) )
+  {
+    word = *p++; cksum += word; cksum += (cksum < word);
+    byte_nb -= sizeof(u32_t);
+  }
+
+  //Fold to 16 bits before adding the tail (less than a word).
+  while( cksum >> 16) {
+    cksum = (cksum & 0xFFFF) + (cksum >> 16);
+  }
+  cksum += ip_checksum_tail((const u16_t*)p, byte_nb);
+  while( cksum >> 16) {
+    cksum = (cksum & 0xFFFF) + (cksum >> 16);
+  }
+
+  return ((u16_t)cksum);
+}
+
+/*!
+ * Function name: ip_copy_checksum
+ * \return checksum value of the copied data (in big endian).
+ * \param output : [out] buffer to copy into. 16-bit aligned.
+ * \param input : [in] buffer to copy.
+ * \param byte_nb : [in] Size in "bytes" of "input". Less than 128KB.
+ * \brief Copy "input" into "output" and compute the 16-bit one's 
+ * complement checksum of the data in the same pass: each word is read
+ * once, written and added.
+ * \note Words are used when "input" and "output" have the same alignment,
+ * bytes otherwise (the MicroBlaze does not load unaligned words).
+ * *******************************************************************/
+u16_t ip_copy_checksum(u8_t* output, const u8_t* input, u32_t byte_nb)
+{
+  u32_t cksum = 0;
+  u32_t word;
+  u16_t half;
+  u8_t msb;
+  u8_t lsb;
+
+#ifdef IP_CHECKSUM_SSE2
+  {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc;
+    __m128i line;
+    unsigned int lanes[4]; //32-bit lanes whatever the size of "u32_t".
+    u32_t block;
+
+    while( byte_nb >= 16 )
+    {
+      acc = _mm_setzero_si128();
+      block = byte_nb / 16;
+      if( block > 32768 ) { block = 32768; }
+      byte_nb -= block * 16;
+      while( block-- )
+      {
+        line = _mm_loadu_si128((const __m128i*)input);
+        _mm_storeu_si128((__m128i*)output, line);
+        acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(line, zero));
+        acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(line, zero));
+        input += 16;
+        output += 16;
+      }
+      _mm_storeu_si128((__m128i*)lanes, acc);
+      cksum += (lanes[0] & 0xFFFF) + (lanes[0] >> 16) + (lanes[1] & 0xFFFF) + (lanes[1] >> 16);
+      cksum += (lanes[2] & 0xFFFF) + (lanes[2] >> 16) + (lanes[3] & 0xFFFF) + (lanes[3] >> 16);
+    }
+  }
+#endif /* IP_CHECKSUM_SSE2 */
+
+  if( (((u32_t)input ^ (u32_t)output) & (sizeof(u32_t) - 1)) == 0 )
+  {
+    //Align on a word 16 bits at a time ("output" is 16-bit aligned so "input" too).
+    while( (((u32_t)output) & (sizeof(u32_t) - 1)) && (byte_nb > 1) )
+    {
+      half = *(const u16_t*)input;
+      *(u16_t*)output = half;
+      cksum += half;
+      input += sizeof(u16_t);
+      output += sizeof(u16_t);
+      byte_nb -= sizeof(u16_t);
+    }
+    while( byte_nb >= sizeof(u32_t) )
+    {
+      word = *(const u32_t*)input;
+      *(u32_t*)output = word;
+      cksum += word;
+      cksum += (cksum < word); //end-around carry
+      input += sizeof(u32_t);
+      output += sizeof(u32_t);
+      byte_nb -= sizeof(u32_t);
+    }
+    //Fold to 16 bits before adding the tail (less than a word).
+    while( cksum >> 16) {
+      cksum = (cksum & 0xFFFF) + (cksum >> 16);
+    }
+  }
+
+  //Byte by byte: rebuild the 16-bit words as ip_checksum() reads them.
+  while( byte_nb > 1 )
+  {
+    msb = *input++;
+    lsb = *input++;
+    *output++ = msb;
+    *output++ = lsb;
+#ifdef __BIG_ENDIAN__
+    cksum += ((u32_t)msb << 8) | lsb;
+#else
+    cksum += ((u32_t)lsb << 8) | msb;
+#endif
+    byte_nb -= sizeof(u16_t);
+  }
+  if( byte_nb > 0 ) //Add left-over byte if any
+  {
+    msb = *input;
+    *output = msb;
+#ifdef __BIG_ENDIAN__
+    cksum += ((u32_t)msb << 8);
+#else
+    cksum += msb;
+#endif
+  }
+
   //Fold 32-bit sum to 16 bits
   while( cksum >> 16) {
     cksum = (cksum & 0xFFFF) + (cksum >> 16);
   }
 
-  //Return the 16-bit result in big endian.
   return ((u16_t)cksum);
 }
 
+#ifdef IP_CHECKSUM_SSE2
+/*!
+ * Function name: ip_checksum_sse2
+ * \return checksum value (in big endian).
+ * \param big_endian_frame : [in] Pointer to a big endian buffer.
+ * \param byte_nb : [in] Size in "bytes" of "big_endian_frame".
+ * \brief Compute the 16-bit one's complement checksum 16 bytes at a time:
+ * the 16-bit words are widened to 32-bit lanes and added without carry.
+ * \note A lane cannot overflow before 65536 additions, so the lanes are 
+ * folded every 32768 lines.
+ * *******************************************************************/
+static u16_t ip_checksum_sse2(const u16_t *big_endian_frame, u32_t byte_nb)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc;
+  __m128i line;
+  unsigned int lanes[4]; //32-bit lanes whatever the size of "u32_t".
+  u32_t cksum = 0;
+  u32_t block;
+
+  while( byte_nb >= 16 )
+  {
+    acc = _mm_setzero_si128();
+    block = byte_nb / 16;
+    if( block > 32768 ) { block = 32768; }
+    byte_nb -= block * 16;
+    while( block-- )
+    {
+      line = _mm_loadu_si128((const __m128i*)big_endian_frame);
+      acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(line, zero));
+      acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(line, zero));
+      big_endian_frame += 8;
+    }
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    cksum += (lanes[0] & 0xFFFF) + (lanes[0] >> 16) + (lanes[1] & 0xFFFF) + (lanes[1] >> 16);
+    cksum += (lanes[2] & 0xFFFF) + (lanes[2] >> 16) + (lanes[3] & 0xFFFF) + (lanes[3] >> 16);
+  }
+  cksum += ip_checksum_tail(big_endian_frame, byte_nb);
+  while( cksum >> 16) {
+    cksum = (cksum & 0xFFFF) + (cksum >> 16);
+  }
+
+  return ((u16_t)cksum);
+}
+#endif /* IP_CHECKSUM_SSE2 */
+
+#ifdef IP_CHECKSUM_AVX2
+/*!
+ * Function name: ip_checksum_avx2
+ * \return checksum value (in big endian).
+ * \param big_endian_frame : [in] Pointer to a big endian buffer.
+ * \param byte_nb : [in] Size in "bytes" of "big_endian_frame".
+ * \brief Same as ip_checksum_sse2() 32 bytes at a time.
+ * \note Only selected if the processor supports AVX2.
+ * *******************************************************************/
+__attribute__((target("avx2")))
+static u16_t ip_checksum_avx2(const u16_t *big_endian_frame, u32_t byte_nb)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc;
+  __m256i line;
+  unsigned int lanes[8]; //32-bit lanes whatever the size of "u32_t".
+  u32_t cksum = 0;
+  u32_t block;
+  u32_t i;
+
+  while( byte_nb >= 32 )
+  {
+    acc = _mm256_setzero_si256();
+    block = byte_nb / 32;
+    if( block > 32768 ) { block = 32768; }
+    byte_nb -= block * 32;
+    while( block-- )
+    {
+      line = _mm256_loadu_si256((const __m256i*)big_endian_frame);
+      acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(line, zero));
+      acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(line, zero));
+      big_endian_frame += 16;
+    }
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    for( i = 0; i < 8; i++)
+    {
+      cksum += (lanes[i] & 0xFFFF) + (lanes[i] >> 16);
+    }
+  }
+  cksum += ip_checksum_tail(big_endian_frame, byte_nb);
+  while( cksum >> 16) {
+    cksum = (cksum & 0xFFFF) + (cksum >> 16);
+  }
+
+  return ((u16_t)cksum);
+}
+#endif /* IP_CHECKSUM_AVX2 */
+
+#ifdef IP_CHECKSUM_NEON
+/*!
+ * Function name: ip_checksum_neon
+ * \return checksum value (in big endian).
+ * \param big_endian_frame : [in] Pointer to a big endian buffer.
+ * \param byte_nb : [in] Size in "bytes" of "big_endian_frame".
+ * \brief Same as ip_checksum_sse2() with a pairwise add and accumulate.
+ * *******************************************************************/
+static u16_t ip_checksum_neon(const u16_t *big_endian_frame, u32_t byte_nb)
+{
+  uint32x4_t acc;
+  unsigned int lanes[4]; //32-bit lanes whatever the size of "u32_t".
+  u32_t cksum = 0;
+  u32_t block;
+
+  while( byte_nb >= 16 )
+  {
+    acc = vdupq_n_u32(0);
+    block = byte_nb / 16;
+    if( block > 32768 ) { block = 32768; }
+    byte_nb -= block * 16;
+    while( block-- )
+    {
+      acc = vpadalq_u16(acc, vld1q_u16(big_endian_frame));
+      big_endian_frame += 8;
+    }
+    vst1q_u32((uint32_t*)lanes, acc);
+    cksum += (lanes[0] & 0xFFFF) + (lanes[0] >> 16) + (lanes[1] & 0xFFFF) + (lanes[1] >> 16);
+    cksum += (lanes[2] & 0xFFFF) + (lanes[2] >> 16) + (lanes[3] & 0xFFFF) + (lanes[3] >> 16);
+  }
+  cksum += ip_checksum_tail(big_endian_frame, byte_nb);
+  while( cksum >> 16) {
+    cksum = (cksum & 0xFFFF) + (cksum >> 16);
+  }
+
+  return ((u16_t)cksum);
+}
+#endif /* IP_CHECKSUM_NEON */
+
 /*!
  * Function name: eth_build_ip_request
  * \return length of the IP frame.
@@ -434,7 +947,8 @@ u16_t ip_checksum(const u16_t *big_endian_frame, u32_t byte_nb)
  * \param ip_output_frame : [out] Frame generated starting at the IP header to the end of the app data.
  * \param transport_length : [in] Length of Udp (or TCP) header and app data.
  * \param protocol : [in] IP_UDP or IP_TCP. 
- * \param reuse : [in] Flag. If set to TRUE, constant fields are not set again. 
+ * \param reuse : [in] Flag. If set to TRUE, constant fields are not set again
+ * and the checksum is updated incrementally (see ip_set_constant_fields()). 
  * \brief descriptions: Build the IP frame. 
  * *******************************************************************/
 void eth_build_ip_request(
@@ -455,14 +969,88 @@ void eth_build_ip_request(
     ip->protocol = protocol;
     ip->source_addr = htonl(source_ip_addr);
     ip->dest_addr = htonl(dest_ip_addr);
+    ip->length = htons( sizeof(IP_HEADER_T) + transport_length); //IP frame length.
+    ip->checksum = 0;//Reset before scanning the frame
+    ip->checksum = ~ip_checksum((const u16_t*)ip_output_frame, sizeof(IP_HEADER_T));
+  }
+  else
+  { //Only the length can change: the checksum of the header is updated.
+    ip_update_length( ip_output_frame, transport_length);
   }
-  ip->length = htons( sizeof(IP_HEADER_T) + transport_length); //IP frame length.
-  ip->checksum = 0;//Reset before scanning the frame
-  ip->checksum = ~ip_checksum((const u16_t*)ip, sizeof(IP_HEADER_T));
 
   return ;
 }
 
+/*!
+ * Function name: ip_update_length
+ * \return nothing.
+ * \param ip_output_frame : [in/out] Frame starting at the IP header. Its header is complete.
+ * \param transport_length : [in] New length of Udp (or TCP) header and app data.
+ * \brief Change the length of a complete IP header and update its 
+ * checksum incrementally instead of recalculating it.
+ * *******************************************************************/
+void ip_update_length( u8_t* const ip_output_frame, const u32_t transport_length)
+{
+  IP_HEADER_T* ip = (IP_HEADER_T*)ip_output_frame;
+  u16_t new_length = htons( sizeof(IP_HEADER_T) + transport_length);
+
+  if( ip->length != new_length ) {
+    ip->checksum = ip_checksum_update16( ip->checksum, ip->length, new_length);
+    ip->length = new_length;
+  }
+
+  return ;
+}
+
+/*!
+ * Function name: ip_checksum_update16
+ * \return the new checksum (in big endian).
+ * \param checksum : [in] checksum field of the header (in big endian).
+ * \param old_value : [in] 16-bit field before the change (as in the frame).
+ * \param new_value : [in] 16-bit field after the change (as in the frame).
+ * \brief Update a checksum when one 16-bit field of a header changes.
+ * \note HC' = ~(~HC + ~m + m') where HC is the checksum, m the old 
+ * value and m' the new one (see the RFC1624, eqn. 3).
+ * *******************************************************************/
+u16_t ip_checksum_update16(const u16_t checksum, const u16_t old_value, const u16_t new_value)
+{
+  u32_t cksum;
+
+  cksum = (u16_t)~checksum;
+  cksum += (u16_t)~old_value;
+  cksum += new_value;
+  //Fold 32-bit sum to 16 bits
+  while( cksum >> 16) {
+    cksum = (cksum & 0xFFFF) + (cksum >> 16);
+  }
+
+  return (u16_t)~cksum;
+}
+
+/*!
+ * Function name: ip_checksum_update32
+ * \return the new checksum (in big endian).
+ * \param checksum : [in] checksum field of the header (in big endian).
+ * \param old_value : [in] 32-bit field before the change (as in the frame).
+ * \param new_value : [in] 32-bit field after the change (as in the frame).
+ * \brief Update a checksum when one 32-bit field of a header changes.
+ * \note The two 16-bit halves are added whatever their order in memory.
+ * *******************************************************************/
+u16_t ip_checksum_update32(const u16_t checksum, const u32_t old_value, const u32_t new_value)
+{
+  u32_t cksum;
+
+  cksum = (u16_t)~checksum;
+  cksum += (u16_t)~(old_value >> 16) + (u16_t)~old_value;
+  cksum += ((new_value >> 16) & 0xFFFF) + (new_value & 0xFFFF);
+  //Fold 32-bit sum to 16 bits
+  while( cksum >> 16) {
+    cksum = (cksum & 0xFFFF) + (cksum >> 16);
+  }
+
+  return (u16_t)~cksum;
+}
+
 /*!
  * Function name: ip_set_constant_fields
  * \return nothing.
@@ -488,6 +1076,9 @@ void ip_set_constant_fields(
   ip->protocol = protocol;
   ip->source_addr = htonl(source_ip_addr);
   ip->dest_addr = htonl(dest_ip_addr);
+  //Keep the checksum consistent with the header so that eth_build_ip_request() can update it incrementally.
+  ip->checksum = 0;
+  ip->checksum = ~ip_checksum((const u16_t*)ip_output_frame, sizeof(IP_HEADER_T));
 
   return ;
 }
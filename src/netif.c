@@ -64,6 +64,7 @@ void netif_init( void)
     g_MAC_adapter[i].num = UNUSED;
   }
 
+  ip_checksum_init();
   (void)tcp_init();
 }
 
@@ -106,6 +107,7 @@ NETIF_T * netif_new(
       const void* const pDriver_arg, err_t* err)
 {
   u32_t i;
+  u32_t j;
   NETIF_T *p = NULL;
 
   for( i = 0; i < MAX_NET_ADAPTER; i++)
@@ -135,6 +137,8 @@ NETIF_T * netif_new(
     p->ping_reply_received = NULL;
     p->driver_recv = driver_recv;
     p->driver_send = driver_send;
+    p->driver_send_batch = NULL;
+    p->checksum_offload = 0;
     p->pDriver_arg = (void*)pDriver_arg;
     for( i = 0; i < MAC_ADDRESS_LENGTH; i++)
     { p->mac_address[i] = mac_address[i];}
@@ -154,19 +158,90 @@ NETIF_T * netif_new(
     p->rcv_pos_remove = 0;
     p->ISR_rcv_nb = 0;
     p->ISR_rcv_nb = p->processed_nb;
+    p->unmatched_nb = 0;
+    p->tcp_clock = 0;
+    p->tcp_fine_clock = FALSE;
+    p->tcp_wheel_time = 0;
+    p->tcp_syn_cs = NULL;
+    p->tcp_syn_free = &(p->tcp_syn_list[0]);  /*!< List of the SYN backlog entries not used: all of them. */
+    for( i = 0; i < TCP_SYN_BACKLOG; i++)
+    {
+      p->tcp_syn_list[i].next = (i < TCP_SYN_BACKLOG - 1)? &(p->tcp_syn_list[i+1]) : NULL;
+    }
+    //Not secret: the application gives a random seed with netif_syn_secret() before the SYN cookies are used.
+    p->tcp_syn_secret = (((u32_t)p->mac_address[2] << 24) | ((u32_t)p->mac_address[3] << 16) | ((u32_t)p->mac_address[4] << 8) | p->mac_address[5]) ^ (ipaddr * 0x9E3779B1UL);
+    p->tcp_syn_seeded = FALSE;
+    for( i = 0; i < TCP_TIMER_WHEEL_SIZE; i++)
+    {
+      p->tcp_wheel[i] = NULL;
+    }
+    p->tcp_frame_free = &(p->tcp_frames[0]);  /*!< List of the frames not borrowed: all of them. */
+    p->tcp_frame_free_nb = TCP_FRAME_POOL;
+    for( i = 0; i < TCP_FRAME_POOL; i++)
+    {
+      p->tcp_frames[i].next = (i < TCP_FRAME_POOL - 1)? &(p->tcp_frames[i+1]) : NULL;
+    }
+    p->tcp_rcv_ring_free = &(p->tcp_rcv_rings[0]);  /*!< List of the receive rings not borrowed: all of them. */
+    for( i = 0; i < TCP_RCV_RING_POOL; i++)
+    {
+      p->tcp_rcv_rings[i].next = (i < TCP_RCV_RING_POOL - 1)? &(p->tcp_rcv_rings[i+1]) : NULL;
+    }
+    p->tcp_snd_ring_free = &(p->tcp_snd_rings[0]);  /*!< List of the send rings not borrowed: all of them. */
+    for( i = 0; i < TCP_SND_RING_POOL; i++)
+    {
+      p->tcp_snd_rings[i].next = (i < TCP_SND_RING_POOL - 1)? &(p->tcp_snd_rings[i+1]) : NULL;
+    }
     p->optimized = optimized;
     p->tcp_server_cs = NULL;  /*!< List of all TCP controllers that are in a LISTEN state. */
     p->tcp_active_cs = NULL;  /*!< List of all TCP controllers that are in a state in which they accept or send data. */
     p->udp_cs = NULL;  /*!< List of all UDP controllers. */
     p->callback_arg = NULL;
+    p->tcp_free_cs = &(p->tcp_c_list[0]);  /*!< List of all TCP controllers not used: all of them. */
     for( i = 0; i < MAX_TCP; i++)
     {
       p->tcp_c_list[i].id = UNUSED;
+      p->tcp_c_list[i].hash_bucket = NULL;
+      p->tcp_c_list[i].prev = (i > 0)? &(p->tcp_c_list[i-1]) : NULL;
+      p->tcp_c_list[i].next = (i < MAX_TCP - 1)? &(p->tcp_c_list[i+1]) : NULL;
+      p->tcp_c_list[i].list = &(p->tcp_free_cs);
+      p->tcp_c_list[i].control_segment.frame = (u8_t*)p->tcp_c_list[i].control_frame;
+      p->tcp_c_list[i].control_segment.buffer = NULL;
+      p->tcp_c_list[i].rcv_ring = NULL;
+      p->tcp_c_list[i].snd_ring = NULL;
+      for( j = 0; j < MAX_TCP_SEG; j++)
+      {
+        p->tcp_c_list[i].segment[j].frame = NULL; //Borrowed from "tcp_frames" when the segment is sent.
+        p->tcp_c_list[i].segment[j].buffer = NULL;
+      }
+      for( j = 0; j < TCP_TIMER_NB; j++)
+      {
+        p->tcp_c_list[i].timers[j].next = NULL;
+        p->tcp_c_list[i].timers[j].pprev = NULL;
+        p->tcp_c_list[i].timers[j].tcp_c = &(p->tcp_c_list[i]);
+        p->tcp_c_list[i].timers[j].kind = (tcp_timer_kind)j;
+      }
+    }
+    for( i = 0; i < TCP_HASH_SIZE; i++)
+    {
+      p->tcp_hash[i] = NULL;
+    }
+    for( i = 0; i < TCP_LISTEN_HASH_SIZE; i++)
+    {
+      p->tcp_listen_hash[i] = NULL;
     }
 
+    p->udp_free_cs = &(p->udp_c_list[0]);  /*!< List of all UDP controllers not used. */
     for( i = 0; i < MAX_UDP; i++)
     {
       p->udp_c_list[i].state = UNUSED;
+      p->udp_c_list[i].prev = (i > 0)? &(p->udp_c_list[i-1]) : NULL;
+      p->udp_c_list[i].next = (i < MAX_UDP - 1)? &(p->udp_c_list[i+1]) : NULL;
+      p->udp_c_list[i].list = &(p->udp_free_cs);
+    }
+
+    for( i = 0; i < MAX_UDP_CYCLIC; i++)
+    {
+      p->udp_cyclic_list[i].udp_c = NULL;
     }
   } else {
     *err = ERR_SEG_MEM;
@@ -186,6 +261,7 @@ void netif_delete(NETIF_T *pnetif)
   pnetif->num = UNUSED; //free the resource so it can be reused by "netif_new"
   pnetif->netmask = 0; //Reject all the incoming frames in "netif_filter"
   pnetif->driver_send = NULL; // Shortcut "netif_send"
+  pnetif->driver_send_batch = NULL; // Shortcut "netif_send_batch"
   return;
 }
 
@@ -205,7 +281,9 @@ err_t netif_send(NETIF_T *pnetif, u8_t *frame, u32_t frame_length)
 
   if( pnetif->driver_send )
   {
+    NETIF_LOCK(); //udp_cyclic_timer() may send from the timer ISR.
     pnetif->driver_send(pnetif->pDriver_arg, frame, frame_length);
+    NETIF_UNLOCK();
     if(err)
     {
       err = adapter_store_error( ERR_DEVICE_DRIVER, pnetif, __func__, __LINE__);
@@ -214,6 +292,47 @@ err_t netif_send(NETIF_T *pnetif, u8_t *frame, u32_t frame_length)
   return err;
 }
 
+/*!
+ * Function name: netif_send_batch
+ * \return ERR_OK or ERR_DEVICE_DRIVER
+ * \param pnetif : [in] network adapter.
+ * \param frames : [in] ethernet frames.
+ * \param frame_lengths : [in] ethernet frame lengths.
+ * \param frame_nb : [in] number of frames.
+ * \brief Forward several ethernet frames to the device driver in one call
+ * if the driver supports it, one by one with netif_send() otherwise (the
+ * first error is returned).
+ * *******************************************************************/
+err_t netif_send_batch(NETIF_T *pnetif, u8_t **frames, u32_t *frame_lengths, u32_t frame_nb)
+{
+  err_t err = ERR_OK;
+  err_t frame_err;
+  u32_t i;
+
+  if( pnetif->driver_send_batch )
+  {
+    if( frame_nb )
+    {
+      NETIF_LOCK(); //udp_cyclic_timer() may send from the timer ISR.
+      frame_err = pnetif->driver_send_batch(pnetif->pDriver_arg, frames, frame_lengths, frame_nb);
+      NETIF_UNLOCK();
+      if( frame_err )
+      {
+        err = adapter_store_error( ERR_DEVICE_DRIVER, pnetif, __func__, __LINE__);
+      }
+    }
+  }
+  else
+  {
+    for( i = 0; i < frame_nb; i++)
+    {
+      frame_err = netif_send(pnetif, frames[i], frame_lengths[i]);
+      if( !err ) { err = frame_err; } //Keep the first error.
+    }
+  }
+  return err;
+}
+
 /*!
  * Function name: netif_filter
  * \return TRUE or FALSE
@@ -307,12 +426,13 @@ void netif_ISR(void *network_adapter)
     //Get the frame from the device driver. Due to the device driver lock, every instruction from the beginning of this function to here is in a "critical section".
     frame_length = pnetif->driver_recv(pnetif->pDriver_arg, rcv_buf);
 
-    if ( frame_length )
+    if ( frame_length & NETIF_RX_LENGTH_MASK )
     { //Filter the frame
       bool_t accepted;
       accepted = netif_filter(rcv_buf, pnetif);
       if( accepted)
       { //Enqueue the frame
+        pnetif->rx_checksum_list[pnetif->rcv_pos_insert] = (frame_length >> NETIF_RX_CHECKSUM_SHIFT) & pnetif->checksum_offload & NETIF_CHECKSUM_RX;
         pnetif->rcv_pos_insert = rcv_pos_insert;
         pnetif->ISR_rcv_nb++;
       }
@@ -352,8 +472,9 @@ void netif_ISR_optimized(void *network_adapter)
 
     //Get the frame from the device driver. Due to the device driver lock, every instruction from the beginning of this function to here is in a "critical section".
     frame_length = pnetif->driver_recv(pnetif->pDriver_arg, rcv_buf);
-    if ( frame_length )
+    if ( frame_length & NETIF_RX_LENGTH_MASK )
     {
+      u32_t rx_checksum = (frame_length >> NETIF_RX_CHECKSUM_SHIFT) & pnetif->checksum_offload & NETIF_CHECKSUM_RX;
       IP_HEADER_T * ip_header;
       ETHER_HEADER_T * ethernet_header;
       u8_t* frame;
@@ -363,10 +484,11 @@ void netif_ISR_optimized(void *network_adapter)
       ip_header = (IP_HEADER_T*)(frame + sizeof(ETHER_HEADER_T));
       if( (ethernet_header->frame_type == ntohs(ETHERTYPE_IP)) && (ip_header->protocol == IP_UDP))
       {  //Forward directly to the UDP parser
-        (void)udp_parse((u8_t*)ip_header, (u32_t)ntohs(ip_header->length), pnetif);
+        (void)udp_parse((u8_t*)ip_header, (u32_t)ntohs(ip_header->length), rx_checksum, pnetif);
       }
       else if( netif_filter(rcv_buf, pnetif)) //Filter the frame
       { //Enqueue the frame
+        pnetif->rx_checksum_list[pnetif->rcv_pos_insert] = rx_checksum;
         pnetif->rcv_pos_insert = rcv_pos_insert;
         pnetif->ISR_rcv_nb++;
       }
@@ -408,10 +530,10 @@ err_t netif_dispatch(NETIF_T *pnetif)
     if( ethernet_header->frame_type == ntohs(ETHERTYPE_IP) ) { //IPv4
       ETHER_IP_HEADER_T* ethernet_ip_header = (ETHER_IP_HEADER_T*)eth_frame;
       frame_length = (u32_t)ntohs(ethernet_ip_header->ip.length) + sizeof(ETHER_HEADER_T);
-      if( frame_length > NETWORK_MTU - (sizeof(ETHER_HEADER_T) + ETHER_CRC_LENGTH)) { //Max size of an IP frame. That situation is unlikely to happen but still can. The max will safely limit the checksum scope of calculation and then reject that improper frame.
-        frame_length = NETWORK_MTU - (sizeof(ETHER_HEADER_T) + ETHER_CRC_LENGTH);
+      if( frame_length > NETWORK_MTU - ETHER_CRC_LENGTH) { //Max size of an ethernet frame (without CRC). That situation is unlikely to happen but still can. The max will safely limit the checksum scope of calculation and then reject that improper frame.
+        frame_length = NETWORK_MTU - ETHER_CRC_LENGTH;
       }
-      err = ip_parse(eth_frame, frame_length, pnetif);
+      err = ip_parse(eth_frame, frame_length, pnetif->rx_checksum_list[pnetif->rcv_pos_remove], pnetif);
     } else if (ethernet_header->frame_type == ntohs(ETHERTYPE_ARP) ) {
       err = arp_parse(eth_frame, pnetif);
     }
@@ -437,6 +559,46 @@ void netif_arg(NETIF_T *adapter, void *arg)
   adapter->callback_arg = arg;
 }
 
+/*!
+ * Function name: netif_checksum_offload
+ * \return nothing.
+ * \param adapter : [out] adapter of interest.
+ * \param capabilities : [in] NETIF_CHECKSUM_* flags.
+ * \brief Declare the checksums that the adapter verifies or inserts in
+ * hardware.
+ * *******************************************************************/
+void netif_checksum_offload (NETIF_T *adapter, u32_t capabilities)
+{
+  adapter->checksum_offload = capabilities;
+}
+
+/*!
+ * Function name: netif_driver_send_batch
+ * \return nothing.
+ * \param adapter : [out] adapter of interest.
+ * \param driver_send_batch : [in] device driver function queuing several frames in one call.
+ * \brief Plug a device driver function sending a batch of frames.
+ * See netif_send_batch().
+ * *******************************************************************/
+void netif_driver_send_batch (NETIF_T *adapter, err_t (* driver_send_batch)(void* pDriver_arg, u8_t** eth_frames, u32_t* byte_counts, u32_t frame_nb))
+{
+  adapter->driver_send_batch = driver_send_batch;
+}
+
+/*!
+ * Function name: netif_syn_secret
+ * \return nothing.
+ * \param adapter : [out] adapter of interest.
+ * \param random_seed : [in] 32 random bits.
+ * \brief Key the SYN cookies and the initial sequence numbers of the TCP
+ * servers with a random secret. It enables the SYN cookies.
+ * *******************************************************************/
+void netif_syn_secret (NETIF_T *adapter, u32_t random_seed)
+{
+  adapter->tcp_syn_secret = random_seed & 0xFFFFFFFFUL;
+  adapter->tcp_syn_seeded = TRUE;
+}
+
 /*!
  * Function name: netif_ping_received
  * \return nothing.
@@ -48,6 +48,45 @@
 
 #define TCP_MTU (NETWORK_MTU - (sizeof(TCP_HEADER_T) + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T) + ETHER_CRC_LENGTH)) //Max data in a segment
 #define ETH_IP_TCP_HEADER_SIZE ( sizeof(ETHER_HEADER_T) + sizeof(IP_HEADER_T) + sizeof(TCP_HEADER_T) )
+#define TCP_RING_INDEX(index) (((index) >= TCP_WND)? (index) - TCP_WND : (index)) //!< Wrap an index of "rcv_ring" (index < 2*TCP_WND).
+#define TCP_TX_OFFLOAD(tcp_c) ((tcp_c)->netif->checksum_offload & NETIF_CHECKSUM_TX_TCP) //!< The adapter inserts the TCP checksum.
+#define TCP_SEQ_LT(a,b) U32_BEFORE(a,b) //!< Sequence number "a" is before "b" (modulo 2^32).
+#define TCP_SEQ_GT(a,b) U32_BEFORE(b,a) //!< Sequence number "a" is after "b" (modulo 2^32).
+#define TCP_SEGMENT_LENGTH(tcp_c, segment) ((segment)->len - ETH_IP_TCP_HEADER_SIZE - (tcp_c)->options_length) //!< Data bytes of an unacknowledged data segment.
+#define TCP_FIN_ACKED(tcp_c) ((tcp_c)->snd_fin && ((tcp_c)->snd_una == (tcp_c)->local_seqno)) //!< The peer device has acknowledged the FIN of cIPS.
+#define TCP_SEGMENT_SEQNO(tcp_c, segment) (((segment)->ack_no - TCP_SEGMENT_LENGTH(tcp_c, segment)) & TCP_SEQ_MASK) //!< Sequence number of the first byte of an unacknowledged data segment.
+#define TCP_SEND_MSS(tcp_c) (((tcp_c)->remote_mss > (tcp_c)->options_length)? (tcp_c)->remote_mss - (tcp_c)->options_length : (tcp_c)->remote_mss) //!< Data bytes of a full segment: the options take room in each segment (RFC 6691).
+#define TCP_DELAYED_ACK_SEGMENTS 2 //!< cIPS acknowledges at least every second segment received (RFC 5681).
+#define TCP_HASH(remote_ip, remote_port, local_port) ((((remote_ip) ^ ((remote_ip) >> 16)) ^ ((u32_t)(remote_port) << 5) ^ (remote_port) ^ (local_port)) & (TCP_HASH_SIZE - 1)) //!< Bucket of a connection in "netif->tcp_hash".
+#define TCP_LISTEN_HASH(local_port) ((local_port) & (TCP_LISTEN_HASH_SIZE - 1)) //!< Bucket of a server in "netif->tcp_listen_hash".
+#define TCP_WHEEL_TICK(time) ((u32_t)(time) / TCP_TIMER_WHEEL_SLOT) //!< Tick of the timer wheel holding the time "time" (ms).
+#define TCP_WHEEL_SLOT(tick) ((tick) & (TCP_TIMER_WHEEL_SIZE - 1)) //!< Slot of "netif->tcp_wheel" holding the tick "tick".
+#define TCP_LOCAL_MSS ((TCP_MSS < TCP_MTU)?TCP_MSS:TCP_MTU) //!< MSS option that cIPS sends.
+#define TCP_SYN_COOKIE_TIME(clock) ((u32_t)(clock) >> 16) //!< A SYN cookie is valid for one or two of these periods (65 s).
+#define TCP_SYN_WND ((TCP_WND > 0xFFFF)? 0xFFFF : TCP_WND) //!< Window of the SYN|ACK: it is never scaled.
+#define TCP_SYN_COOKIE_MSS_MASK 0x3UL //!< Bits of a SYN cookie holding the index of the MSS in "tcp_syn_cookie_mss".
+#define TCP_SYN_COOKIES_ON(net_adapter) (TCP_SYN_COOKIES && (net_adapter)->tcp_syn_seeded) //!< SYN cookies are only answered with a random secret (see netif_syn_secret()).
+#define TCP_SND_RING_INDEX(tcp_c, seqno) ((((seqno) - (tcp_c)->snd_ring_base) & TCP_SEQ_MASK) % TCP_SND_BUF) //!< Index of "snd_ring" holding the byte "seqno".
+#define TCP_SND_SPACE(tcp_c) (TCP_SND_BUF - (((tcp_c)->snd_nxt - (tcp_c)->snd_una) & TCP_SEQ_MASK) - (tcp_c)->snd_queued) //!< Free bytes of "snd_ring": tcp_write() accepts them.
+
+#if (TCP_HASH_SIZE & (TCP_HASH_SIZE - 1)) || (TCP_LISTEN_HASH_SIZE & (TCP_LISTEN_HASH_SIZE - 1))
+#error "TCP_HASH_SIZE and TCP_LISTEN_HASH_SIZE must be powers of 2."
+#endif
+#if (TCP_TIMER_WHEEL_SIZE & (TCP_TIMER_WHEEL_SIZE - 1)) || (TCP_TIMER_WHEEL_SLOT & (TCP_TIMER_WHEEL_SLOT - 1))
+#error "TCP_TIMER_WHEEL_SIZE and TCP_TIMER_WHEEL_SLOT must be powers of 2."
+#endif
+#if (TCP_SYN_BACKLOG < 1)
+#error "TCP_SYN_BACKLOG must be at least 1."
+#endif
+#if (TCP_FRAME_POOL < 1) || (TCP_RCV_RING_POOL < 1) || (TCP_SND_RING_POOL < 1)
+#error "TCP_FRAME_POOL, TCP_RCV_RING_POOL and TCP_SND_RING_POOL must be at least 1."
+#endif
+#if (TCP_SND_BUF < TCP_MSS)
+#error "TCP_SND_BUF must hold at least one segment (TCP_MSS)."
+#endif
+
+//! MSS a SYN cookie can hold: the largest one not above the MSS of the peer device is encoded.
+static const u32_t tcp_syn_cookie_mss[TCP_SYN_COOKIE_MSS_MASK + 1] = { 536, 1220, 1440, 1460 };
 
 /*!Type of socket to indicate whether the socket can be reused when CLOSED
 TCP_PERSISTENT: the socket can be closed and reopened (i.e it keeps its parameters (IP addresses, ports#...)).
@@ -65,6 +104,34 @@ static const u32_t DEFAULT_500ms_NB = ~0; //!<In ticks. Default value use to cal
 #define TCP_URG 0x20U //Not supported
 
 #define TCP_FLAGS_MASK 0x3FU
+
+/*!TCP options (RFC 793, RFC 7323)*/
+#define TCP_OPTION_END 0U //!< End of option list
+#define TCP_OPTION_NOP 1U //!< No operation (padding)
+#define TCP_OPTION_MSS 2U //!< Maximum segment size
+#define TCP_OPTION_WND_SCALE 3U //!< Window scale
+#define TCP_OPTION_SACK_PERMITTED 4U //!< Selective acknowledgments permitted (RFC 2018)
+#define TCP_OPTION_SACK 5U //!< Selective acknowledgment blocks (RFC 2018)
+#define TCP_OPTION_TIMESTAMPS 8U //!< Timestamps (RFC 7323)
+#define TCP_OPTION_MSS_LENGTH 4U
+#define TCP_OPTION_WND_SCALE_LENGTH 3U
+#define TCP_OPTION_SACK_PERMITTED_LENGTH 2U
+#define TCP_OPTION_SACK_LENGTH(blocks) (2U + 8U*(blocks)) //!< Kind, length and the left and right edges of each block.
+#define TCP_OPTION_TIMESTAMPS_LENGTH 10U
+#define TCP_TIMESTAMPS_LENGTH 12U //!< Timestamps option aligned by 2 NOPs, in every segment once negotiated.
+#define TCP_SYN_OPTIONS_LENGTH 24U //!< MSS, SACK permitted, window scale and timestamps aligned by NOPs: the largest options cIPS sends in a SYN.
+#define TCP_MAX_OPTIONS_LENGTH 40U //!< The data offset field limits the TCP header to 60 bytes.
+#define TCP_MAX_SACK_BLOCKS 3U //!< SACK blocks per ACK. RFC 2018: 3 blocks leave room for the timestamps.
+#define TCP_MAX_WND_SCALE 14U //!< Largest shift allowed by RFC 7323.
+#define TCP_OPTION_GET32(option) (((u32_t)(option)[0] << 24) | ((u32_t)(option)[1] << 16) | ((u32_t)(option)[2] << 8) | (u32_t)(option)[3]) //!< Big endian field of an option.
+
+/*!Options negotiated in the SYNs ("peer_options")*/
+#define TCP_PEER_WND_SCALE 0x01U //!< Window scale (RFC 7323)
+#define TCP_PEER_SACK_PERMITTED 0x02U //!< Selective acknowledgments (RFC 2018)
+#define TCP_PEER_TIMESTAMPS 0x04U //!< Timestamps (RFC 7323)
+#define TCP_OFFERED_OPTIONS (TCP_PEER_WND_SCALE | ((TCP_SACK)? TCP_PEER_SACK_PERMITTED : 0) | ((TCP_TIMESTAMPS)? TCP_PEER_TIMESTAMPS : 0)) //!< Options cIPS offers in its SYN.
+#define TCP_SACK_ENABLED(tcp_c) ((tcp_c)->peer_options & TCP_PEER_SACK_PERMITTED)
+#define TCP_TIMESTAMPS_ENABLED(tcp_c) ((tcp_c)->peer_options & TCP_PEER_TIMESTAMPS)
 #define TCP_GET_HEADER_LENGTH(pheader) ((ntohs((pheader)->data_offset_flags) >> 12)*sizeof(u32_t)) //!<<in bytes
 #define TCP_SET_HEADER_LENGTH(pheader, header_length_in_bytes) (pheader)->data_offset_flags = htons( (((header_length_in_bytes)/sizeof(u32_t)) << 12) | TCP_GET_FLAGS(pheader))
 #define TCP_GET_FLAGS(pheader)  (ntohs((pheader)->data_offset_flags) & TCP_FLAGS_MASK)
@@ -73,30 +140,80 @@ static const u32_t DEFAULT_500ms_NB = ~0; //!<In ticks. Default value use to cal
 static err_t tcp_process_application_events(TCP_T *tcp_c, const TCP_USER_COMMAND command, void* arg);
 static err_t tcp_process_network_events(TCP_T *tcp_c, u16_t flags, TCP_HEADER_T *tcphdr, u32_t app_data_length);
 static err_t tcp_process_timer_events(TCP_T *tcp_c);
-static u32_t tcp_parse_options(const u8_t* const option);
+static void tcp_state_timer(TCP_T* const tcp_c);
+static void tcp_check_timer(TCP_T* const tcp_c);
+static void tcp_timer_arm(TCP_T* const tcp_c, const tcp_timer_kind kind, const u32_t expiry);
+static void tcp_timer_cancel(TCP_T* const tcp_c, const tcp_timer_kind kind);
+static err_t tcp_timer_wheel(struct NETIF_S* net_adapter);
+static err_t tcp_timer_fire(TCP_T* const tcp_c, const tcp_timer_kind kind);
+static bool_t tcp_parse_options(TCP_T* const tcp_c, const TCP_HEADER_T* const tcphdr);
 static err_t tcp_store_error( const err_t err, TCP_T* const tcp_c, const s8_t* const function_name, const u32_t line_number);
 static err_t tcp_send_control (TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment, const u8_t control_bits, const u8_t* const options, const u8_t options_length);
-static err_t tcp_build_data_ethernet_frame (TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment, const u8_t* const pdata, const u32_t app_len,const u8_t control_bits);
+static err_t tcp_build_data_ethernet_frame (TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment, const u32_t seqno, const u32_t app_len,const u8_t control_bits);
+static void tcp_stamp_data_ethernet_frame (TCP_T* const tcp_c, const TCP_SENDING_SEG_T* const template_seg, TCP_SENDING_SEG_T* const segment, const u32_t seqno, const u32_t app_len, const u8_t control_bits, const u32_t pseudo_header);
+static u32_t tcp_copy_from_snd_ring(const TCP_T* const tcp_c, u8_t* const output, const u32_t seqno, const u32_t length);
+static err_t tcp_output(TCP_T* const tcp_c);
+static err_t tcp_queue_fin(TCP_T* const tcp_c);
+static err_t tcp_send_fin(TCP_T* const tcp_c);
+static void tcp_refresh_acknowledgment(const TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment);
+static err_t tcp_retransmit(TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment);
+static err_t tcp_retransmission_timer(TCP_T* const tcp_c);
+static err_t tcp_delayed_ack(TCP_T* const tcp_c);
+static void tcp_rto_init(TCP_T* const tcp_c);
+static void tcp_rto_restart(TCP_T* const tcp_c);
+static void tcp_rtt_sample(TCP_T* const tcp_c, const u32_t rtt);
+static err_t tcp_receive_ack(TCP_T* const tcp_c, const u16_t flags, const TCP_HEADER_T* const tcphdr, const u32_t app_data_length);
+static err_t tcp_new_ack(TCP_T* const tcp_c, const u32_t ackno);
+static err_t tcp_duplicate_ack(TCP_T* const tcp_c);
+static void tcp_sack_mark(TCP_T* const tcp_c, const u32_t left, const u32_t right);
+static u8_t tcp_format_sack_option(const TCP_T* const tcp_c, u8_t* const options);
+static err_t tcp_receive_segment(TCP_T* const tcp_c, const TCP_HEADER_T* const tcphdr, u32_t app_data_length);
+static void tcp_store_out_of_order(TCP_T* const tcp_c, const u8_t* const data, const u32_t seqno, const u32_t length);
+static err_t tcp_reassemble(TCP_T* const tcp_c);
 static err_t tcp_build_control_ethernet_frame (TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment, const u8_t control_bits, const u8_t* const options, const u8_t optlen);
 static err_t tcp_recv_null(void *arg, TCP_T *tcp_c,  void* data, u32_t data_length);
 static void tcp_need_acknowledgment (TCP_SENDING_SEG_T* segment, const u32_t app_AND_option_len, const u32_t seqno);
 static void tcp_lookup_segment_by_acknowledge_no(TCP_T* const tcp_c, const u32_t ack_no);
 static TCP_T * tcp_alloc(  struct NETIF_S* net_adapter, const u32_t type);
-static void tcp_order_active_list( TCP_T** tcp_active_cs, const struct NETIF_S* const net_adapter);
 static TCP_T* malloc_tcp_c( struct NETIF_S* net_adapter);
 static err_t tcp_reset (TCP_T* const tcp_c,  TCP_SENDING_SEG_T* const segment, const s8_t* const func, const u32_t line);
-static err_t tcp_create_child(TCP_T *tcp_c, u8_t* ip_frame);
-static void tcp_remove_server_child_cs( struct NETIF_S* net_adapter );
+static TCP_T* tcp_create_child(TCP_T *tcp_c, const TCP_SYN_T* const syn, err_t* const err);
+static err_t tcp_listen_syn(TCP_T* const tcp_c, const u8_t* const ip_frame);
+static err_t tcp_listen_ack(TCP_T* const tcp_c, const u8_t* const ip_frame, TCP_HEADER_T* const tcphdr, const u32_t app_data_length);
+static err_t tcp_syn_send(const TCP_T* const tcp_c, const TCP_SYN_T* const syn);
+static TCP_SYN_T* tcp_syn_lookup(const struct NETIF_S* const net_adapter, const TCP_T* const tcp_c, const u32_t remote_ip, const u16_t remote_port);
+static TCP_SYN_T* tcp_syn_alloc(struct NETIF_S* const net_adapter);
+static void tcp_syn_free(struct NETIF_S* const net_adapter, TCP_SYN_T* const syn);
+static u32_t tcp_syn_cookie(const struct NETIF_S* const net_adapter, const TCP_T* const tcp_c, const u32_t remote_ip, const u16_t remote_port, const u32_t irs, const u32_t period);
+static u32_t tcp_syn_mix(const u32_t hash);
+static void tcp_parse_syn_options(const TCP_HEADER_T* const tcphdr, TCP_SYN_T* const syn);
+static void tcp_apply_syn_options(TCP_T* const tcp_c, const TCP_SYN_T* const syn);
 static void segment_init_resource(TCP_T* tcp_c);
 static void segment_init_connection (TCP_T* const tcp_c, const u8_t* const dest_mac_addr);
 static void segment_change_state(TCP_T* tcp_c, TCP_SENDING_SEG_T *elt,  const seg_state new_state);
+static bool_t segment_borrow_frame(TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment);
+static void segment_return_frame(TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment);
+static void tcp_return_rcv_ring(TCP_T* const tcp_c);
+static void tcp_return_snd_ring(TCP_T* const tcp_c);
 static TCP_SENDING_SEG_T * segment_get_first( TCP_T* tcp_c, const seg_state state);
-static TCP_SENDING_SEG_T * segment_get_first_unused_after_unacked( TCP_T* tcp_c, const seg_state state);
+static TCP_SENDING_SEG_T * segment_get_oldest_unacked( TCP_T* tcp_c);
+static TCP_SENDING_SEG_T * segment_get_next_hole( TCP_T* tcp_c);
+static void segment_reset_scoreboard( TCP_T* tcp_c);
 static void tcp_register( TCP_T** tcp_active_cs,  TCP_T* tcp_c );
 static void tcp_remove( TCP_T** tcp_active_cs,  TCP_T* tcp_c );
+static void tcp_list_insert( TCP_T** list, TCP_T* tcp_c );
+static void tcp_list_remove( TCP_T* tcp_c );
+static void tcp_hash_insert( TCP_T** bucket, TCP_T* tcp_c );
+static void tcp_hash_remove( TCP_T* tcp_c );
+static TCP_T* tcp_lookup( const struct NETIF_S* const net_adapter, const u32_t remote_ip, const u16_t remote_port, const u16_t local_port);
+static TCP_T* tcp_lookup_listener( const struct NETIF_S* const net_adapter, const u16_t local_port);
 static u16_t tcp_new_port( struct NETIF_S* net_adapter);
 static u8_t* tcp_memcpy(u8_t* output, const u8_t* input, const u32_t length);
-static u32_t tcp_format_max_segment_size_option(const u16_t mss);
+static u8_t tcp_format_syn_options(const struct NETIF_S* const net_adapter, const u32_t local_mss, const u32_t ts_recent, u8_t* const options, const u32_t offered);
+static u8_t tcp_format_timestamps_option(const struct NETIF_S* const net_adapter, const u32_t ts_recent, u8_t* const options);
+static void tcp_option_put32(u8_t* const option, const u32_t value);
+static u8_t tcp_window_scale(void);
+static u16_t tcp_advertised_window(const TCP_T* const tcp_c, const u8_t control_bits);
 
 
 #if TCP_DEBUG
@@ -114,13 +231,17 @@ static void tcp_debug_print_command(u32_t command);
  * \return ERR_CHECKSUM or ERR_OK
  * \param ip_frame : [in] IP frame.
  * \param ip_frame_length : [in] Length of IP header + TCP header + app_data.
+ * \param rx_checksum : [in] NETIF_CHECKSUM_RX_* checksums already verified by the adapter.
  * \param net_adapter : [in/out] network adapter.
  * \brief The IP layer (ip_parse()) identifies a TCP frame and forwards it to 
  * the TCP layer by calling tcp_demultiplex(). tcp_demultiplex() links 
  * the frame to its TCP controller. The TCP can be a TCP client, a
  * TCP server listening or might not exist.
+ * \note The lookup only reads the headers. The checksum is verified after
+ * it, so a frame that no controller accepts is dropped without being summed
+ * (and counted in net_adapter->unmatched_nb).
  * *******************************************************************/
-err_t tcp_demultiplex(u8_t* ip_frame, u32_t ip_frame_length, struct NETIF_S *net_adapter)
+err_t tcp_demultiplex(u8_t* ip_frame, u32_t ip_frame_length, u32_t rx_checksum, struct NETIF_S *net_adapter)
 {
   u32_t tcp_frame_length;
   TCP_HEADER_T* tcphdr;
@@ -130,106 +251,141 @@ err_t tcp_demultiplex(u8_t* ip_frame, u32_t ip_frame_length, struct NETIF_S *net
   u32_t ip_header_length;
   err_t err = ERR_OK;
   u16_t pseudo_checksum;
+  TCP_T* tcp_c;
+  TCP_T* ltcp_c = NULL;
+  u16_t control_bits;
 
   iphdr = (IP_HEADER_T*) ip_frame; 
   ip_header_length = IP_GET_HEADER_LENGTH(iphdr);
   tcphdr = (TCP_HEADER_T *)(ip_frame + ip_header_length);
+  control_bits = TCP_GET_FLAGS(tcphdr) & TCP_FLAGS_MASK;
+
+  //The peer device sends a TCP frame, cIPS looks in its hash table for the TCP controller matching
+  //the incoming frame feature (port, ip address...). The lookup only reads the headers so 
+  //it comes before the checksum: a frame that no controller accepts is not summed.
+  tcp_c = tcp_lookup(net_adapter, ntohl(iphdr->source_addr), ntohs(tcphdr->source_port), ntohs(tcphdr->dest_port));
 
-  //Verify TCP checksum. The pseudo checksum takes into account the IP portion 
-  //whereas the next checksum is on the TCP portion only.
-  tcp_length = ip_frame_length - ip_header_length;
-  pseudo_checksum = eth_build_pseudo_header( ntohl(iphdr->dest_addr) , ntohl(iphdr->source_addr), tcp_length - TCP_GET_HEADER_LENGTH(tcphdr), TCP_GET_HEADER_LENGTH(tcphdr), IP_TCP);
-  if(pseudo_checksum != tcphdr->chksum)
+  if (tcp_c == NULL)
   {
-    checksum = ip_checksum( (const u16_t*)tcphdr, tcp_length );
-    checksum += (u32_t)pseudo_checksum;
-    //Fold 32-bit sum to 16 bits and add carry
-    while( checksum >> 16) {
-      checksum = (checksum & 0xFFFF) + (checksum >> 16);
+    //If cIPS did not get a match, the TCP frame might be a TCP client trying 
+    //to connect a cIPS TCP server. So cIPS tries to match the peer device frame with a TCP server.
+    //The TCP server are controller in the LISTENing state. 
+    //So cIPS checks all TCP controllers that are LISTENing for incoming connections.
+    //A server only processes a SYN, a RST or the ACK completing a handshake (see tcp_listen_ack()).
+    if( (control_bits == TCP_SYN) || ((control_bits & TCP_RST) == TCP_RST) || ((control_bits & (TCP_SYN | TCP_ACK)) == TCP_ACK) )
+    {
+      ltcp_c = tcp_lookup_listener(net_adapter, ntohs(tcphdr->dest_port));
     }
   }
-  else
-  {
-    //The peer has delegated the checksum to the adapter but the adapter has not calculated it (when it should had!).
-    //As a result the frame only has its pseudo checksum. Wireshark displays "maybe caused by "TCP chcksum offload").
-    checksum = CHECKSUM_OK;
-  }
-
-  if( checksum == CHECKSUM_OK)
-  {
 
-  //The peer device sends a TCP frame, cIPS looks in its list for the TCP controller matching
-  //the incoming frame feature (port, ip address...)
-  TCP_T* tcp_c = net_adapter->tcp_active_cs;
-  while((tcp_c != NULL) && !((tcp_c->local_port == ntohs(tcphdr->dest_port))
-  && (tcp_c->remote_port == ntohs(tcphdr->source_port)) && (tcp_c->remote_ip == ntohl(iphdr->source_addr)) ))
+  if( (tcp_c == NULL) && (ltcp_c == NULL) )
   {
-    tcp_c = tcp_c->next;
+    net_adapter->unmatched_nb++;
+    T_DEBUGF(TCP_DEBUG, ("%s#%d:TCP: no controller, frame dropped\r\n", net_adapter->name, ntohs(tcphdr->dest_port)));
   }
-
-  if (tcp_c != NULL) // The incoming segment belongs to a connection.
+  else
   {
-    if ( (ntohs(tcphdr->data_offset_flags) & TCP_RST) != TCP_RST)
-    {
-      tcp_frame_length = ip_frame_length - ( ip_header_length + TCP_GET_HEADER_LENGTH(tcphdr));
-      err = tcp_process_network_events(tcp_c, ntohs(tcphdr->data_offset_flags), tcphdr, tcp_frame_length );
+    //Verify TCP checksum. The pseudo checksum takes into account the IP portion 
+    //whereas the next checksum is on the TCP portion only.
+    tcp_length = ip_frame_length - ip_header_length;
+    if( rx_checksum & NETIF_CHECKSUM_RX_TCP )
+    { //The adapter has verified it.
+      checksum = CHECKSUM_OK;
     }
     else
     {
-      //1. cIPS notifies the application with an error code
-      err = tcp_store_error( ERR_RST, tcp_c, __func__, __LINE__);
-      //2. cIPS closes the tcp_c without sending a message to the peer device
-      tcp_c->state = CLOSED;
-      (void)tcp_remove(&(net_adapter->tcp_active_cs), tcp_c);
-      if(tcp_c->closed) 
-      {// cIPS notifies the application with a callback.
-       //The callback gives the application the opportunity to do some processing of its choice.
-        err = tcp_c->closed( tcp_c->callback_arg, tcp_c, err );
+      if( (tcp_c != NULL) && (tcp_c->pseudo_sum != 0) && (tcp_c->local_ip == ntohl(iphdr->dest_addr)) )
+      { //The addresses are the ones of the connection.
+        pseudo_checksum = ip_pseudo_header_length( tcp_c->pseudo_sum, tcp_length);
+      }
+      else
+      {
+        pseudo_checksum = eth_build_pseudo_header( ntohl(iphdr->dest_addr) , ntohl(iphdr->source_addr), tcp_length - TCP_GET_HEADER_LENGTH(tcphdr), TCP_GET_HEADER_LENGTH(tcphdr), IP_TCP);
+      }
+      if(pseudo_checksum != tcphdr->chksum)
+      {
+        checksum = ip_checksum( (const u16_t*)tcphdr, tcp_length );
+        checksum += (u32_t)pseudo_checksum;
+        //Fold 32-bit sum to 16 bits and add carry
+        while( checksum >> 16) {
+          checksum = (checksum & 0xFFFF) + (checksum >> 16);
+        }
+      }
+      else
+      {
+        //The peer has delegated the checksum to the adapter but the adapter has not calculated it (when it should had!).
+        //As a result the frame only has its pseudo checksum. Wireshark displays "maybe caused by "TCP chcksum offload").
+        checksum = CHECKSUM_OK;
       }
     }
-  }
-  else
-  {
-    //Finally, if cIPS still did not get a match, the TCP frame might be a TCP client trying 
-    //to connect a cIPS TCP server. So cIPS tries to match the peer device frame with a TCP server.
-    //The TCP server are controller in the LISTENing state. 
-    //So cIPS checks all TCP controllers that are LISTENing for incoming connections.
-    TCP_T* ltcp_c = net_adapter->tcp_server_cs;
-    while((ltcp_c != NULL) && !(ltcp_c->local_port == ntohs(tcphdr->dest_port)) )
+
+    if( checksum != CHECKSUM_OK)
     {
-      ltcp_c = ltcp_c->next;
+      T_ERROR(("%s#%d:TCP: checksum error, frame dropped\r\n", net_adapter->name, ntohs(tcphdr->dest_port)));
+      err = adapter_store_error( ERR_CHECKSUM, net_adapter, __func__, __LINE__);
     }
-    if( ltcp_c != NULL)
+    else if (tcp_c != NULL) // The incoming segment belongs to a connection.
+    {
+      if ( (ntohs(tcphdr->data_offset_flags) & TCP_RST) != TCP_RST)
+      {
+        if( (TCP_GET_HEADER_LENGTH(tcphdr) > sizeof(TCP_HEADER_T)) && !tcp_parse_options(tcp_c, tcphdr) )
+        { //PAWS (RFC 7323): an old duplicate segment. cIPS acknowledges it and drops it.
+          T_DEBUGF(TCP_DEBUG, ("%s#%d:TCP: old timestamp, frame dropped\r\n", net_adapter->name, ntohs(tcphdr->dest_port)));
+          err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_ACK, NULL, 0);
+        }
+        else
+        {
+          tcp_frame_length = ip_frame_length - ( ip_header_length + TCP_GET_HEADER_LENGTH(tcphdr));
+          err = tcp_process_network_events(tcp_c, ntohs(tcphdr->data_offset_flags), tcphdr, tcp_frame_length );
+        }
+      }
+      else
+      {
+        //1. cIPS notifies the application with an error code
+        err = tcp_store_error( ERR_RST, tcp_c, __func__, __LINE__);
+        //2. cIPS closes the tcp_c without sending a message to the peer device
+        tcp_c->state = CLOSED;
+        (void)tcp_remove(&(net_adapter->tcp_active_cs), tcp_c);
+        if(tcp_c->closed) 
+        {// cIPS notifies the application with a callback.
+         //The callback gives the application the opportunity to do some processing of its choice.
+          err = tcp_c->closed( tcp_c->callback_arg, tcp_c, err );
+        }
+      }
+    }
+    else //A TCP server (ltcp_c) accepts the frame.
     {
-      u16_t control_bits = TCP_GET_FLAGS(tcphdr) & TCP_FLAGS_MASK;
-
       if(control_bits == TCP_SYN)
       {
         T_DEBUGF(TCP_DEBUG, ("New TCP client on server port %d.\r\n",ltcp_c->local_port));
         err = tcp_process_application_events(ltcp_c, TCP_USER_SEND, (void*)ip_frame);
       }
-      else if( (control_bits & TCP_RST) == TCP_RST)
+      else if( (control_bits & TCP_RST) == TCP_RST )
       {
+        //The peer device gives up its connection request. A blind RST only guesses
+        //the 4-tuple: its sequence number must fall in the window of the SYN|ACK (RFC 5961, 3).
+        TCP_SYN_T* syn = tcp_syn_lookup(net_adapter, ltcp_c, ntohl(iphdr->source_addr), ntohs(tcphdr->source_port));
+        if( (syn != NULL) && (((ntohl(tcphdr->seqno) - (syn->irs + 1)) & TCP_SEQ_MASK) < TCP_SYN_WND) )
+        { tcp_syn_free(net_adapter, syn);}
         if(ltcp_c->state != LISTEN){
           err = tcp_store_error( ERR_RST, ltcp_c, __func__, __LINE__);
         }else{
           err = ERR_OK;
         }
-	  }
+      }
+      else //The ACK of a SYN|ACK: the child controller is created.
+      {
+        tcp_frame_length = ip_frame_length - ( ip_header_length + TCP_GET_HEADER_LENGTH(tcphdr));
+        err = tcp_listen_ack(ltcp_c, ip_frame, tcphdr, tcp_frame_length);
+      }
     }
   }
-  }
-  else
-  {
-    T_ERROR(("%s#%d:TCP: checksum error, frame dropped\r\n", net_adapter->name, ntohs(tcphdr->dest_port)));
-    err = adapter_store_error( ERR_CHECKSUM, net_adapter, __func__, __LINE__);
-  }
   return err;
 }
 
 /*!
  * Function name: tcp_process_network_events
- * \return ERR_OK, ERR_SEG_MEM, ERR_BUF, ERR_STREAMING
+ * \return ERR_OK, ERR_SEG_MEM, ERR_BUF
  * \param tcp_c : [in/out] tcp_c of interest.
  * \param flags : [in] Control bits of the TCP frame.
  * \param tcphdr : [in] TCP header of the ethernet frame.
@@ -240,7 +396,6 @@ err_t tcp_demultiplex(u8_t* ip_frame, u32_t ip_frame_length, struct NETIF_S *net
 static err_t tcp_process_network_events(TCP_T *tcp_c, u16_t flags, TCP_HEADER_T *tcphdr,
  u32_t app_data_length)
 {
-  TCP_SENDING_SEG_T* first_segment;
   err_t err = ERR_OK;
 
 #if TCP_DEBUG
@@ -263,112 +418,58 @@ static err_t tcp_process_network_events(TCP_T *tcp_c, u16_t flags, TCP_HEADER_T
       //It acknowledges by removing the ACK from the array of waiting ACK
       //2. PSH: 
       //Note: this "if" must be before "if( (flags & TCP_PSH) == TCP_PSH)"
-      (void) tcp_lookup_segment_by_acknowledge_no( tcp_c, ntohl(tcphdr->ackno));
-      //Update window size
-      tcp_c->remote_wnd = ntohs(tcphdr->windowsize);
+      bool_t stream_segment = FALSE;
+      u32_t snd_una = tcp_c->snd_una;
+      err = tcp_receive_ack(tcp_c, flags, tcphdr, app_data_length);
       if( ((flags & TCP_PSH) == 0) && (app_data_length != 0) ) //Means that the peer device sends cIPS a stream or a big file.
       {
-        if( (tcp_c->stream_sequence != (MAX_TCP_SEG -1)) && (app_data_length <= tcp_c->local_mss))// -1 is the boundary because the last packet has a PSH flag in addtion to the ACK.
-        {
-          if(tcp_c->stream_sequence==0) {tcp_c->seqno_ori = ntohl(tcphdr->seqno);}
-          //Store the incoming stream in a buffer
-          tcp_memcpy(tcp_c->stream_position,(u8_t*)tcphdr + (u32_t)TCP_GET_HEADER_LENGTH(tcphdr),app_data_length);
-          tcp_c->stream_position += app_data_length; //advance the pointer position
-          (tcp_c->stream_sequence)++; //stream_sequence counts how many segment are used.
-          if(tcp_c->seg_nb[TCP_SEG_UNSENT] ==0)
-          { //cIPS receives a TCP frame and has one to send to the peer device. 
-            //It multiplexes the ACK of the received frame with the data of the one it is sending to the peer device.
-            tcp_c->remote_seqno = ntohl(tcphdr->seqno) + app_data_length; //Sequence number to acknowledge
-            err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_ACK, NULL, 0);
-          }
-        }
-        else
-        {
-          T_ERROR(("%s#%d: Incoming stream bigger than the tcp_c buffer\r\n", tcp_c->netif->name, ntohs(tcphdr->dest_port)));
-          err =tcp_store_error( ERR_BUF, tcp_c, __func__, __LINE__);
-          tcp_c->stream_position = tcp_c->incoming_stream;
-          tcp_c->stream_sequence = 0;
-        }
+        //The application receives the data as soon as they are in order.
+        err = tcp_receive_segment(tcp_c, tcphdr, app_data_length);
+        stream_segment = TRUE;
       }
-      //If cIPS sends a large message to the peer device, cIPS holds the message in several segments.
-      //When the ACK of the first segment arrives, cIPS sends the second segments and so on.
-      //Note: if the message holds in one segment then cIPS sends it directly in tcp_write()
-      //and does not use this piece of code.
-      if(tcp_c->seg_nb[TCP_SEG_UNSENT])
+      //If cIPS sends a large message to the peer device, the message waits in the send ring.
+      //The ACK slides the send window: the segments that now fit in it are cut from the ring and leave back to back.
+      if(tcp_c->snd_queued)
       {
-        //look up unsent segment.
-        first_segment = segment_get_first( tcp_c, TCP_SEG_UNSENT);
-        //Send next "unsent" segment.
-        err = netif_send(tcp_c->netif,first_segment->frame, first_segment->len);
-        //Move the segment from the "unsent" list to the "unacked" one.
-        (void)segment_change_state( tcp_c, first_segment, TCP_SEG_UNACKED);
+        err = tcp_output(tcp_c);
+      }
+      if( (tcp_c->snd_una != snd_una) && (tcp_c->sent != NULL) )
+      { //The ACK has freed room in the send ring: the application can write again (and carry the ACK).
+        err = tcp_c->sent( tcp_c->callback_arg, tcp_c, TCP_SND_SPACE(tcp_c));
+      }
+      if( stream_segment )
+      { //No data segment has carried the acknowledgment of the stream: every second segment is acknowledged.
+        err = tcp_delayed_ack(tcp_c);
       }
     }
     if( (flags & TCP_PSH) == TCP_PSH) //if the peer device sends data to cIPS: cIPS processes them.
     {
-      if( tcp_c->remote_seqno == ntohl(tcphdr->seqno)) //Detects the case when the peer device sends a request, the cIPS replies and the reply is lost. Then cIPS waits for the peer to retransmit but does not process the request a second time.
-      {
       //Next_state : ESTABLISHED
       //to the application layer (if the app uses tcp_write() then tcp_write() will send the ACK).
       T_ASSERT(("%s#%d Register a callback with tcp_recv() on TCP controller 0x%lx\r\n",__func__, __LINE__, (u32_t)tcp_c), tcp_c->recv != NULL);
-      tcp_c->remote_ACK_counter++;
-      tcp_c->remote_seqno = ntohl(tcphdr->seqno) + app_data_length; //Sequence number to acknowledge
-      if(tcp_c->stream_sequence == 0)//Not a stream: the peer device sent a frame smaller a TCP segment.
-      {err = tcp_c->recv( tcp_c->callback_arg, tcp_c,(void*)((u8_t*)tcphdr + (u32_t)TCP_GET_HEADER_LENGTH(tcphdr)), app_data_length);}
-      else
-      { 
-        //If the streaming reception went OK, we should have tcp_c->stream_sequence * TCP_MSS == ntohl(tcphdr->seqno) (Note: app_data_length is not yet included in tcphdr->seqno).
-        //Otherwise, if frames are lost so tcp_c->stream_sequence is lower than expectected. As a result (tcp_c->stream_sequence * TCP_MSS) != ntohl(tcphdr->seqno) indicates lost of frames.
-        //TO DO : reorder a stream.
-        if( tcp_c->stream_sequence * tcp_c->local_mss == ntohl(tcphdr->seqno) - tcp_c->seqno_ori)
-        {
-          //CIPS completes the stream and sends it to the application.
-          tcp_memcpy(tcp_c->stream_position,(u8_t*)tcphdr + (u32_t)TCP_GET_HEADER_LENGTH(tcphdr),app_data_length);
-          //Note: if tcp_c->recv uses tcp_write then cIPS multiplexes the tcp_write with the received frame acknowlegment: the purpose of tcp_c->remote_ACK_counter is to signal a multiplexing situation to tcp_write.
-          err = tcp_c->recv( tcp_c->callback_arg, tcp_c,(void*)tcp_c->incoming_stream, tcp_c->stream_sequence * tcp_c->local_mss + app_data_length);
-        }
-        else
-        {
-           T_ERROR(("%s#%d: Streaming failed because of frame(s) lost\r\n",tcp_c->netif->name, ntohs(tcphdr->dest_port)));
-           err =tcp_store_error( ERR_STREAMING, tcp_c, __func__, __LINE__);
-        }
-        tcp_c->stream_position = tcp_c->incoming_stream;
-        tcp_c->stream_sequence = 0;
-      }
+      //Note: if tcp_c->recv uses tcp_write then cIPS multiplexes the tcp_write with the received frame acknowlegment: the purpose of tcp_c->remote_ACK_counter is to signal a multiplexing situation to tcp_write.
+      err = tcp_receive_segment(tcp_c, tcphdr, app_data_length);
       //Send ACK. (multiplex with the possibly tcp_write()).
-      if(tcp_c->seg_nb[TCP_SEG_UNSENT])
-      {
-        //look up unsent segment.
-        first_segment = segment_get_first( tcp_c, TCP_SEG_UNSENT);
-        //Send next "unsent" segment.
-        err = netif_send(tcp_c->netif,first_segment->frame, first_segment->len);
-        //Move the segment from the "unsent" list to the "unacked" one.
-        (void)segment_change_state( tcp_c, first_segment, TCP_SEG_UNACKED);
-       }
-      else
+      if(tcp_c->snd_queued)
       {
-        if( tcp_c->remote_ACK_counter){ //cIPS must reply with a ACK.
-          if( (!(tcp_c->options & tcp_delay_ack_reply))){ //if there has been no tcp_write() to send the ACK then send it.
-            err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_ACK, NULL, 0);
-            tcp_c->remote_ACK_counter = 0;
-          } else { //cIPS must reply with a ACK but the option tells to delay it.
-            tcp_c->remote_ACK_counter++; //delay the ACK. As a result tcp_write() or tcp_ack() must send the ACK.
-          }
-        }
+        //The segments that fit in the send window carry the ACK.
+        err = tcp_output(tcp_c);
       }
-      } //end of if( tcp_c->remote_seqno != ntohl(tcphdr->seqno))
+      //If no tcp_write() has carried the ACK, it is delayed: the next tcp_write(), the next segment or the time out sends it.
+      err = tcp_delayed_ack(tcp_c);
     }
-    if( (flags & TCP_FIN) == TCP_FIN)
+    if( ((flags & TCP_FIN) == TCP_FIN) && (((ntohl(tcphdr->seqno) + app_data_length) & TCP_SEQ_MASK) == tcp_c->remote_seqno) ) //The FIN follows the last byte received: a FIN after a hole waits for its retransmission.
     {
-      tcp_c->remote_seqno = ntohl(tcphdr->seqno) + 1; //Sequence number to acknowledge
+      tcp_c->remote_seqno = (tcp_c->remote_seqno + 1) & TCP_SEQ_MASK; //Sequence number to acknowledge
       // 1. rcv FIN
-      // 2. snd FIN|ACK
-      err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_FIN|TCP_ACK, NULL, 0);
-      tcp_c->local_seqno++; //Note: increment for TCP_SYN or TCP_FIN but not for TCP_ACK
+      // 2. snd FIN|ACK once the unsent bytes have left. Until then, an ACK acknowledges the FIN of the peer device.
+      err = tcp_queue_fin(tcp_c);
+      if( tcp_c->snd_nxt != tcp_c->local_seqno )
+      { err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_ACK, NULL, 0);}
       //3.Next_state : LAST_ACK (skip CLOSE_WAIT because other stacks expect FIN and ACK is the same frame)
       tcp_c->state = LAST_ACK;
     }
-    tcp_c->counter_of_500ms = 0; //Reset counter to mean that activity is going on.
+    tcp_c->activity = tcp_c->netif->tcp_clock; //Activity is going on: the inactivity check starts again (see tcp_check_timer()).
     break;
   case CLOSED: //represents no connection state at all.
     break;
@@ -378,21 +479,30 @@ static err_t tcp_process_network_events(TCP_T *tcp_c, u16_t flags, TCP_HEADER_T
     if( (flags & (TCP_SYN | TCP_ACK)) == ( TCP_SYN | TCP_ACK))
     {
       //1. rcv SYN|ACK
-      tcp_c->remote_seqno = ntohl(tcphdr->seqno) + 1 ;
-      tcp_c->remote_wnd = ntohs(tcphdr->windowsize);
+      tcp_c->remote_seqno = (ntohl(tcphdr->seqno) + 1) & TCP_SEQ_MASK;
+      tcp_c->remote_wnd = ntohs(tcphdr->windowsize); //The window of a SYN is never scaled. tcp_demultiplex() has parsed the options.
       //2. snd ACK
       err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_ACK, NULL, 0);
       //3.Remove the ACK from the array of waiting ACK
       (void) tcp_lookup_segment_by_acknowledge_no( tcp_c, ntohl(tcphdr->ackno));
+      if( tcp_c->rtt_timing ) { tcp_rtt_sample(tcp_c, U32_DIFF(tcp_c->netif->tcp_clock, tcp_c->rtt_start));}
+      tcp_c->rto_backoff = 0;
+      tcp_rto_restart(tcp_c);
       //4. Next_state : ESTABLISHED
       tcp_c->state = ESTABLISHED;
+      tcp_c->snd_una = tcp_c->local_seqno; //The send window starts after the SYN.
+      tcp_c->snd_nxt = tcp_c->local_seqno;
+      tcp_c->recover = tcp_c->local_seqno;
+      tcp_c->dupacks = 0;
+      tcp_c->fast_recovery = FALSE;
+      tcp_c->cc->init(tcp_c); //The MSS of the peer device is known.
     }
     else if( (flags & TCP_SYN) == TCP_SYN)
     {
       //1. rcv SYN
-      tcp_c->remote_seqno = ntohl(tcphdr->seqno) + 1 ;
-      tcp_c->remote_wnd = ntohs(tcphdr->windowsize);
-      tcp_c->local_seqno++; //Note: increment for TCP_SYN or TCP_FIN but not for TCP_ACK
+      tcp_c->remote_seqno = (ntohl(tcphdr->seqno) + 1) & TCP_SEQ_MASK;
+      tcp_c->remote_wnd = ntohs(tcphdr->windowsize); //The window of a SYN is never scaled. tcp_demultiplex() has parsed the options.
+      tcp_c->local_seqno = (tcp_c->local_seqno + 1) & TCP_SEQ_MASK; //Note: increment for TCP_SYN or TCP_FIN but not for TCP_ACK
       //2. snd ACK
       err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_ACK, NULL, 0);
       //3.Next_state : SYN_RCVD
@@ -404,23 +514,35 @@ static err_t tcp_process_network_events(TCP_T *tcp_c, u16_t flags, TCP_HEADER_T
     {
       //Next_state : ESTABLISHED
       tcp_c->state = ESTABLISHED;
+      tcp_c->snd_una = tcp_c->local_seqno; //The send window starts after the SYN.
+      tcp_c->snd_nxt = tcp_c->local_seqno;
+      tcp_c->recover = tcp_c->local_seqno;
+      tcp_c->dupacks = 0;
+      tcp_c->fast_recovery = FALSE;
+      tcp_c->cc->init(tcp_c); //The MSS of the peer device is known.
       //1. rcv ACK of SYN
     }
     break;
   case FIN_WAIT_1: //represents waiting for a connection termination request from the remote TCP, or an acknowledgment of the connection termination request previously sent.
     if( (flags & TCP_ACK) == TCP_ACK)
     {
-      //Next_state : FIN_WAIT_2
-      tcp_c->state = FIN_WAIT_2;
-      // 1. rcv ACK of FIN
+      //The data written before tcp_close() leave first, then the FIN.
+      err = tcp_receive_ack(tcp_c, flags, tcphdr, app_data_length);
+      err = tcp_output(tcp_c);
+      if( TCP_FIN_ACKED(tcp_c) )
+      {
+        //Next_state : FIN_WAIT_2
+        tcp_c->state = FIN_WAIT_2;
+        // 1. rcv ACK of FIN
+      }
     }
     if( (flags & TCP_FIN) == TCP_FIN)
     {
-      //Next_state : CLOSING
-      tcp_c->state = CLOSING;
+      //Next_state : TIME_WAIT if the FIN of cIPS is acknowledged, CLOSING otherwise
+      tcp_c->state = (tcp_c->state == FIN_WAIT_2)? TIME_WAIT : CLOSING;
       // 1. rcv FIN
       // 2. snd ACK
-      tcp_c->remote_seqno = ntohl(tcphdr->seqno) + 1 ;
+      tcp_c->remote_seqno = (ntohl(tcphdr->seqno) + 1) & TCP_SEQ_MASK;
       err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_ACK, NULL, 0);
     }
     break;
@@ -431,7 +553,7 @@ static err_t tcp_process_network_events(TCP_T *tcp_c, u16_t flags, TCP_HEADER_T
       tcp_c->state = TIME_WAIT;
       // 1. rcv FIN
       // 2. snd ACK
-      tcp_c->remote_seqno = ntohl(tcphdr->seqno) + 1 ;
+      tcp_c->remote_seqno = (ntohl(tcphdr->seqno) + 1) & TCP_SEQ_MASK;
       err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_ACK, NULL, 0);
     }
     break;
@@ -440,33 +562,44 @@ static err_t tcp_process_network_events(TCP_T *tcp_c, u16_t flags, TCP_HEADER_T
       //Next_state : LAST_ACK
       tcp_c->state = LAST_ACK;
       // 1. rcv FIN
-      // 2. snd ACK
-      err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_FIN, NULL, 0);
-      tcp_c->local_seqno++; //Note: increment for TCP_SYN or TCP_FIN but not for TCP_ACK
+      // 2. snd FIN
+      err = tcp_queue_fin(tcp_c);
     }
     break;
   case CLOSING: //represents waiting for a connection termination request acknowledgment from the remote TCP.
     if( (flags & TCP_ACK) == TCP_ACK)
     {
-      //Next_state : TIME_WAIT -> CLOSED
-      tcp_c->state = TIME_WAIT;
-      // 1. rcv ACK of FIN
+      err = tcp_receive_ack(tcp_c, flags, tcphdr, app_data_length);
+      err = tcp_output(tcp_c);
+      if( TCP_FIN_ACKED(tcp_c) )
+      {
+        //Next_state : TIME_WAIT -> CLOSED
+        tcp_c->state = TIME_WAIT;
+        // 1. rcv ACK of FIN
+      }
     }
     break;
   case LAST_ACK: //represents waiting for an acknowledgment of the connection termination request previously sent to the remote TCP (which includes an acknowledgment of its connection termination request).
     if( (flags & TCP_ACK) == TCP_ACK)
     {
-      //Next_state : CLOSED
-      tcp_c->state = CLOSED;
-      (void)tcp_remove(&(tcp_c->netif->tcp_active_cs), tcp_c);
-      if(tcp_c->closed) //Report to the application.
-      { err = tcp_c->closed( tcp_c->callback_arg, tcp_c, err );}
-      // 1. rcv ACK of FIN
+      //The data written before the FIN leave first.
+      err = tcp_receive_ack(tcp_c, flags, tcphdr, app_data_length);
+      err = tcp_output(tcp_c);
+      if( TCP_FIN_ACKED(tcp_c) )
+      {
+        //Next_state : CLOSED
+        tcp_c->state = CLOSED;
+        (void)tcp_remove(&(tcp_c->netif->tcp_active_cs), tcp_c);
+        if(tcp_c->closed) //Report to the application.
+        { err = tcp_c->closed( tcp_c->callback_arg, tcp_c, err );}
+        // 1. rcv ACK of FIN
+      }
     }
     break;
   default:
     break;
   }
+  tcp_state_timer(tcp_c);
   return err;
 }
 
@@ -474,7 +607,8 @@ static err_t tcp_process_network_events(TCP_T *tcp_c, u16_t flags, TCP_HEADER_T
  * Function name: tcp_process_timer_events
  * \return ERR_OK, ERR_RST
  * \param tcp_c : [in/out] tcp_c of interest.
- * \brief Check if this TCP controller has stayed too long in some "dead" states.
+ * \brief The state timer has expired (see tcp_state_timer()): this TCP
+ * controller has stayed too long in some "dead" states.
  * For example, the peer device negociates a close connection with cIPS.
  * In the middle of the negociation, the ethernet cable is disconnected.
  * CIPS detects that that kind of situation by checking whether a TCP 
@@ -483,23 +617,16 @@ static err_t tcp_process_network_events(TCP_T *tcp_c, u16_t flags, TCP_HEADER_T
 static err_t tcp_process_timer_events(TCP_T *tcp_c)
 {
   err_t err = ERR_OK;
-  //1. Check if this TCP controller has stayed too long in some "dead" states.
+  //1. This TCP controller has stayed too long in some "dead" states.
   switch(tcp_c->state)
   {
     case ESTABLISHED: //state hanled by tcp_check_connection()
     break;
-    case LISTEN:
-    case SYN_SENT:
-      tcp_c->counter_of_500ms = 0; //Reset counter to mean that activity is going on.
-    break;
     case FIN_WAIT_1:
     case CLOSING:
     case FIN_WAIT_2:
-      if ( ++(tcp_c->timer) == (u32_t)(TCP_FIN_WAIT_TIMEOUT / TCP_TIMER_PERIOD))
-      {
-        tcp_c->state = TIME_WAIT;
-        T_DEBUGF(TCP_DEBUG,("%s#%d: timeout in FIN-WAIT-x\r\n", tcp_c->netif->name, tcp_c->local_port));
-      }
+      tcp_c->state = TIME_WAIT;
+      T_DEBUGF(TCP_DEBUG,("%s#%d: timeout in FIN-WAIT-x\r\n", tcp_c->netif->name, tcp_c->local_port));
     break;
     case LAST_ACK: //In case "ACK of FIN" is not received (note: Labview does not send "ACK of FIN")
     case TIME_WAIT:
@@ -510,20 +637,83 @@ static err_t tcp_process_timer_events(TCP_T *tcp_c)
         T_DEBUGF(TCP_DEBUG,("%s#%d: timeout in TIME_WAIT: tcp_c removed\r\n", tcp_c->netif->name, tcp_c->local_port));
     break;
     case SYN_RCVD:
-      if ( ++(tcp_c->timer) == (u32_t)(TCP_SYN_RCVD_TIMEOUT / TCP_TIMER_PERIOD))
-      {
-        err = tcp_reset (tcp_c, &tcp_c->control_segment, __func__, __LINE__);
-        tcp_c->state = CLOSED;
-        (void)tcp_remove(&(tcp_c->netif->tcp_active_cs), tcp_c);
-        T_DEBUGF(TCP_DEBUG,("%s#%d: timeout in SYN_RCVD: tcp_c removed\r\n", tcp_c->netif->name, tcp_c->local_port));
-      }
+      err = tcp_reset (tcp_c, &tcp_c->control_segment, __func__, __LINE__);
+      tcp_c->state = CLOSED;
+      (void)tcp_remove(&(tcp_c->netif->tcp_active_cs), tcp_c);
+      T_DEBUGF(TCP_DEBUG,("%s#%d: timeout in SYN_RCVD: tcp_c removed\r\n", tcp_c->netif->name, tcp_c->local_port));
     break;
     default:
     break;
   }
+  //2. The next state may have its own time out (FIN_WAIT_x -> TIME_WAIT).
+  tcp_state_timer(tcp_c);
   return err;
 }
 
+/*!
+ * Function name: tcp_state_timer
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Arm the time out of the state of the controller after a 
+ * transition: TCP_SYN_RCVD_TIMEOUT in SYN_RCVD, TCP_FIN_WAIT_TIMEOUT from
+ * FIN_WAIT_1 to CLOSING, TCP_TIMER_PERIOD in LAST_ACK and TIME_WAIT. 
+ * While the data written before the FIN are unacknowledged, the 
+ * retransmission timer watches the peer device instead.
+ * The timer keeps running through the states sharing a time out. It is
+ * cancelled in the other states. tcp_process_timer_events() handles the
+ * expiry.
+ * *******************************************************************/
+static void tcp_state_timer(TCP_T* const tcp_c)
+{
+  TCP_TIMER_T* timer = &(tcp_c->timers[TCP_TIMER_STATE]);
+  u32_t timeout;
+
+  switch(tcp_c->state)
+  {
+    case SYN_RCVD:
+      timeout = TCP_SYN_RCVD_TIMEOUT;
+    break;
+    case FIN_WAIT_1:
+    case FIN_WAIT_2:
+    case CLOSING:
+      timeout = TCP_FIN_WAIT_TIMEOUT;
+    break;
+    case LAST_ACK: //In case "ACK of FIN" is not received.
+    case TIME_WAIT:
+      timeout = TCP_TIMER_PERIOD;
+    break;
+    default:
+      timeout = 0;
+    break;
+  }
+  if( tcp_c->snd_fin && (tcp_c->state != TIME_WAIT) && (((tcp_c->snd_una + 1) & TCP_SEQ_MASK) != tcp_c->local_seqno) )
+  { timeout = 0;} //More than the FIN is unacknowledged: the data still leave.
+  if( timeout == 0 )
+  { tcp_timer_cancel(tcp_c, TCP_TIMER_STATE);}
+  else if( (timer->pprev == NULL) || (timer->timeout != timeout) )
+  {
+    timer->timeout = timeout;
+    tcp_timer_arm(tcp_c, TCP_TIMER_STATE, tcp_c->netif->tcp_clock + timeout);
+  }
+}
+
+/*!
+ * Function name: tcp_check_timer
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Arm the inactivity check "nb_of_500ms x TCP_TIMER_PERIOD" ms 
+ * after the last activity of an active controller (see 
+ * tcp_check_connection()). The segments received only update "activity":
+ * the timer moves when it expires.
+ * *******************************************************************/
+static void tcp_check_timer(TCP_T* const tcp_c)
+{
+  if( tcp_c->nb_of_500ms && (tcp_c->list == &(tcp_c->netif->tcp_active_cs)) )
+  { tcp_timer_arm(tcp_c, TCP_TIMER_CHECK, tcp_c->activity + tcp_c->nb_of_500ms * TCP_TIMER_PERIOD);}
+  else
+  { tcp_timer_cancel(tcp_c, TCP_TIMER_CHECK);}
+}
+
 /*!
  * Function name: tcp_process_application_events
  * \return ERR_TCP_MEM or ERR_OK
@@ -551,9 +741,8 @@ static err_t tcp_process_application_events(TCP_T *tcp_c, const TCP_USER_COMMAND
     case ESTABLISHED: //a connection is open between the peer device and cIPS.
     if( command == TCP_USER_CLOSE)
     {
-      // 1. snd FIN (The RFC expects an ACK but Labview does not ACK so do not expect an ACK
-      err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_FIN, NULL, 0);
-      tcp_c->local_seqno++; //Note: increment for TCP_SYN or TCP_FIN but not for TCP_ACK
+      // 1. snd FIN once the unsent bytes have left (The RFC expects an ACK but Labview does not ACK so do not expect an ACK
+      err = tcp_queue_fin(tcp_c);
       //2. Next_state : FIN_WAIT_1
       tcp_c->state = FIN_WAIT_1;
     }
@@ -571,22 +760,42 @@ static err_t tcp_process_application_events(TCP_T *tcp_c, const TCP_USER_COMMAND
     if( command == TCP_USER_ACTIVE_OPEN)
     { //The application opens a TCP client to a remote server.
       TCP_SENDING_SEG_T* first_segment;
-      u32_t options;
-      //Build an MSS option.
-      options = tcp_format_max_segment_size_option(tcp_c->local_mss);
+      u8_t options[TCP_SYN_OPTIONS_LENGTH];
+      u8_t options_length;
+      //Build the MSS, window scale, SACK permitted and timestamps options. They apply only if the peer device sends them too.
+      tcp_c->peer_options = 0; //Nothing negotiated yet, even if cIPS reuses a controller.
+      tcp_c->remote_ACK_counter = 0;
+      tcp_c->options_length = 0;
+      tcp_c->ts_recent = 0;
+      tcp_c->snd_fin = FALSE;
+      tcp_c->snd_una = tcp_c->local_seqno; //The SYN takes "local_seqno".
+      tcp_c->snd_nxt = tcp_c->local_seqno;
+      options_length = tcp_format_syn_options(tcp_c->netif, tcp_c->local_mss, tcp_c->ts_recent, options, TCP_OFFERED_OPTIONS);
 
       (void)segment_init_resource(tcp_c); //If CIPS reuses a controller then empty the potential remaining frames in the segments.
       //Note: cIPS initialized the segements in tcp_connect().
       first_segment = segment_get_first( tcp_c, TCP_SEG_UNUSED);
-      err = tcp_send_control (tcp_c, first_segment, TCP_SYN, (u8_t *)&options, sizeof(options));
+      if( segment_borrow_frame(tcp_c, first_segment) )
+      { err = tcp_send_control (tcp_c, first_segment, TCP_SYN, options, options_length);}
+      else
+      {
+        T_ERROR(("ERR_SEG_MEM : no frame to hold the SYN. Increase TCP_FRAME_POOL\r\n"));
+        err = tcp_store_error( ERR_SEG_MEM, tcp_c, __func__, __LINE__);
+      }
       if( !err )
       {
-        tcp_c->local_seqno++; //Note: increment for TCP_SYN or TCP_FIN but not for TCP_ACK
-        (void)tcp_need_acknowledgment (first_segment, sizeof(options), tcp_c->local_seqno);
+        tcp_c->local_seqno = (tcp_c->local_seqno + 1) & TCP_SEQ_MASK; //Note: increment for TCP_SYN or TCP_FIN but not for TCP_ACK
+        tcp_c->snd_nxt = tcp_c->local_seqno; //The ACK of the SYN|ACK follows the SYN.
+        (void)tcp_need_acknowledgment (first_segment, options_length, tcp_c->local_seqno);
         //The application creates a TCP connection, cIPS sends the first signal TCP_SYN and 
         //keeps it in case cIPS needs to retransmit it. It keeps it by moving the segment 
         //from the "unused" list to the "unacked" one.
         (void)segment_change_state( tcp_c, first_segment, TCP_SEG_UNACKED);
+        tcp_rto_init(tcp_c);
+        tcp_c->rtt_timing = TRUE; //The SYN|ACK gives the first round trip time.
+        tcp_c->rtt_seq = tcp_c->local_seqno;
+        tcp_c->rtt_start = tcp_c->netif->tcp_clock;
+        tcp_rto_restart(tcp_c);
         // 1. Next_state : SYN_SENT
         tcp_c->state = SYN_SENT;
         (void)tcp_register(&(tcp_c->netif->tcp_active_cs), tcp_c);
@@ -596,7 +805,7 @@ static err_t tcp_process_application_events(TCP_T *tcp_c, const TCP_USER_COMMAND
   case LISTEN: //CIPS has a TCP server.
     if( command == TCP_USER_SEND) // The peer device is a client and requests a new connection to the server.
     {
-      err = tcp_create_child(tcp_c , (u8_t*)arg);
+      err = tcp_listen_syn(tcp_c , (const u8_t*)arg);
     }
     if( command == TCP_USER_CLOSE) // The application decides to close its TCP server
     {
@@ -621,8 +830,7 @@ static err_t tcp_process_application_events(TCP_T *tcp_c, const TCP_USER_COMMAND
     if( command == TCP_USER_CLOSE) //The application server is opening a connection with a peer device client but decides to close it.
     {
       // 1. snd FIN (The RFC expect an ACK but Labview does not ACK so do not expect an ACK
-      err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_FIN, NULL, 0);
-      tcp_c->local_seqno++; //Note: increment for TCP_SYN or TCP_FIN but not for TCP_ACK
+      err = tcp_queue_fin(tcp_c);
       //2. Next_state : FIN_WAIT_1
       tcp_c->state = FIN_WAIT_1;
     }
@@ -631,8 +839,7 @@ static err_t tcp_process_application_events(TCP_T *tcp_c, const TCP_USER_COMMAND
     if( command == TCP_USER_CLOSE) //The CLOSE_WAIT state expects the TCP_USER_CLOSE message (see RFC793).
     {
       // 1. snd FIN (The RFC expect an ACK but Labview does not ACK so do not expect an ACK
-      err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_FIN, NULL, 0);
-      tcp_c->local_seqno++; //Note: increment for TCP_SYN or TCP_FIN but not for TCP_ACK
+      err = tcp_queue_fin(tcp_c);
       // 2. Next_state : LAST_ACK -> CLOSED
       tcp_c->state = LAST_ACK;
     }
@@ -656,97 +863,85 @@ static err_t tcp_process_application_events(TCP_T *tcp_c, const TCP_USER_COMMAND
     break;
   }
 
+  tcp_state_timer(tcp_c);
   return err;
 }
 
 
 /*!
  * Function name: tcp_write
- * \return ERR_OK, 
- * ERR_SEG_MEM if the application sends too much data in one call or 
- * ERR_APP if the application uses tcp_write() when it is not connected.
+ * \return the number of bytes queued: "app_len", or less if the send ring
+ * is full (see tcp_sent()).
  * \param tcp_c: [in/out]connection of interest.
  * \param app_data: [in]Application data in "unsigned char".
  * \param app_len: [in]Application data length in bytes.
+ * \param err: [out] ERR_OK, 
+ * ERR_CUR_SEG_MEM if the send ring is full: no byte is queued,
+ * ERR_SEG_MEM if no send ring is left in TCP_SND_RING_POOL,
+ * ERR_APP if the application uses tcp_write() when it is not connected.
  * \brief Write some data to a TCP connection.
- * \note send the first elt (or multiplex with an ACK) and then put 
- * the other segments in the unsent queue. The ACK of the first 
- * segment is going to trigger the sending of the second and so on.
+ * \note The data are copied into the send ring of the controller (a byte
+ * stream) and the segments that fit in the send window are cut from it 
+ * when they leave (see tcp_output()). The ACKs of the peer device slide 
+ * the window and release the others. Small writes that wait share full 
+ * segments. If the window of the peer device is closed, they wait too.
  * *******************************************************************/
-err_t tcp_write(TCP_T *tcp_c, const void *app_data, u32_t app_len)
+u32_t tcp_write(TCP_T *tcp_c, const void *app_data, u32_t app_len, err_t* err)
 {
-  err_t err = ERR_OK;
+  u32_t queued = 0;
 
   T_ASSERT(("%s#%d TCP socket is not created \n", __func__, __LINE__), tcp_c != NULL);
+  *err = ERR_OK;
 
   if( tcp_c->state == ESTABLISHED ) {
      //The application sends a message to a peer device. The peer device might not 
-     //have enough memory to receive the message.
-    if(((u32_t)tcp_c->remote_wnd) >= tcp_c->remote_mss){
-      u32_t intermediate_length;
-      u32_t segment_nb;
-      //1. The application sends a message that can take several TCP segments. CIPS calculates the amount of segments it needs.
-      segment_nb = (tcp_c->remote_mss)? app_len / tcp_c->remote_mss:0;
-      if( (segment_nb * tcp_c->remote_mss) < app_len ) { segment_nb++;}//round up
-
-      //2. Once cIPS has calculated the amount of segments, it checks whether it has these segments available.
-      if( segment_nb > tcp_c->seg_nb[TCP_SEG_UNUSED] ){
-        //Not enough space to store the data in multiple frames. If it was predictable, increase MAX_TCP_SEG.
-        T_ERROR(("ERR_SEG_MEM : not enough space to hold the message. tcp_write(%ld bytes). Increase MAX_TCP_SEG\r\n", app_len));
-        err =tcp_store_error( ERR_SEG_MEM, tcp_c, __func__, __LINE__);
+     //have enough memory to receive the message: the data wait in the send ring (see tcp_output()).
+    struct NETIF_S* net_adapter = tcp_c->netif;
+    u32_t index;
+    u32_t first_part;
+
+    //1. Take what fits in the free space of the send ring: the bytes in flight and the unsent ones hold the rest.
+    queued = (app_len < TCP_SND_SPACE(tcp_c))? app_len : TCP_SND_SPACE(tcp_c);
+    if( (queued == 0) && (app_len != 0) ){
+      //The ring is full. The "sent" callback tells when the ACKs of the peer device free some room.
+      *err = tcp_store_error( ERR_CUR_SEG_MEM, tcp_c, __func__, __LINE__);
+    }
+    else if( (tcp_c->snd_ring == NULL) && (queued != 0) ){
+      //2. Borrow a send ring: nothing is unacknowledged so the ring starts at "snd_una".
+      if( net_adapter->tcp_snd_ring_free != NULL ){
+        tcp_c->snd_ring = net_adapter->tcp_snd_ring_free;
+        net_adapter->tcp_snd_ring_free = tcp_c->snd_ring->next;
+        tcp_c->snd_ring_base = tcp_c->snd_una;
+      }else{
+        //The other connections hold the rings of the adapter. They give them back as the peer devices acknowledge their data.
+        T_ERROR(("ERR_SEG_MEM : no send ring to hold the message. tcp_write(%ld bytes). Increase TCP_SND_RING_POOL\r\n", app_len));
+        *err = tcp_store_error( ERR_SEG_MEM, tcp_c, __func__, __LINE__);
+        queued = 0;
       }
+    }
 
-      intermediate_length = (app_len < tcp_c->remote_mss)? app_len: tcp_c->remote_mss;
-
-      T_DEBUGF(TCP_DEBUG, ("%s#%d: %s %ld segment(s) for a total length of %ld bytes.\r\n",tcp_c->netif->name,tcp_c->local_port, __func__,segment_nb,app_len));
-
-      //3. enqueue data into segments
-      if( (!err) && (intermediate_length!=0)) {
-        u8_t control_bits ;
-        TCP_SENDING_SEG_T* unused_seg;
-        u32_t i;
-        //3.1 Fill in each segment and put it in the unsent queue.
-        for( i = 0; i < segment_nb; i++) {
-          if(!tcp_c->seg_nb[TCP_SEG_UNACKED]){
-            unused_seg = segment_get_first( tcp_c, TCP_SEG_UNUSED);
-          }else{
-            unused_seg = segment_get_first_unused_after_unacked( tcp_c, TCP_SEG_UNUSED);
-            if(!unused_seg){
-              //cIPS claimed that there were enough UNUSED segments. Unfortunatly
-              //there are enough but not after the last UNACKED so it put it where it can.
-              //Consequently, cIPS cannot maintain the order of the segment. It will pass only if there is no retransmission.
-              unused_seg = segment_get_first( tcp_c, TCP_SEG_UNUSED);
-            }
-          }
-          control_bits = (i == segment_nb-1)?TCP_PSH:0; //Set TCP_PSH on the last segment.
-          control_bits |= TCP_ACK; //A stream returns an ACK for each sub-segment.
-          err = tcp_build_data_ethernet_frame (tcp_c, unused_seg, (u8_t*)app_data + i*tcp_c->remote_mss, intermediate_length, control_bits);
-          tcp_c->local_seqno += intermediate_length;
-
-          (void)tcp_need_acknowledgment (unused_seg, intermediate_length, tcp_c->local_seqno);
-
-          if( i == 0 ) {//Send the frame directly
-            err = netif_send(tcp_c->netif,unused_seg->frame, ETH_IP_TCP_HEADER_SIZE + intermediate_length);
-            (void)segment_change_state( tcp_c, unused_seg, TCP_SEG_UNACKED);
-            tcp_c->remote_ACK_counter = 0; //The app uses tcp_write. Tcp_write multiplexes PUSH and ACK. As tcp_write sends an ACK, cIPS does not need to send an individual ACK frame.
-          } else {
-            (void)segment_change_state( tcp_c, unused_seg, TCP_SEG_UNSENT);
-          }
-
-          unused_seg->retransmission_timer_slice = 0; //Reset retransmission timer for this segment.
-          //next "intermediate_length".
-          intermediate_length = ((i+1) != segment_nb-1)?tcp_c->remote_mss:(app_len - (segment_nb-1)*tcp_c->remote_mss);
-        }
-      }
-    } else { //The window of the peer device is too small.
-      err =tcp_store_error( ERR_PEER_WINDOW, tcp_c, __func__, __LINE__);
+    T_DEBUGF(TCP_DEBUG, ("%s#%d: %s %ld of %ld bytes, %ld bytes unsent.\r\n",tcp_c->netif->name,tcp_c->local_port, __func__,queued,app_len,tcp_c->snd_queued));
+
+    //3. Append the data to the ring, after the unsent bytes (in two parts if the ring wraps).
+    if( queued != 0 ) {
+      index = TCP_SND_RING_INDEX(tcp_c, tcp_c->snd_nxt + tcp_c->snd_queued);
+      first_part = (queued < TCP_SND_BUF - index)? queued : TCP_SND_BUF - index;
+      tcp_memcpy(tcp_c->snd_ring->data + index, (const u8_t*)app_data, first_part);
+      if( first_part < queued )
+      { tcp_memcpy(tcp_c->snd_ring->data, (const u8_t*)app_data + first_part, queued - first_part);}
+      tcp_c->snd_queued += queued;
+      tcp_c->local_seqno = (tcp_c->local_seqno + queued) & TCP_SEQ_MASK;
+
+      //4. Send the segments that fit in the send window. The data are queued even if the device driver fails: they are retransmitted.
+      //Tcp_write multiplexes PUSH and ACK. As tcp_write sends an ACK, cIPS does not need to send an individual ACK frame.
+      *err = tcp_output(tcp_c);
     }
   } else{ //The application uses tcp_write() when it is not connected
     T_DEBUGF(TCP_DEBUG, ("%s#%d: %s:The application uses tcp_write() when it is not connected\r\n",tcp_c->netif->name,tcp_c->local_port, __func__));
-    err = ERR_APP;
+    *err = ERR_APP;
   }
 
-  return err;
+  return queued;
 }
 
 /*!
@@ -905,6 +1100,7 @@ err_t tcp_connect(TCP_T *tcp_c, u32_t ipaddr, u16_t port, err_t (* connect)(void
     } else { //The destination MAC address is unknown, cIPS sends an ARP request to resolve it.
       u32_t framelen;
       framelen =  eth_build_frame( dest_mac_addr, tcp_c->netif->mac_address, dest_ip_or_gateway, tcp_c->local_ip, tcp_c->control_segment.frame, ETH_ARP_REQUEST);
+      tcp_c->control_segment.header_only = FALSE; //The ARP request overwrites the TCP header.
       err = netif_send(tcp_c->netif,tcp_c->control_segment.frame, framelen);
       if(!err){
         err = tcp_store_error( ERR_MAC_ADDR_UNKNOWN, tcp_c, __func__, __LINE__);
@@ -920,138 +1116,209 @@ err_t tcp_connect(TCP_T *tcp_c, u32_t ipaddr, u16_t port, err_t (* connect)(void
  * \return ERR_OK, ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER, ERR_RST.
  * \param net_adapter : [in/out] adapter of interest.
  * \brief 
- * Called every 500 ms and implements the retransmission and timeout
- * timer. It also increments various timers such as the inactivity 
- * timer in each controller.
+ * Called every 500 ms and implements the timeout timers.
  * \note The timer could be called every 500ms. The important point is that it must be lower than TCP_RETRANSMISSION_TIMEOUT.
- * 1. Steps through all of the active TCP controllers.
- * 1.1 check the unack list per tcp_c.
- * 1.2 re-send or reset the connection.
- * 2. Check if this TCP controller has stayed too long in some "dead" states.
- * 3. Check if the application should check the connection.
+ * 1. Advance the TCP clock unless tcp_fast_timer() drives it.
+ * 2. Fire the timers of the controllers that have expired (see tcp_timer_wheel()).
  * *******************************************************************/
 err_t tcp_timer(struct NETIF_S* net_adapter)
 {
-  TCP_SENDING_SEG_T* unacked_seg;
-  TCP_T *tcp_c;
+  err_t err;
+
+  //1. Advance the TCP clock.
+  if( !net_adapter->tcp_fine_clock ) //Otherwise tcp_fast_timer() drives the clock.
+  { net_adapter->tcp_clock += TCP_TIMER_PERIOD;}
+
+  //2. Retransmit, send the delayed ACKs, close the connections stuck in a "dead" state and check the inactive ones.
+  err = tcp_timer_wheel(net_adapter);
+  return err;
+}
+
+/*!
+ * Function name: tcp_fast_timer
+ * \return ERR_OK, ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER, ERR_RST.
+ * \param net_adapter : [in/out] adapter of interest.
+ * \param now : [in] Current time of the application in milliseconds (it may roll over).
+ * \brief Drive the TCP clock with the application clock and fire the 
+ * timers that have expired. The resolution of the timers becomes the 
+ * resolution of "now" instead of TCP_TIMER_PERIOD.
+ * *******************************************************************/
+err_t tcp_fast_timer(struct NETIF_S* net_adapter, u32_t now)
+{
   err_t err = ERR_OK;
 
-  //1. Steps through all of the active TCP controllers.
-  tcp_c = net_adapter->tcp_active_cs;
-  while (tcp_c != NULL) //tcp_c_list
-  {
-    //When cIPS sends a TCP frame to the peer device , the peer device  must acknowledge it.
-    //If the peer device does not acknowledge the frame fast enough, it means 
-    //that the frame is lost. Then cIPS retransmits. If the peer device does 
-    //not acknowledge after a few retransmissions then the peer device connection 
-    //is down and cIPS confirms it by sending a reset.
-
-    //1.1 check the unack list per tcp_c
-    //Retrieve the first UNACKED segment.
-    if (tcp_c->seg_nb[TCP_SEG_UNACKED]) //If there is a frame to retransmit.
-    { //retransmit only one at a time
-      unacked_seg = segment_get_first( tcp_c, TCP_SEG_UNACKED);
-      if( unacked_seg->retransmission_timer_slice == 0 )
-      { ++(unacked_seg->retransmission_timer_slice);} //skip the potential action. this is to prevent the case when tcp_timer() is called just after sending the msg. We have to wait TCP_TIMER_PERIOD s at least.
-      else
+  net_adapter->tcp_fine_clock = TRUE;
+  if( now != net_adapter->tcp_clock )
+  {
+    net_adapter->tcp_clock = now;
+    err = tcp_timer_wheel(net_adapter);
+  }
+  return err;
+}
+
+/*!
+ * Function name: tcp_timer_wheel
+ * \return ERR_OK, ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER, ERR_RST.
+ * \param net_adapter : [in/out] adapter of interest.
+ * \brief Fire the timers that have expired at "tcp_clock". The wheel is
+ * visited from the slot of its last visit to the slot of "tcp_clock", 
+ * each slot at most once: the cost depends on the elapsed time and on the
+ * timers of these slots, not on the number of connections. A timer that
+ * goes round the wheel stays in its slot until it expires.
+ * *******************************************************************/
+static err_t tcp_timer_wheel(struct NETIF_S* net_adapter)
+{
+  u32_t now = net_adapter->tcp_clock;
+  u32_t tick = TCP_WHEEL_TICK(net_adapter->tcp_wheel_time);
+  u32_t last_tick = TCP_WHEEL_TICK(now);
+  TCP_TIMER_T* expired;
+  TCP_TIMER_T* timer;
+  err_t err = ERR_OK;
+  err_t timer_err;
+
+  if( last_tick - tick >= TCP_TIMER_WHEEL_SIZE ) //The clock has gone round the wheel: every slot is visited once.
+  { tick = last_tick - (TCP_TIMER_WHEEL_SIZE - 1);}
+  net_adapter->tcp_wheel_time = now;
+  do
+  {
+    //1. Take the timers of the slot: the events below can arm or cancel any timer meanwhile.
+    expired = net_adapter->tcp_wheel[TCP_WHEEL_SLOT(tick)];
+    net_adapter->tcp_wheel[TCP_WHEEL_SLOT(tick)] = NULL;
+    if( expired != NULL ) { expired->pprev = &expired;}
+    //2. Fire the expired timers, put back the others.
+    while( expired != NULL )
+    {
+      timer = expired;
+      tcp_timer_cancel(timer->tcp_c, timer->kind);
+      if( !U32_BEFORE(now, timer->expiry) )
       {
-        ++(unacked_seg->retransmission_timer_slice);
-        if( unacked_seg->retransmission_timer_slice >= tcp_c->retransmission_time_out)
-        {
-          //Send a TCP_RST and Close the TCP controller.
-          err = tcp_reset(tcp_c, &tcp_c->control_segment, __func__, __LINE__);
-        }
-        else  //CIPS retransmits the unackwoledged frame or transmits the potential next segment.
-        {
-          if (tcp_c->seg_nb[TCP_SEG_UNSENT]==0)
-          { //There is only one segment. In that condition, the peer device must send an ACK.
-            //It did not so cIPS retransmits.
-            err = netif_send(tcp_c->netif, unacked_seg->frame, unacked_seg->len);
-          }else{
-            if(unacked_seg->retransmission_timer_slice >= tcp_c->retransmission_time_out-1)
-            { //There are several segments but the peer device has not acknowleged for quite 
-              //a long time (tcp_c->retransmission_time_out-1) so cIPS retransmits.
-              err = netif_send(tcp_c->netif, unacked_seg->frame, unacked_seg->len);
-            }else{
-              //When the application sends data larger than one segment (tcp_write()), cIPS splits
-              //the data into several segments (or frames). It sends the first frame and waits for 
-              //the ACK in order to send the next frame segment and so on. However, TCP does not 
-              //necessary acknowledge every frame by an ACK. For example, HTTP on TCP does not 
-              //acknowledge two consecutive frames with two ACKs but with only one ACK every two frames.
-              //If cIPS sends one frame and the peer device acknowledges after two frames only and cIPS waits 
-              //for an ACK, then the situation is stuck. tcp_timer() solves the situation.
-              //If cIPS has some unacknowledged frames and unsent frames then it sends the next unsent
-              //frame and expects the peer device to acknowledge. If the peer does not acknowledge for a while
-              //then cIPS retransmits.
-              TCP_SENDING_SEG_T* unsent_seg;
-              unsent_seg = segment_get_first( tcp_c, TCP_SEG_UNSENT);
-              err = netif_send(tcp_c->netif, unsent_seg->frame, unsent_seg->len);
-              //Move the segment from the "unsent" list to the "unacked" one.
-              (void)segment_change_state( tcp_c, unsent_seg, TCP_SEG_UNACKED);
-            }
-          }
-        }
+        timer_err = tcp_timer_fire(timer->tcp_c, timer->kind);
+        if( timer_err ) { err = timer_err;}
       }
+      else
+      { tcp_timer_arm(timer->tcp_c, timer->kind, timer->expiry);}
     }
+  } while( tick++ != last_tick );
+  return err;
+}
 
-    //If a TCP connection connects a peer device to cIPS and if there is no traffic between the two.
-    //Either the connection is broken or it is the normal state of operation between the peer device and the application not to exchange messages.
-    //cIPS cannot make the difference between the two situations but the application can.
-    //So cIPS counts the inactivity time and notifies the application (through the periodic_connection_check() callback.
-    //The application can decide to close the connection, to test the connection or to do nothing.
-    if(tcp_c->state != LISTEN){ //The LISTEN state is excluded because it represents a TCP server. TCP server waits for clients to connect. Once a client is connected or no other client connects, there is no traffic but it is normal.
-      if(tcp_c->state != CLOSED){
-        //2. Check if this TCP controller has stayed too long in a "no traffic" state.
-         err = tcp_process_timer_events( tcp_c );
+/*!
+ * Function name: tcp_timer_fire
+ * \return ERR_OK, ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER, ERR_RST.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param kind : [in] Timer that has expired.
+ * \brief Process the expiry of a timer of the controller.
+ * *******************************************************************/
+static err_t tcp_timer_fire(TCP_T* const tcp_c, const tcp_timer_kind kind)
+{
+  err_t err = ERR_OK;
 
-        //3. Check if we should check the connection.
-        ++tcp_c->counter_of_500ms;
-        if (tcp_c->counter_of_500ms == tcp_c->nb_of_500ms)
-        {
-          if(tcp_c->periodic_connection_check) //The application checks the connection.
-          {err = tcp_c->periodic_connection_check( tcp_c->callback_arg, tcp_c );}
+  switch(kind)
+  {
+    case TCP_TIMER_RTO:
+      //When cIPS sends a TCP frame to the peer device , the peer device  must acknowledge it.
+      //If the peer device does not acknowledge the frame fast enough, it means 
+      //that the frame is lost. Then cIPS retransmits. If the peer device does 
+      //not acknowledge after a few retransmissions then the peer device connection 
+      //is down and cIPS confirms it by sending a reset.
+      err = tcp_retransmission_timer(tcp_c);
+    break;
+    case TCP_TIMER_DELAYED_ACK:
+      err = tcp_delayed_ack(tcp_c);
+    break;
+    case TCP_TIMER_STATE:
+      err = tcp_process_timer_events(tcp_c);
+    break;
+    case TCP_TIMER_CHECK:
+      //If a TCP connection connects a peer device to cIPS and if there is no traffic between the two.
+      //Either the connection is broken or it is the normal state of operation between the peer device and the application not to exchange messages.
+      //cIPS cannot make the difference between the two situations but the application can.
+      //So cIPS counts the inactivity time and notifies the application (through the periodic_connection_check() callback.
+      //The application can decide to close the connection, to test the connection or to do nothing.
+      if( (tcp_c->state == LISTEN) || (tcp_c->state == SYN_SENT) ) //No connection yet: no inactivity.
+      { tcp_c->activity = tcp_c->netif->tcp_clock;}
+      else if( !U32_BEFORE(tcp_c->netif->tcp_clock, tcp_c->activity + tcp_c->nb_of_500ms * TCP_TIMER_PERIOD) )
+      {
+        tcp_c->activity = tcp_c->netif->tcp_clock;
+        if(tcp_c->periodic_connection_check) //The application checks the connection.
+        {err = tcp_c->periodic_connection_check( tcp_c->callback_arg, tcp_c );}
 //NOTE: The library does not implement the TCP KEEP ALIVE property. But, if you need it,
 //send a tcp message with no data in the "tcp_c->tcp_check_connection" callback.
 //example: {err = tcp_write(tcp_c, NULL, 0);} //!< send an empty message.
-          tcp_c->counter_of_500ms = 0;
-        }
-      } else if((tcp_c->connect) && (!err)){
-        //The controller is a TCP client. It is in the CLOSED state but the application has called tcp_connect()
-        //in order to reach a peer server. Reaching the peer server necessitates two steps:
-        //1. to resolve the (IP,MAC) link. This step can take several ARP calls. It can last for ever if the server is not there.
-        //2. to exchange the TCP connect message.
-        //Potentially several times #1 and then #2 means that tcp_connect() might be call several times.
-        //If one call is not enough, the purpose of the callback is to call again tcp_connect().
-        //It is a callback rather than an internal call so that the application can decide what to do if
-        //the server does not exist (keep trying or time-out). In addition, in the callback, the application
-        //can space out the tcp_connect() to more than the tcp_timer() period.
-        //Note 1: if the server disconnect the client, then the client goes to CLOSED state.
-        //If the tcp_c->connect callback is defined then thc_timer() calls it and the client re-connects.
-        //Note 2: the content of the callback can be:
-        //err = tcp_connect(tcp_c, tcp_c->remote_ip, tcp_c->remote_port, tcp_c->connect);
-        err = tcp_c->connect(tcp_c->callback_arg, tcp_c);
       }
-    }
-
-  tcp_c = tcp_c->next;
+      tcp_check_timer(tcp_c); //Next check, unless the callback has closed the connection.
+    break;
+    default:
+    break;
   }
   return err;
 }
 
- /*!
+/*!
+ * Function name: tcp_timer_arm
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param kind : [in] Timer to arm.
+ * \param expiry : [in] Time (ms) when the timer expires.
+ * \brief Link the timer in the slot of the wheel holding "expiry", in 
+ * O(1). An armed timer moves. A timer that has already expired goes to
+ * the slot of the last visit: the next visit fires it.
+ * *******************************************************************/
+static void tcp_timer_arm(TCP_T* const tcp_c, const tcp_timer_kind kind, const u32_t expiry)
+{
+  TCP_TIMER_T* timer = &(tcp_c->timers[kind]);
+  struct NETIF_S* net_adapter = tcp_c->netif;
+  TCP_TIMER_T** slot;
+
+  tcp_timer_cancel(tcp_c, kind);
+  timer->expiry = expiry;
+  if( U32_BEFORE(net_adapter->tcp_wheel_time, expiry) )
+  { slot = &(net_adapter->tcp_wheel[TCP_WHEEL_SLOT(TCP_WHEEL_TICK(expiry))]);}
+  else
+  { slot = &(net_adapter->tcp_wheel[TCP_WHEEL_SLOT(TCP_WHEEL_TICK(net_adapter->tcp_wheel_time))]);}
+  timer->next = *slot;
+  if( *slot != NULL ) { (*slot)->pprev = &(timer->next);}
+  timer->pprev = slot;
+  *slot = timer;
+}
+
+/*!
+ * Function name: tcp_timer_cancel
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param kind : [in] Timer to cancel.
+ * \brief Unlink the timer from its slot in O(1). Nothing happens if it
+ * is not armed.
+ * *******************************************************************/
+static void tcp_timer_cancel(TCP_T* const tcp_c, const tcp_timer_kind kind)
+{
+  TCP_TIMER_T* timer = &(tcp_c->timers[kind]);
+
+  if( timer->pprev != NULL )
+  {
+    *(timer->pprev) = timer->next;
+    if( timer->next != NULL ) { timer->next->pprev = timer->pprev;}
+    timer->next = NULL;
+    timer->pprev = NULL;
+  }
+}
+
+/*!
  * Function name: tcp_options
  * \return ERR_OK.
  * \param tcp_c : [in/out] tcp_c of interest.
  * \param options : [in/out] controller option. See TCP_OPTIONS_T for detail.
  * \brief The application calls tcp_options() in order to configure a 
- * connection. One possible configuration is to delay the incoming
- * frames acknowledgment. If the application sets the ACK dalay then
- * the application should look at tcp_ack().
+ * connection. tcp_nagle holds the small writes while data are in flight 
+ * (RFC 896): they wait in the send ring and leave as one segment with the
+ * next ACK of the peer device or once they fill a segment. It saves frames when the 
+ * application writes a few bytes at a time, but it delays a write that
+ * follows another one when the peer device delays its ACKs.
  * *******************************************************************/
 err_t tcp_options(TCP_T *tcp_c, TCP_OPTIONS_T options)
 {
   err_t err = ERR_OK;
-  if( tcp_c && (options & tcp_delay_ack_reply)){
+  if( tcp_c ){
     tcp_c->options = options;
   }
   return err;
@@ -1063,14 +1330,13 @@ err_t tcp_options(TCP_T *tcp_c, TCP_OPTIONS_T options)
  * \param tcp_c : [in/out] tcp_c of interest.
  * \brief The TCP protocol is connection oriented. The protocol 
  * acknowledges each incoming frame.
- * cIPS acknowledges an incoming frame as soon as the application completes 
- * its processing. (FYI:in addition, if the application uses tcp_write() 
- * then cIPS multiplexes the acknowledgment with the outgoing frame). 
- * The consequence is that when the peer device receives the acknowledgment,
- * it can send its next frame. The result is very fast. The peer device receives 
- * the acknowledgment much sooner than the 200 milliseconds allowed for an ACK.
- * But in one situation, the fast speed can increase the traffic network.
- * The situation is: cIPS initiates a dialogue with the peer device
+ * cIPS delays the acknowledgment of an incoming frame (RFC 1122): if 
+ * the application uses tcp_write() then cIPS multiplexes the acknowledgment
+ * with the outgoing frame. Otherwise cIPS acknowledges every second segment
+ * received, or once TCP_DELAYED_ACK_TIMEOUT has expired (see tcp_timer() and
+ * tcp_fast_timer()). A segment out of order or filling a hole is 
+ * acknowledged at once. The delay matters in the following situation:
+ * cIPS initiates a dialogue with the peer device
  * cIPS periodically sends data to the peer device, the period is less than 
  * 200 milliseconds and the peer device replies with some data.
  *
@@ -1085,20 +1351,15 @@ err_t tcp_options(TCP_T *tcp_c, TCP_OPTIONS_T options)
  *       ...
  * cIPS can multiplex the two frames ACK(frame(M)) and PSH(frame(N+1)) 
  * into one frame ACK(frame(M)),PSH(frame(N+1)). To do so, cIPS delays 
- * the ACK(frame(M)). But as cIPS does not know that the application 
- * would send a frame after 1ms but before 200ms, the cIPS default 
- * behavior is to acknowledge immediately unless the application
- * configures the connection in order not to do it.
- * The application configures the delay by calling 
- * tcp_options(tcp_delay_ack_reply). Then tcp_write() would acknowledge 
- * the previous incoming frame or the application can force it by 
+ * the ACK(frame(M)) up to TCP_DELAYED_ACK_TIMEOUT. If the application 
+ * knows that it will not write soon, it can send the ACK at once by 
  * calling tcp_ack().
  * *******************************************************************/
 err_t tcp_ack(TCP_T *tcp_c)
 {
   err_t err = ERR_OK;
 
-  if( tcp_c && (tcp_c->remote_ACK_counter) && (tcp_c->options & tcp_delay_ack_reply)){
+  if( tcp_c && (tcp_c->remote_ACK_counter) ){
     err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_ACK, NULL, 0);
     tcp_c->remote_ACK_counter = 0;
   }
@@ -1137,8 +1398,10 @@ static TCP_T* tcp_alloc( struct NETIF_S* net_adapter, const u32_t type)
   {
     tcp_c->local_ip = 0;
     tcp_c->remote_ip = 0;
+    tcp_c->pseudo_sum = 0;
     tcp_c->netif = net_adapter;
     tcp_c->remote_ACK_counter = 0;
+    tcp_c->ack_deadline = 0;
     tcp_c->next = NULL; //!< will be updated by tcp_register().
     tcp_c->state = CLOSED;
     tcp_c->callback_arg = NULL;
@@ -1147,23 +1410,37 @@ static TCP_T* tcp_alloc( struct NETIF_S* net_adapter, const u32_t type)
     tcp_c->remote_seqno = 0;
     tcp_c->remote_wnd = TCP_MTU;
     tcp_c->remote_mss = TCP_MTU;
-    tcp_c->timer = 0;
-    tcp_c->counter_of_500ms = 0;
+    tcp_c->activity = net_adapter->tcp_clock;
     tcp_c->nb_of_500ms = DEFAULT_500ms_NB;
-    tcp_c->local_mss = (TCP_MSS < TCP_MTU)?TCP_MSS:TCP_MTU;
-    tcp_c->local_wnd = (TCP_WND < TCP_MTU)?TCP_WND:TCP_MTU; //Sould be (TCP_MTU+4) because WND starts at the ACK long.
-    tcp_c->retransmission_time_out = TCP_RETRANSMISSION_TIMEOUT / TCP_TIMER_PERIOD; //The retransmission time out is a counter representing time. It is the maximum amount of fraction of TCP_TIMER_PERIOD to reach TCP_RETRANSMISSION_TIMEOUT.
+    tcp_c->local_mss = TCP_LOCAL_MSS;
+    tcp_c->local_wnd = TCP_WND; //The application empties "rcv_ring" up to "remote_seqno" at once: the whole ring is free.
+    tcp_c->snd_wnd_scale = 0;
+    tcp_c->rcv_wnd_scale = 0;
+    tcp_c->peer_options = 0;
+    tcp_c->options_length = 0;
+    tcp_c->ts_recent = 0;
+    tcp_c->sack_recent = 0;
+    tcp_rto_init(tcp_c);
     tcp_c->local_seqno = ((u32_t)tcp_c) & 0xFF; //(added by JMD) ISS: ramdom number between 0 an 0xFF.
+    tcp_c->snd_una = tcp_c->local_seqno;
+    tcp_c->snd_nxt = tcp_c->local_seqno;
+    tcp_c->recover = tcp_c->local_seqno;
+    tcp_c->dupacks = 0;
+    tcp_c->fast_recovery = FALSE;
+    tcp_c->snd_queued = 0;
+    tcp_c->snd_fin = FALSE;
+    tcp_c->cc = &TCP_CC_DEFAULT;
+    tcp_c->cc->init(tcp_c);
     (void)segment_init_resource(tcp_c);
-    tcp_c->stream_position = tcp_c->incoming_stream;
-    tcp_c->stream_sequence = 0;
-    tcp_c->seqno_ori = 0;
+    tcp_c->rcv_ring_start = 0;
+    tcp_c->out_of_order_nb = 0;
     tcp_c->options = tcp_no_options;
     tcp_c->recv = tcp_recv_null;  // Function to be called when a connection has been set up.
     tcp_c->connect = NULL;
     tcp_c->accept = NULL;
     tcp_c->periodic_connection_check = NULL;
     tcp_c->closed = NULL;
+    tcp_c->sent = NULL;
     tcp_c->type = type;
   }
   return tcp_c;
@@ -1281,9 +1558,9 @@ void tcp_accept(TCP_T *tcp_c, err_t (* accept)(void *arg, TCP_T *newtcp_c))
 void tcp_check_connection(TCP_T *tcp_c, err_t (*periodic_connection_check)(void *arg, TCP_T *tcp_c), u32_t nb_of_500ms)
 {
   tcp_c->periodic_connection_check = periodic_connection_check;
-  tcp_c->timer = 0;
   tcp_c->nb_of_500ms = nb_of_500ms;
-  tcp_c->counter_of_500ms = 0;
+  tcp_c->activity = tcp_c->netif->tcp_clock;
+  tcp_check_timer(tcp_c);
 }
 
  /*!
@@ -1300,83 +1577,1028 @@ void tcp_closed(TCP_T *tcp_c, err_t (* closed)(void *arg, TCP_T *tcp_c, err_t er
   tcp_c->closed = closed;
 }
 
+ /*!
+ * Function name: tcp_sent
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param sent : [in] Sent callback.
+ * \brief The peer device acknowledges data: room frees up in the send 
+ * ring. tcp_sent() sets the application function that cIPS calls then,
+ * with the number of bytes that tcp_write() accepts. An application that
+ * streams more than TCP_SND_BUF writes the rest in it.
+ * *******************************************************************/
+void tcp_sent(TCP_T *tcp_c, err_t (* sent)(void *arg, TCP_T *tcp_c, u32_t space))
+{
+  tcp_c->sent = sent;
+}
+
+ /*!
+ * Function name: tcp_congestion_control
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param cc : [in] &tcp_cc_newreno or &tcp_cc_cubic.
+ * \brief Select the congestion control algorithm of a connection. 
+ * The connections use TCP_CC_DEFAULT unless the application calls 
+ * tcp_congestion_control() before tcp_connect() or, for a server, in tcp_accept().
+ * The children of a server inherit its algorithm.
+ * *******************************************************************/
+void tcp_congestion_control(TCP_T *tcp_c, const TCP_CC_T* cc)
+{
+  T_ASSERT(("%s#%d Invalid congestion control.\r\n",__func__, __LINE__), cc != NULL);
+  tcp_c->cc = cc;
+  tcp_c->cc->init(tcp_c);
+}
+
 /*!
  * Function name: tcp_build_data_ethernet_frame
  * \return ERR_OK or ERR_VAL .
  * \param tcp_c : [in/out] tcp_c of interest.
  * \param segment : [in/out] TCP segment containing the outgoing ethernet frame.
- * \param pdata : [in] Pointer to the application data.
+ * \param seqno : [in] Sequence number of the first byte, in "snd_ring".
  * \param app_len : [in/out] Application data length.
  * \param control_bits : [in] TCP flags.
- * \brief Build a TCP frame.
+ * \brief Build a TCP frame from the bytes of the send ring.
  * *******************************************************************/
 static err_t tcp_build_data_ethernet_frame (TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment,
-       const u8_t* const pdata,const u32_t app_len, const u8_t control_bits)
+       const u32_t seqno,const u32_t app_len, const u8_t control_bits)
 {
   TCP_HEADER_T *tcphdr;
   err_t err = ERR_OK;
   u8_t* frame = segment->frame;
+  u32_t header_length = sizeof(TCP_HEADER_T) + tcp_c->options_length;
+  u32_t checksum;
 
-  //Fill in app data part
-  if (pdata != NULL)
-  {
-    tcp_memcpy(frame + sizeof(TCP_HEADER_T) + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T), pdata, app_len);
-  }
+  //Fill in app data part and sum it in the same pass.
+  checksum = tcp_copy_from_snd_ring(tcp_c, frame + header_length + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T), seqno, app_len);
 
   // Build TCP header :  only update fields that are not constant
   tcphdr = (TCP_HEADER_T *)(frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T));
-  tcphdr->seqno = htonl(tcp_c->local_seqno);
+  tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(tcp_c->remote_seqno);
-  TCP_SET_HEADER_LENGTH(tcphdr, sizeof(TCP_HEADER_T));
+  TCP_SET_HEADER_LENGTH(tcphdr, header_length);
   TCP_SET_FLAGS(tcphdr, control_bits);
-  tcphdr->windowsize = htons(tcp_c->local_wnd);/* advertise our receive window size in this TCP segment */
+  tcphdr->windowsize = htons(tcp_advertised_window(tcp_c, control_bits));/* advertise our receive window size in this TCP segment */
   tcphdr->chksum = 0; //reset checksum (because the buffer is not erased before being reused)
   tcphdr->urgent_ptr = 0;
-  //no options
+  if( tcp_c->options_length ) //The timestamps are the only options of the data segments.
+  { (void)tcp_format_timestamps_option(tcp_c->netif, tcp_c->ts_recent, frame + ETH_IP_TCP_HEADER_SIZE);}
 
+  if( !TCP_TX_OFFLOAD(tcp_c) ) //Otherwise the adapter inserts the checksum.
   {
-    u32_t checksum;
-    checksum = eth_build_pseudo_header( tcp_c->remote_ip, tcp_c->local_ip, app_len , sizeof(TCP_HEADER_T), IP_TCP);
-    checksum += ip_checksum((const u16_t*)tcphdr, sizeof(TCP_HEADER_T) + app_len); // length contains the standard header + the application data
+    //The application data are already summed.
+    checksum += ip_checksum((const u16_t*)(frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T)), header_length);
+    checksum += ip_pseudo_header_length( tcp_c->pseudo_sum, app_len + header_length);
     //Fold 32-bit sum to 16 bits and add carry
     while( checksum >> 16) {
       checksum = (checksum & 0xFFFF) + (checksum >> 16);
     }
     tcphdr->chksum = (~((u16_t)checksum)); //checksum is the one's complement of the calculated ckecksum. Note: checksum and tcphdr->chksum are big endian.
-  }
-  if( tcphdr->chksum == 0 ) // chksum zero must become 0xffff, as zero means 'no checksum' 
-  {
-    tcphdr->chksum = (u16_t)0xFFFF;
+    if( tcphdr->chksum == 0 ) // chksum zero must become 0xffff, as zero means 'no checksum' 
+    {
+      tcphdr->chksum = (u16_t)0xFFFF;
+    }
   }
 
   //Fill in IP part
   (void)eth_build_ip_request( tcp_c->remote_ip, tcp_c->local_ip,
-    frame + sizeof(ETHER_HEADER_T), app_len + sizeof(TCP_HEADER_T), IP_TCP, segment->frame_initialized);
+    frame + sizeof(ETHER_HEADER_T), app_len + header_length, IP_TCP, segment->frame_initialized);
 
   return err;
 }
 
 /*!
- * Function name: tcp_send_control
- * \return ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER.
+ * Function name: tcp_stamp_data_ethernet_frame
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param template_seg : [in] segment built by tcp_build_data_ethernet_frame() in the same tcp_output().
+ * \param segment : [in/out] TCP segment containing the outgoing ethernet frame.
+ * \param seqno : [in] Sequence number of the first byte, in "snd_ring".
+ * \param app_len : [in] Application data length.
+ * \param control_bits : [in] TCP flags.
+ * \param pseudo_header : [in] eth_build_pseudo_header() for "app_len".
+ * \brief Build a TCP frame from the headers of "template_seg": copy them, 
+ * then only patch the sequence number and the flags. If the length differs, 
+ * the IP checksum is updated incrementally. The application data are 
+ * summed while they are copied from the send ring (see ip_copy_checksum()).
+ * *******************************************************************/
+static void tcp_stamp_data_ethernet_frame (TCP_T* const tcp_c, const TCP_SENDING_SEG_T* const template_seg,
+       TCP_SENDING_SEG_T* const segment, const u32_t seqno, const u32_t app_len,
+       const u8_t control_bits, const u32_t pseudo_header)
+{
+  TCP_HEADER_T *tcphdr;
+  u8_t* frame = segment->frame;
+  u32_t header_length = sizeof(TCP_HEADER_T) + tcp_c->options_length;
+  u32_t checksum;
+
+  //Copy the headers (options included) and fill in app data part (summed in the same pass)
+  tcp_memcpy(frame, template_seg->frame, ETH_IP_TCP_HEADER_SIZE + tcp_c->options_length);
+  checksum = tcp_copy_from_snd_ring(tcp_c, frame + ETH_IP_TCP_HEADER_SIZE + tcp_c->options_length, seqno, app_len);
+
+  //Patch the IP part: the length of the last segment can be shorter.
+  ip_update_length( frame + sizeof(ETHER_HEADER_T), app_len + header_length);
+
+  //Patch the TCP header
+  tcphdr = (TCP_HEADER_T *)(frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T));
+  tcphdr->seqno = htonl(seqno);
+  TCP_SET_FLAGS(tcphdr, control_bits);
+  tcphdr->chksum = 0;
+
+  if( !TCP_TX_OFFLOAD(tcp_c) ) //Otherwise the adapter inserts the checksum.
+  {
+    checksum += pseudo_header + ip_checksum((const u16_t*)(frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T)), header_length);
+    //Fold 32-bit sum to 16 bits and add carry
+    while( checksum >> 16) {
+      checksum = (checksum & 0xFFFF) + (checksum >> 16);
+    }
+    tcphdr->chksum = (~((u16_t)checksum));
+    if( tcphdr->chksum == 0 ) // chksum zero must become 0xffff, as zero means 'no checksum' 
+    {
+      tcphdr->chksum = (u16_t)0xFFFF;
+    }
+  }
+
+  return;
+}
+
+/*!
+ * Function name: tcp_copy_from_snd_ring
+ * \return the checksum of the data copied (not folded), 0 if the adapter
+ * inserts the TCP checksum.
+ * \param tcp_c : [in] tcp_c of interest.
+ * \param output : [out] Data part of the frame. 16-bit aligned.
+ * \param seqno : [in] Sequence number of the first byte to copy.
+ * \param length : [in] Number of bytes to copy.
+ * \brief Copy bytes of the send ring into a frame and sum them in the same
+ * pass. The bytes wrap around the end of the ring in two parts. If the 
+ * first part is odd, the second one is not 16-bit aligned in the frame: it
+ * is copied, then the data are summed from the frame.
+ * *******************************************************************/
+static u32_t tcp_copy_from_snd_ring(const TCP_T* const tcp_c, u8_t* const output, const u32_t seqno, const u32_t length)
+{
+  const u8_t* ring = tcp_c->snd_ring->data;
+  u32_t index = TCP_SND_RING_INDEX(tcp_c, seqno);
+  u32_t first_part = (length < TCP_SND_BUF - index)? length : TCP_SND_BUF - index;
+  u32_t checksum = 0;
+
+  if( TCP_TX_OFFLOAD(tcp_c) || (first_part & 1) )
+  {
+    tcp_memcpy(output, ring + index, first_part);
+    tcp_memcpy(output + first_part, ring, length - first_part);
+    if( !TCP_TX_OFFLOAD(tcp_c) )
+    { checksum = ip_checksum((const u16_t*)output, length);}
+  }
+  else
+  {
+    checksum = ip_copy_checksum(output, ring + index, first_part);
+    if( first_part < length )
+    { checksum += ip_copy_checksum(output + first_part, ring, length - first_part);}
+  }
+  return checksum;
+}
+
+/*!
+ * Function name: tcp_output
+ * \return ERR_OK, ERR_DEVICE_DRIVER.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Cut segments of up to the MSS from the unsent bytes of the send
+ * ring and send them back to back, as long as the bytes in flight 
+ * (snd_nxt - snd_una) stay within the send window: the smallest of the 
+ * window of the peer device and of the congestion window. Each segment 
+ * borrows a frame while it is built, the first one completely, the others
+ * from its headers (see tcp_stamp_data_ethernet_frame()). The frames are 
+ * handed to the device driver in one batch (see netif_send_batch()), then
+ * go back to the adapter: an unacknowledged segment only keeps its 
+ * sequence numbers.
+ * \note If nothing is in flight, the first segment leaves whatever the 
+ * window so that the connection cannot stall: cut to the window of the 
+ * peer device, or to one byte if it is closed (zero window probe, 
+ * repeated by the retransmission timer). With tcp_nagle, a segment 
+ * shorter than the MSS only leaves when nothing is in flight: the next 
+ * writes fill it up in the meantime.
+ * *******************************************************************/
+static err_t tcp_output(TCP_T* const tcp_c)
+{
+  u8_t* batch_frames[MAX_TCP_SEG]; //Segments handed to the device driver in one call.
+  u32_t batch_lengths[MAX_TCP_SEG];
+  TCP_SENDING_SEG_T* batch_segments[MAX_TCP_SEG]; //Their frames go back to the adapter once sent.
+  u32_t batch_nb = 0;
+  u32_t window;
+  u32_t in_flight;
+  u32_t length;
+  u32_t mss = TCP_SEND_MSS(tcp_c);
+  u32_t pseudo_header = 0; //Pseudo header of the segments whose length is "pseudo_length".
+  u32_t pseudo_length = 0;
+  u32_t i;
+  u8_t control_bits;
+  bool_t idle = (tcp_c->seg_nb[TCP_SEG_UNACKED])? FALSE : TRUE; //Nothing in flight: the retransmission timer is not running.
+  TCP_SENDING_SEG_T* segment;
+  err_t err = ERR_OK;
+
+  window = (tcp_c->cwnd < (u32_t)tcp_c->remote_wnd)? tcp_c->cwnd : (u32_t)tcp_c->remote_wnd;
+  while( tcp_c->snd_queued )
+  {
+    length = (tcp_c->snd_queued < mss)? tcp_c->snd_queued : mss;
+    in_flight = (tcp_c->snd_nxt - tcp_c->snd_una) & TCP_SEQ_MASK;
+    if( (in_flight == 0) && (length > (u32_t)tcp_c->remote_wnd) )
+    { length = (tcp_c->remote_wnd)? (u32_t)tcp_c->remote_wnd : 1;} //Zero window probe (RFC 9293, 3.8.6.1) if the window is closed.
+    if( (in_flight != 0) && (in_flight + length > window) )
+    { break;} //The window is full. The next ACK slides it.
+    if( (tcp_c->options & tcp_nagle) && (in_flight != 0) && (length < mss) )
+    { break;} //Nagle (RFC 896): a small segment waits for the ACK of the data in flight.
+    segment = segment_get_first( tcp_c, TCP_SEG_UNUSED);
+    if( segment == NULL )
+    { break;} //MAX_TCP_SEG segments are in flight. The next ACK frees one.
+    if( !segment_borrow_frame(tcp_c, segment) )
+    { break;} //The other connections hold the frames of the adapter. They give them back once sent.
+
+    control_bits = (length == tcp_c->snd_queued)? (TCP_PSH | TCP_ACK) : TCP_ACK; //Set TCP_PSH on the last segment.
+    if( batch_nb == 0 ) { //The first segment is the template of the others.
+      err = tcp_build_data_ethernet_frame (tcp_c, segment, tcp_c->snd_nxt, length, control_bits);
+    } else {
+      if( (pseudo_length != length) && !TCP_TX_OFFLOAD(tcp_c) ) { //Only the last segment can be shorter.
+        pseudo_header = ip_pseudo_header_length( tcp_c->pseudo_sum, length + sizeof(TCP_HEADER_T) + tcp_c->options_length);
+        pseudo_length = length;
+      }
+      tcp_stamp_data_ethernet_frame (tcp_c, batch_segments[0], segment, tcp_c->snd_nxt, length, control_bits, pseudo_header);
+    }
+    (void)tcp_need_acknowledgment (segment, length + tcp_c->options_length, tcp_c->snd_nxt + length);
+    batch_frames[batch_nb] = segment->frame;
+    batch_lengths[batch_nb] = segment->len;
+    batch_segments[batch_nb] = segment;
+    batch_nb++;
+    tcp_c->snd_nxt = (tcp_c->snd_nxt + length) & TCP_SEQ_MASK;
+    tcp_c->snd_queued -= length;
+    if( !tcp_c->rtt_timing && !TCP_TIMESTAMPS_ENABLED(tcp_c) ) //Measure the round trip time of this segment. With timestamps, each ACK measures it (see tcp_parse_options()).
+    {
+      tcp_c->rtt_timing = TRUE;
+      tcp_c->rtt_seq = segment->ack_no;
+      tcp_c->rtt_start = tcp_c->netif->tcp_clock;
+    }
+    //The segment waits for its acknowledgment.
+    (void)segment_change_state( tcp_c, segment, TCP_SEG_UNACKED);
+  }
+
+  if( batch_nb )
+  {
+    tcp_c->remote_ACK_counter = 0; //The data segments carry the ACK.
+    if( idle || !tcp_c->rto_running ) { tcp_rto_restart(tcp_c);}
+    err = netif_send_batch(tcp_c->netif, batch_frames, batch_lengths, batch_nb);
+    for( i = 0; i < batch_nb; i++)
+    { segment_return_frame(tcp_c, batch_segments[i]);} //A retransmission rebuilds the frame from "snd_ring".
+  }
+  if( !err ) { err = tcp_send_fin(tcp_c);} //The FIN follows the last byte sent.
+  return err;
+}
+
+/*!
+ * Function name: tcp_queue_fin
+ * \return ERR_OK, ERR_SEG_MEM, ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief cIPS closes its side of the connection: the FIN takes the 
+ * sequence number after the last byte written. It leaves at once if 
+ * nothing waits in the send ring, after the last segment otherwise (see 
+ * tcp_output()).
+ * *******************************************************************/
+static err_t tcp_queue_fin(TCP_T* const tcp_c)
+{
+  tcp_c->snd_fin = TRUE;
+  tcp_c->local_seqno = (tcp_c->local_seqno + 1) & TCP_SEQ_MASK; //Note: increment for TCP_SYN or TCP_FIN but not for TCP_ACK
+  return tcp_send_fin(tcp_c);
+}
+
+/*!
+ * Function name: tcp_send_fin
+ * \return ERR_OK, ERR_SEG_MEM, ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Send the FIN queued by tcp_queue_fin() once every byte of the 
+ * send ring has left. Like the SYN, it keeps its frame and waits for its
+ * acknowledgment as an unacknowledged segment: the retransmission timer 
+ * sends it again. It counts in "snd_nxt".
+ * *******************************************************************/
+static err_t tcp_send_fin(TCP_T* const tcp_c)
+{
+  TCP_SENDING_SEG_T* segment;
+  bool_t idle = (tcp_c->seg_nb[TCP_SEG_UNACKED])? FALSE : TRUE; //Nothing in flight: the retransmission timer is not running.
+  err_t err = ERR_OK;
+
+  if( tcp_c->snd_fin && !tcp_c->snd_queued && (tcp_c->snd_nxt != tcp_c->local_seqno) )
+  {
+    segment = segment_get_first( tcp_c, TCP_SEG_UNUSED);
+    if( (segment != NULL) && segment_borrow_frame(tcp_c, segment) )
+    {
+      err = tcp_send_control (tcp_c, segment, TCP_FIN|TCP_ACK, NULL, 0);
+      (void)tcp_need_acknowledgment (segment, tcp_c->options_length, tcp_c->local_seqno);
+      (void)segment_change_state( tcp_c, segment, TCP_SEG_UNACKED);
+      tcp_c->snd_nxt = tcp_c->local_seqno;
+      tcp_c->remote_ACK_counter = 0; //The FIN carries the ACK.
+      if( idle || !tcp_c->rto_running ) { tcp_rto_restart(tcp_c);}
+    }
+    else
+    { //The next ACK of the peer device tries again.
+      T_ERROR(("ERR_SEG_MEM : no segment to hold the FIN. Increase MAX_TCP_SEG or TCP_FRAME_POOL\r\n"));
+      err = tcp_store_error( ERR_SEG_MEM, tcp_c, __func__, __LINE__);
+    }
+  }
+  return err;
+}
+
+/*!
+ * Function name: tcp_refresh_acknowledgment
+ * \return nothing.
+ * \param tcp_c : [in] tcp_c of interest.
+ * \param segment : [in/out] Data segment about to leave.
+ * \brief The SYN waits for a retransmission after it has been built. In 
+ * the meantime, the peer device may have sent more data. tcp_refresh_acknowledgment() sets the acknowledgment number
+ * of the segment to the last byte received and updates its checksum
+ * incrementally. With timestamps, it also stamps the TCP clock and the 
+ * last timestamp of the peer device: a retransmission is measured from 
+ * its own departure.
+ * *******************************************************************/
+static void tcp_refresh_acknowledgment(const TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment)
+{
+  TCP_HEADER_T* tcphdr = (TCP_HEADER_T *)(segment->frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T));
+  u8_t* timestamps = segment->frame + ETH_IP_TCP_HEADER_SIZE + 4; //TSval then TSecr, after 2 NOPs, the kind and the length.
+  u32_t ackno = htonl(tcp_c->remote_seqno);
+  u32_t old_value;
+
+  if( tcphdr->ackno != ackno )
+  {
+    if( !TCP_TX_OFFLOAD(tcp_c) ) //Otherwise the adapter inserts the checksum.
+    { tcphdr->chksum = ip_checksum_update32( tcphdr->chksum, tcphdr->ackno, ackno);}
+    tcphdr->ackno = ackno;
+  }
+  if( tcp_c->options_length )
+  {
+    old_value = TCP_OPTION_GET32(timestamps);
+    tcp_option_put32(timestamps, tcp_c->netif->tcp_clock);
+    if( !TCP_TX_OFFLOAD(tcp_c) ) //The timestamps are 32-bit aligned: the checksum updates like an aligned field.
+    { tcphdr->chksum = ip_checksum_update32( tcphdr->chksum, htonl(old_value), htonl(tcp_c->netif->tcp_clock));}
+    old_value = TCP_OPTION_GET32(timestamps + 4);
+    tcp_option_put32(timestamps + 4, tcp_c->ts_recent);
+    if( !TCP_TX_OFFLOAD(tcp_c) )
+    { tcphdr->chksum = ip_checksum_update32( tcphdr->chksum, htonl(old_value), htonl(tcp_c->ts_recent));}
+  }
+  return;
+}
+
+/*!
+ * Function name: tcp_retransmit
+ * \return ERR_OK, ERR_DEVICE_DRIVER, ERR_SEG_MEM.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param segment : [in/out] Unacknowledged segment to retransmit: the 
+ * oldest one (segment_get_oldest_unacked()) or a hole reported by the SACK
+ * blocks (segment_get_next_hole()). Nothing is sent if NULL.
+ * \brief Retransmit an unacknowledged segment. The SYN and the FIN keep 
+ * their frame.
+ * A data segment is rebuilt from the send ring: the bytes acknowledged in
+ * the meantime are left out and the following unacknowledged segments 
+ * (not SACKed) join it up to the MSS, so small segments lost together 
+ * leave again as one.
+ * *******************************************************************/
+static err_t tcp_retransmit(TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment)
+{
+  TCP_SENDING_SEG_T* next;
+  u32_t mss = TCP_SEND_MSS(tcp_c);
+  u32_t seqno;
+  u32_t end;
+  u32_t i;
+  bool_t merged;
+  u8_t control_bits;
+  err_t err = ERR_OK;
+
+  if( segment != NULL )
+  {
+    segment->retransmitted = TRUE;
+    if( segment->buffer != NULL ) //The SYN or the FIN.
+    {
+      tcp_refresh_acknowledgment(tcp_c, segment);
+      err = netif_send(tcp_c->netif, segment->frame, segment->len);
+    }
+    else
+    {
+      seqno = TCP_SEGMENT_SEQNO(tcp_c, segment);
+      if( TCP_SEQ_LT(seqno, tcp_c->snd_una) ) { seqno = tcp_c->snd_una;} //Partially acknowledged.
+      end = segment->ack_no;
+      do
+      { //Repacketization: the segments that follow join this one.
+        merged = FALSE;
+        for( i = 0; i < MAX_TCP_SEG; i++)
+        {
+          next = &tcp_c->segment[i];
+          if( (next != segment) && (next->state == TCP_SEG_UNACKED) && (next->buffer == NULL) && !next->sacked &&
+              (TCP_SEGMENT_SEQNO(tcp_c, next) == end) && (((next->ack_no - seqno) & TCP_SEQ_MASK) <= mss) )
+          {
+            end = next->ack_no;
+            (void)segment_change_state( tcp_c, next, TCP_SEG_UNUSED);
+            merged = TRUE;
+          }
+        }
+      } while( merged );
+      (void)tcp_need_acknowledgment (segment, ((end - seqno) & TCP_SEQ_MASK) + tcp_c->options_length, end);
+      if( segment_borrow_frame(tcp_c, segment) )
+      {
+        control_bits = (end == ((tcp_c->snd_nxt + tcp_c->snd_queued) & TCP_SEQ_MASK))? (TCP_PSH | TCP_ACK) : TCP_ACK;
+        err = tcp_build_data_ethernet_frame (tcp_c, segment, seqno, (end - seqno) & TCP_SEQ_MASK, control_bits);
+        if( !err ) { err = netif_send(tcp_c->netif, segment->frame, segment->len);}
+        segment_return_frame(tcp_c, segment);
+      }
+      else
+      { //The retransmission time out tries again.
+        T_ERROR(("ERR_SEG_MEM : no frame to retransmit a segment. Increase TCP_FRAME_POOL\r\n"));
+        err = tcp_store_error( ERR_SEG_MEM, tcp_c, __func__, __LINE__);
+      }
+    }
+    tcp_c->remote_ACK_counter = 0; //The segment carries the ACK.
+    tcp_c->rtt_timing = FALSE; //Karn: the ACK could acknowledge either transmission.
+  }
+  return err;
+}
+
+/*!
+ * Function name: tcp_retransmission_timer
+ * \return ERR_OK, ERR_DEVICE_DRIVER, ERR_RST.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief When cIPS sends a TCP frame to the peer device, the peer device
+ * must acknowledge it within the retransmission time out. Otherwise the 
+ * frame is lost: cIPS retransmits the oldest unacknowledged segment and 
+ * doubles the retransmission time out (back-off). If the peer device does
+ * not acknowledge anything for TCP_RETRANSMISSION_TIMEOUT, the connection
+ * is down and cIPS confirms it by sending a reset.
+ * *******************************************************************/
+static err_t tcp_retransmission_timer(TCP_T* const tcp_c)
+{
+  u32_t now = tcp_c->netif->tcp_clock;
+  err_t err = ERR_OK;
+
+  if( tcp_c->rto_running && tcp_c->seg_nb[TCP_SEG_UNACKED] && !U32_BEFORE(now, tcp_c->rto_expiry) )
+  {
+    if( tcp_c->rto_backoff && (U32_DIFF(now, tcp_c->rto_stall) >= TCP_RETRANSMISSION_TIMEOUT) )
+    {
+      //Send a TCP_RST and Close the TCP controller.
+      err = tcp_reset(tcp_c, &tcp_c->control_segment, __func__, __LINE__);
+    }
+    else
+    {
+      if( (tcp_c->state == ESTABLISHED) && (tcp_c->remote_wnd != 0) && !TCP_SEQ_LT(tcp_c->snd_una, tcp_c->recover) )
+      { //First retransmission of this loss episode: the network is congested. A zero window probe is not a loss.
+        tcp_c->cc->on_rto(tcp_c);
+        tcp_c->recover = tcp_c->snd_nxt;
+      }
+      tcp_c->fast_recovery = FALSE; //The timer takes over: the ACKs clock the slow start again.
+      tcp_c->dupacks = 0;
+      segment_reset_scoreboard(tcp_c);
+      err = tcp_retransmit(tcp_c, segment_get_oldest_unacked(tcp_c));
+      tcp_c->rto_backoff++;
+      tcp_c->rto = (tcp_c->rto < TCP_MAX_RTO / 2)? 2 * tcp_c->rto : TCP_MAX_RTO;
+      tcp_c->rto_expiry = now + tcp_c->rto;
+      tcp_timer_arm(tcp_c, TCP_TIMER_RTO, tcp_c->rto_expiry);
+      T_DEBUGF(TCP_DEBUG, ("%s#%d: TCP retransmission time out, next in %ld ms\r\n",tcp_c->netif->name, tcp_c->local_port, tcp_c->rto));
+    }
+  }
+  return err;
+}
+
+/*!
+ * Function name: tcp_delayed_ack
+ * \return ERR_OK, ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Send the ACK that no data segment has carried (RFC 1122): once
+ * TCP_DELAYED_ACK_SEGMENTS segments wait for it or once 
+ * TCP_DELAYED_ACK_TIMEOUT has expired. Until then, a tcp_write() can 
+ * carry it. Request/response traffic then saves one frame per exchange.
+ * *******************************************************************/
+static err_t tcp_delayed_ack(TCP_T* const tcp_c)
+{
+  err_t err = ERR_OK;
+
+  if( tcp_c->remote_ACK_counter && (tcp_c->state >= ESTABLISHED) && (tcp_c->state <= CLOSE_WAIT) &&
+      ((tcp_c->remote_ACK_counter >= TCP_DELAYED_ACK_SEGMENTS) || !U32_BEFORE(tcp_c->netif->tcp_clock, tcp_c->ack_deadline)) )
+  {
+    err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_ACK, NULL, 0);
+    tcp_c->remote_ACK_counter = 0;
+  }
+  return err;
+}
+
+/*!
+ * Function name: tcp_rto_init
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief No round trip time measured yet: the retransmission time out is
+ * TCP_INITIAL_RTO.
+ * *******************************************************************/
+static void tcp_rto_init(TCP_T* const tcp_c)
+{
+  tcp_c->srtt = 0;
+  tcp_c->rttvar = 0;
+  tcp_c->rto = TCP_INITIAL_RTO;
+  tcp_c->rto_backoff = 0;
+  tcp_c->rto_running = FALSE;
+  tcp_timer_cancel(tcp_c, TCP_TIMER_RTO);
+  tcp_c->rtt_timing = FALSE;
+  return;
+}
+
+/*!
+ * Function name: tcp_rto_restart
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief The peer device acknowledges new data or cIPS sends data while 
+ * nothing is in flight: the retransmission timer restarts if segments are
+ * still unacknowledged, it stops otherwise (RFC 6298, 5.1 to 5.3).
+ * *******************************************************************/
+static void tcp_rto_restart(TCP_T* const tcp_c)
+{
+  tcp_c->rto_stall = tcp_c->netif->tcp_clock;
+  tcp_c->rto_expiry = tcp_c->netif->tcp_clock + tcp_c->rto;
+  tcp_c->rto_running = (tcp_c->seg_nb[TCP_SEG_UNACKED])? TRUE : FALSE;
+  if( tcp_c->rto_running )
+  { tcp_timer_arm(tcp_c, TCP_TIMER_RTO, tcp_c->rto_expiry);}
+  else
+  { tcp_timer_cancel(tcp_c, TCP_TIMER_RTO);}
+  return;
+}
+
+/*!
+ * Function name: tcp_rtt_sample
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param rtt : [in] Round trip time in ms, of the timed segment or echoed by the timestamps option.
+ * \brief A round trip time is measured: update the smoothed round
+ * trip time, its variation and the retransmission time out (RFC 6298):
+ * RTO = SRTT + max(G, 4*RTTVAR), G being the resolution of the TCP clock.
+ * The retransmission time out is bounded by TCP_MIN_RTO and TCP_MAX_RTO.
+ * *******************************************************************/
+static void tcp_rtt_sample(TCP_T* const tcp_c, const u32_t rtt)
+{
+  u32_t granularity = (tcp_c->netif->tcp_fine_clock)? 1 : TCP_TIMER_PERIOD;
+  s32_t delta;
+  u32_t rto;
+
+  if( tcp_c->srtt == 0 ) //First measure.
+  {
+    tcp_c->srtt = rtt << 3;
+    tcp_c->rttvar = rtt << 1;
+  }
+  else
+  {
+    delta = (s32_t)rtt - (s32_t)(tcp_c->srtt >> 3);
+    tcp_c->srtt = (u32_t)((s32_t)tcp_c->srtt + delta); //SRTT = 7/8 SRTT + 1/8 RTT
+    if( delta < 0 ) { delta = -delta;}
+    tcp_c->rttvar = tcp_c->rttvar - (tcp_c->rttvar >> 2) + (u32_t)delta; //RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - RTT|
+  }
+  rto = (tcp_c->srtt >> 3) + ((tcp_c->rttvar > granularity)? tcp_c->rttvar : granularity);
+  tcp_c->rto = (rto < TCP_MIN_RTO)? TCP_MIN_RTO : ((rto > TCP_MAX_RTO)? TCP_MAX_RTO : rto);
+  tcp_c->rtt_timing = FALSE;
+  T_DEBUGF(TCP_DEBUG, ("%s#%d: TCP rtt %ld ms, srtt %ld ms, rto %ld ms\r\n",tcp_c->netif->name, tcp_c->local_port, rtt, tcp_c->srtt >> 3, tcp_c->rto));
+  return;
+}
+
+/*!
+ * Function name: tcp_receive_ack
+ * \return ERR_OK, ERR_DEVICE_DRIVER.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param flags : [in] Control bits of the TCP frame.
+ * \param tcphdr : [in] TCP header of the ethernet frame.
+ * \param app_data_length : [in] Length of application data.
+ * \brief The peer device acknowledges the segments of cIPS: free them, 
+ * slide the send window or count a duplicate ACK, then update the window
+ * of the peer device. ESTABLISHED and the states waiting for the ACK of 
+ * the FIN share it.
+ * *******************************************************************/
+static err_t tcp_receive_ack(TCP_T* const tcp_c, const u16_t flags, const TCP_HEADER_T* const tcphdr, const u32_t app_data_length)
+{
+  err_t err = ERR_OK;
+
+  (void) tcp_lookup_segment_by_acknowledge_no( tcp_c, ntohl(tcphdr->ackno));
+  //Slide the send window: the peer device has received everything before "ackno".
+  if( TCP_SEQ_GT(ntohl(tcphdr->ackno), tcp_c->snd_una) && !TCP_SEQ_GT(ntohl(tcphdr->ackno), tcp_c->snd_nxt) )
+  {
+    err = tcp_new_ack(tcp_c, ntohl(tcphdr->ackno));
+  }
+  else if( (ntohl(tcphdr->ackno) == tcp_c->snd_una) && (tcp_c->snd_nxt != tcp_c->snd_una) && 
+           (app_data_length == 0) && ((flags & (TCP_SYN | TCP_FIN)) == 0) && (tcp_c->remote_wnd != 0) &&
+           (((u32_t)ntohs(tcphdr->windowsize) << tcp_c->snd_wnd_scale) == tcp_c->remote_wnd) )
+  { //Duplicate ACK (RFC 5681): the peer device received a segment after a hole.
+    err = tcp_duplicate_ack(tcp_c);
+  }
+  //Update window size
+  tcp_c->remote_wnd = (u32_t)ntohs(tcphdr->windowsize) << tcp_c->snd_wnd_scale;
+  if( tcp_c->remote_wnd == 0 )
+  { //The peer device answers the zero window probe: it is alive. The persist time does not count toward TCP_RETRANSMISSION_TIMEOUT.
+    tcp_c->rto_stall = tcp_c->netif->tcp_clock;
+    tcp_c->rto_backoff = 0;
+  }
+  return err;
+}
+
+/*!
+ * Function name: tcp_new_ack
+ * \return ERR_OK, ERR_DEVICE_DRIVER.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param ackno : [in] Acknowledgment number received, within (snd_una, snd_nxt].
+ * \brief The peer device acknowledges new data: slide the send window.
+ * Outside fast recovery, the congestion control opens the congestion window.
+ * In fast recovery (RFC 6582):
+ * - a partial ACK (below "recover") reveals the next hole: cIPS retransmits 
+ * it at once and deflates the congestion window by the bytes acknowledged.
+ * With SACK, the next hole is the oldest segment neither SACKed nor 
+ * retransmitted yet.
+ * - a full ACK ends the fast recovery: the congestion window deflates to 
+ * "ssthresh" (or to the flight plus one segment if it is smaller).
+ * After a retransmission time out, each ACK below "recover" retransmits the
+ * next hole reported by the SACK blocks.
+ * *******************************************************************/
+static err_t tcp_new_ack(TCP_T* const tcp_c, const u32_t ackno)
+{
+  u32_t acked = (ackno - tcp_c->snd_una) & TCP_SEQ_MASK;
+  u32_t mss = tcp_cc_mss(tcp_c);
+  u32_t in_flight;
+  u32_t distance;
+  TCP_SENDING_SEG_T* hole;
+  err_t err = ERR_OK;
+
+  tcp_c->dupacks = 0;
+  if( tcp_c->rtt_timing && !TCP_SEQ_LT(ackno, tcp_c->rtt_seq) )
+  { tcp_rtt_sample(tcp_c, U32_DIFF(tcp_c->netif->tcp_clock, tcp_c->rtt_start));}
+  tcp_c->rto_backoff = 0;
+  if( !tcp_c->fast_recovery )
+  {
+    tcp_c->cc->on_ack(tcp_c, acked, tcp_c->netif->tcp_clock); //Open the congestion window.
+    tcp_c->snd_una = ackno;
+    if( TCP_SACK_ENABLED(tcp_c) && TCP_SEQ_LT(ackno, tcp_c->recover) )
+    { //Slow start after a time out: retransmit the next hole instead of waiting for the timer.
+      err = tcp_retransmit(tcp_c, segment_get_next_hole(tcp_c));
+    }
+  }
+  else if( TCP_SEQ_LT(ackno, tcp_c->recover) ) //Partial ACK.
+  {
+    tcp_c->snd_una = ackno;
+    hole = (TCP_SACK_ENABLED(tcp_c))? segment_get_next_hole(tcp_c) : NULL;
+    err = tcp_retransmit(tcp_c, (hole != NULL)? hole : segment_get_oldest_unacked(tcp_c));
+    tcp_c->cwnd = (tcp_c->cwnd > acked + mss)? tcp_c->cwnd - acked : mss;
+    if( acked >= mss ) { tcp_c->cwnd += mss;}
+  }
+  else //Full ACK.
+  {
+    tcp_c->snd_una = ackno;
+    in_flight = (tcp_c->snd_nxt - tcp_c->snd_una) & TCP_SEQ_MASK;
+    in_flight = ((in_flight > mss)? in_flight : mss) + mss;
+    tcp_c->cwnd = (tcp_c->ssthresh < in_flight)? tcp_c->ssthresh : in_flight;
+    tcp_c->fast_recovery = FALSE;
+  }
+  if( (tcp_c->snd_una == tcp_c->snd_nxt) && !tcp_c->snd_queued )
+  { tcp_return_snd_ring(tcp_c);} //Everything is acknowledged: the send ring goes back to the adapter.
+  else if( tcp_c->snd_ring != NULL )
+  { //Keep "snd_ring_base" within one ring of "snd_una": the distance to the bytes stored never wraps 2^32, which TCP_SND_BUF does not divide.
+    distance = (tcp_c->snd_una - tcp_c->snd_ring_base) & TCP_SEQ_MASK;
+    tcp_c->snd_ring_base = (tcp_c->snd_ring_base + distance - (distance % TCP_SND_BUF)) & TCP_SEQ_MASK;
+  }
+  tcp_rto_restart(tcp_c);
+  return err;
+}
+
+/*!
+ * Function name: tcp_duplicate_ack
+ * \return ERR_OK, ERR_DEVICE_DRIVER.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief The peer device acknowledges "snd_una" again: a segment is lost 
+ * or the network reorders the segments. After TCP_DUPACK_THRESHOLD 
+ * duplicate ACKs, cIPS retransmits the segment starting at "snd_una" 
+ * without waiting for tcp_timer() (fast retransmit, RFC 5681) and enters
+ * fast recovery (RFC 6582): each further duplicate ACK means that a 
+ * segment has left the network so the congestion window inflates by one 
+ * segment and tcp_output() can send a new one. With SACK, the 
+ * room goes to the next hole first (see segment_get_next_hole()).
+ * \note cIPS enters fast recovery once per loss episode: the ACK must
+ * cover "recover".
+ * *******************************************************************/
+static err_t tcp_duplicate_ack(TCP_T* const tcp_c)
+{
+  u32_t mss = tcp_cc_mss(tcp_c);
+  TCP_SENDING_SEG_T* hole;
+  err_t err = ERR_OK;
+
+  tcp_c->dupacks++;
+  if( tcp_c->fast_recovery )
+  {
+    hole = (TCP_SACK_ENABLED(tcp_c))? segment_get_next_hole(tcp_c) : NULL;
+    if( hole != NULL )
+    { err = tcp_retransmit(tcp_c, hole);} //The segment that left the network makes room for the hole.
+    else
+    { tcp_c->cwnd += mss;}
+  }
+  else if( (tcp_c->dupacks == TCP_DUPACK_THRESHOLD) && !TCP_SEQ_LT(tcp_c->snd_una, tcp_c->recover) )
+  {
+    T_DEBUGF(TCP_DEBUG, ("%s#%d: TCP fast retransmit #0x%lx\r\n",tcp_c->netif->name, tcp_c->local_port, tcp_c->snd_una));
+    tcp_c->recover = tcp_c->snd_nxt;
+    tcp_c->cc->on_loss(tcp_c);
+    err = tcp_retransmit(tcp_c, segment_get_oldest_unacked(tcp_c));
+    tcp_c->cwnd += TCP_DUPACK_THRESHOLD * mss; //The duplicate ACKs have left the network.
+    tcp_c->fast_recovery = TRUE;
+  }
+  return err;
+}
+
+/*!
+ * Function name: tcp_sack_mark
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param left : [in] First sequence number of the SACK block.
+ * \param right : [in] Sequence number following the SACK block.
+ * \brief The peer device holds the bytes from "left" to "right": mark the
+ * unacknowledged segments they cover. cIPS will not retransmit them.
+ * *******************************************************************/
+static void tcp_sack_mark(TCP_T* const tcp_c, const u32_t left, const u32_t right)
+{
+  TCP_SENDING_SEG_T* segment = tcp_c->segment;
+  u32_t i;
+
+  if( TCP_SEQ_LT(left, right) && !TCP_SEQ_LT(left, tcp_c->snd_una) && !TCP_SEQ_GT(right, tcp_c->snd_nxt) )
+  {
+    for( i = 0; i < MAX_TCP_SEG; i++)
+    {
+      if( (segment[i].state == TCP_SEG_UNACKED) && !TCP_SEQ_LT(TCP_SEGMENT_SEQNO(tcp_c, &segment[i]), left) && !TCP_SEQ_GT(segment[i].ack_no, right) )
+      { segment[i].sacked = TRUE;}
+    }
+  }
+  return;
+}
+
+/*!
+ * Function name: tcp_format_sack_option
+ * \return the length of the option in bytes, NOPs included.
+ * \param tcp_c : [in] tcp_c of interest.
+ * \param options : [out] TCP_OPTION_SACK_LENGTH(TCP_MAX_SACK_BLOCKS) + 2 bytes.
+ * \brief Generates the SACK option from "out_of_order": the contiguous 
+ * segments merge into one block. The first block holds the last segment 
+ * received (RFC 2018), up to TCP_MAX_SACK_BLOCKS blocks follow.
+ * *******************************************************************/
+static u8_t tcp_format_sack_option(const TCP_T* const tcp_c, u8_t* const options)
+{
+  const TCP_OUT_OF_ORDER_T* segment;
+  u32_t left[TCP_MAX_SACK_BLOCKS];
+  u32_t right[TCP_MAX_SACK_BLOCKS];
+  u32_t blocks = 0;
+  u32_t recent = 0;
+  u32_t start;
+  u32_t end;
+  u32_t i;
+  u32_t j;
+  bool_t found;
+  u8_t length = 0;
+
+  for( i = 0; i < tcp_c->out_of_order_nb; i++)
+  {
+    if( tcp_c->out_of_order[i].seqno == tcp_c->sack_recent ) { recent = i;}
+  }
+  for( i = 0; (i <= tcp_c->out_of_order_nb) && (blocks < TCP_MAX_SACK_BLOCKS); i++)
+  {
+    segment = &tcp_c->out_of_order[(i == 0)? recent : i - 1];
+    found = FALSE;
+    for( j = 0; j < blocks; j++)
+    {
+      if( !TCP_SEQ_LT(segment->seqno, left[j]) && !TCP_SEQ_GT(segment->seqno + segment->length, right[j]) )
+      { found = TRUE;} //Already in a block.
+    }
+    if( !found )
+    {
+      left[blocks] = segment->seqno;
+      right[blocks] = (segment->seqno + segment->length) & TCP_SEQ_MASK;
+      do
+      { //Merge the segments that touch the block.
+        found = FALSE;
+        for( j = 0; j < tcp_c->out_of_order_nb; j++)
+        {
+          start = tcp_c->out_of_order[j].seqno;
+          end = start + tcp_c->out_of_order[j].length;
+          if( !TCP_SEQ_GT(start, right[blocks]) && !TCP_SEQ_LT(end, left[blocks]) &&
+              (TCP_SEQ_LT(start, left[blocks]) || TCP_SEQ_GT(end, right[blocks])) )
+          {
+            if( TCP_SEQ_LT(start, left[blocks]) ) { left[blocks] = start;}
+            if( TCP_SEQ_GT(end, right[blocks]) ) { right[blocks] = end;}
+            found = TRUE;
+          }
+        }
+      } while( found );
+      blocks++;
+    }
+  }
+  options[length++] = TCP_OPTION_NOP; //Aligns the blocks on 32 bits.
+  options[length++] = TCP_OPTION_NOP;
+  options[length++] = TCP_OPTION_SACK;
+  options[length++] = TCP_OPTION_SACK_LENGTH(blocks);
+  for( i = 0; i < blocks; i++)
+  {
+    tcp_option_put32(options + length, left[i]);
+    tcp_option_put32(options + length + 4, right[i]);
+    length += 8; //Two 32-bit edges.
+  }
+  return length;
+}
+
+/*!
+ * Function name: tcp_receive_segment
+ * \return ERR_OK, ERR_DEVICE_DRIVER or the error of the tcp_c->recv() callback.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param tcphdr : [in] TCP header of the incoming data segment.
+ * \param app_data_length : [in] Length of application data.
+ * \brief The peer device sends data in one or several segments:
+ * - the segment is the next one expected ("remote_seqno"): the application
+ * receives it at once, from the frame. Then the segments stored out of 
+ * order that follow it fill the hole (see tcp_reassemble()).
+ * - the segment comes after a hole: it waits in "rcv_ring" (see 
+ * tcp_store_out_of_order()).
+ * - the segment is already received: cIPS ignores it.
+ * In the last two cases, cIPS acknowledges at once. The duplicate ACKs 
+ * tell the peer device which segment is missing (RFC 5681, fast retransmit)
+ * and their SACK blocks which segments follow the hole (see tcp_send_control()).
+ * The ACK of a segment in order is delayed (see tcp_delayed_ack()) unless
+ * the segment fills a hole.
+ * *******************************************************************/
+static err_t tcp_receive_segment(TCP_T* const tcp_c, const TCP_HEADER_T* const tcphdr, u32_t app_data_length)
+{
+  const u8_t* data = (const u8_t*)tcphdr + (u32_t)TCP_GET_HEADER_LENGTH(tcphdr);
+  u32_t seqno = ntohl(tcphdr->seqno);
+  err_t err = ERR_OK;
+  err_t reassembly_err;
+
+  if( TCP_SEQ_LT(seqno, tcp_c->remote_seqno) && TCP_SEQ_GT(seqno + app_data_length, tcp_c->remote_seqno) )
+  { //The peer device retransmits data partly received: keep the new part.
+    data += (tcp_c->remote_seqno - seqno) & TCP_SEQ_MASK;
+    app_data_length -= (tcp_c->remote_seqno - seqno) & TCP_SEQ_MASK;
+    seqno = tcp_c->remote_seqno;
+  }
+
+  if( seqno != tcp_c->remote_seqno ) //Out of order or already received.
+  {
+    if( TCP_SEQ_GT(seqno, tcp_c->remote_seqno) )
+    { tcp_store_out_of_order(tcp_c, data, seqno, app_data_length);}
+    err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_ACK, NULL, 0);
+    tcp_c->remote_ACK_counter = 0;
+  }
+  else if( app_data_length )
+  {
+    tcp_c->remote_seqno = (seqno + app_data_length) & TCP_SEQ_MASK; //Sequence number to acknowledge
+    tcp_c->rcv_ring_start = TCP_RING_INDEX(tcp_c->rcv_ring_start + app_data_length);
+    if( !tcp_c->remote_ACK_counter ) //The first segment not acknowledged starts the delayed ACK timer.
+    {
+      tcp_c->ack_deadline = tcp_c->netif->tcp_clock + TCP_DELAYED_ACK_TIMEOUT;
+      tcp_timer_arm(tcp_c, TCP_TIMER_DELAYED_ACK, tcp_c->ack_deadline);
+    }
+    tcp_c->remote_ACK_counter++; //Acknowledged by the next data segment (see tcp_output()) or by an ACK (see tcp_delayed_ack()).
+    err = tcp_c->recv( tcp_c->callback_arg, tcp_c, (void*)data, app_data_length);
+    if( tcp_c->out_of_order_nb )
+    {
+      reassembly_err = tcp_reassemble(tcp_c);
+      if( reassembly_err ) { err = reassembly_err;}
+      if( tcp_c->remote_ACK_counter ) //The segment fills a hole: the peer device learns it at once (RFC 5681).
+      {
+        reassembly_err = tcp_send_control (tcp_c, &tcp_c->control_segment, TCP_ACK, NULL, 0);
+        if( reassembly_err ) { err = reassembly_err;}
+        tcp_c->remote_ACK_counter = 0;
+      }
+    }
+  }
+  return err;
+}
+
+/*!
+ * Function name: tcp_store_out_of_order
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param data : [in] Data of the segment.
+ * \param seqno : [in] Sequence number of the segment, after "remote_seqno".
+ * \param length : [in] Length of the data.
+ * \brief Keep a segment received after a hole in "rcv_ring" until the hole
+ * is filled. "rcv_ring_start" holds "remote_seqno", the segment is copied 
+ * at its distance from "remote_seqno" (wrapping around the ring). 
+ * The ring is borrowed from the adapter (TCP_RCV_RING_POOL) with the first
+ * segment waiting. cIPS drops the segment if no ring is left, if it does 
+ * not fit in the advertised window or if MAX_TCP_OUT_OF_ORDER segments are
+ * already waiting: the peer device will retransmit it.
+ * *******************************************************************/
+static void tcp_store_out_of_order(TCP_T* const tcp_c, const u8_t* const data, const u32_t seqno, const u32_t length)
+{
+  u32_t offset = (seqno - tcp_c->remote_seqno) & TCP_SEQ_MASK;
+  u32_t index;
+  u32_t first_part;
+  u32_t i;
+  bool_t stored = FALSE;
+
+  for( i = 0; i < tcp_c->out_of_order_nb; i++)
+  {
+    if( (tcp_c->out_of_order[i].seqno == seqno) && (tcp_c->out_of_order[i].length >= length) )
+    { stored = TRUE;} //Retransmitted.
+  }
+  if( (tcp_c->rcv_ring == NULL) && (tcp_c->netif->tcp_rcv_ring_free != NULL) )
+  { //The first segment after a hole: borrow a ring. Its content does not matter, "rcv_ring_start" still holds "remote_seqno".
+    tcp_c->rcv_ring = tcp_c->netif->tcp_rcv_ring_free;
+    tcp_c->netif->tcp_rcv_ring_free = tcp_c->rcv_ring->next;
+  }
+  if( !stored && (tcp_c->rcv_ring != NULL) && (offset + length <= (u32_t)tcp_c->local_wnd) && (tcp_c->out_of_order_nb < MAX_TCP_OUT_OF_ORDER) )
+  {
+    index = TCP_RING_INDEX(tcp_c->rcv_ring_start + offset);
+    first_part = (index + length > TCP_WND)? TCP_WND - index : length;
+    (void)tcp_memcpy(tcp_c->rcv_ring->data + index, data, first_part);
+    (void)tcp_memcpy(tcp_c->rcv_ring->data, data + first_part, length - first_part);
+    tcp_c->out_of_order[tcp_c->out_of_order_nb].seqno = seqno;
+    tcp_c->out_of_order[tcp_c->out_of_order_nb].length = length;
+    tcp_c->out_of_order_nb++;
+    tcp_c->sack_recent = seqno;
+    stored = TRUE;
+  }
+  if( !tcp_c->out_of_order_nb ) { tcp_return_rcv_ring(tcp_c);}
+  T_DEBUGF(TCP_DEBUG, ("%s#%d: TCP segment #0x%lx out of order (expected #0x%lx) %s\r\n",tcp_c->netif->name, tcp_c->local_port, seqno, tcp_c->remote_seqno, (stored)? "stored" : "dropped"));
+  return;
+}
+
+/*!
+ * Function name: tcp_reassemble
+ * \return ERR_OK or the error of the tcp_c->recv() callback.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief The data up to "remote_seqno" are in order. The segments stored
+ * out of order that start before "remote_seqno" are now in order too:
+ * the application receives them from "rcv_ring" (in two parts if they
+ * wrap around the ring) and "remote_seqno" moves to their end. Once no
+ * segment waits, the ring goes back to the adapter.
+ * *******************************************************************/
+static err_t tcp_reassemble(TCP_T* const tcp_c)
+{
+  TCP_OUT_OF_ORDER_T* segment;
+  u32_t end;
+  u32_t length;
+  u32_t index;
+  u32_t first_part;
+  u32_t i = 0;
+  err_t err = ERR_OK;
+  err_t recv_err;
+
+  while( i < tcp_c->out_of_order_nb )
+  {
+    segment = &tcp_c->out_of_order[i];
+    if( !TCP_SEQ_GT(segment->seqno, tcp_c->remote_seqno) )
+    {
+      end = (segment->seqno + segment->length) & TCP_SEQ_MASK;
+      *segment = tcp_c->out_of_order[--(tcp_c->out_of_order_nb)]; //Remove it.
+      if( TCP_SEQ_GT(end, tcp_c->remote_seqno) )
+      {
+        length = (end - tcp_c->remote_seqno) & TCP_SEQ_MASK;
+        index = tcp_c->rcv_ring_start;
+        first_part = (index + length > TCP_WND)? TCP_WND - index : length;
+        tcp_c->remote_seqno = end;
+        tcp_c->rcv_ring_start = TCP_RING_INDEX(index + length);
+        recv_err = tcp_c->recv( tcp_c->callback_arg, tcp_c, (void*)(tcp_c->rcv_ring->data + index), first_part);
+        if( (!recv_err) && (length != first_part) && (tcp_c->rcv_ring != NULL) ) //The callback may have aborted the connection.
+        { recv_err = tcp_c->recv( tcp_c->callback_arg, tcp_c, (void*)tcp_c->rcv_ring->data, length - first_part);}
+        if( recv_err ) { err = recv_err;}
+      }
+      i = 0; //"remote_seqno" has moved: scan again.
+    }
+    else
+    { i++;}
+  }
+  if( !tcp_c->out_of_order_nb ) { tcp_return_rcv_ring(tcp_c);} //The hole is filled: the ring goes back to the adapter.
+  return err;
+}
+
+/*!
+ * Function name: tcp_send_control
+ * \return ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER.
  * \param tcp_c : [in/out] tcp_c of interest.
  * \param segment : [in/out] TCP segment containing the outgoing ethernet frame.
  * \param control_bits : [in] TCP flags.
  * \param options : [in] TCP options.
  * \param options_length : [in] TCP options length in bytes.
  * \brief Build and send a TCP control frame (SYN, ACK, RST...).
+ * Once negotiated, the timestamps go in every frame but a reset, and an 
+ * ACK carries SACK blocks while segments wait out of order.
  * *******************************************************************/
 static err_t tcp_send_control (TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment,
        const u8_t control_bits, const u8_t* const options, const u8_t options_length)
 {
+  u8_t negotiated_options[TCP_MAX_OPTIONS_LENGTH];
+  const u8_t* frame_options = options;
+  u8_t frame_options_length = options_length;
   err_t err;
 
+  if( (options == NULL) && ((control_bits & TCP_RST) == 0) && (TCP_TIMESTAMPS_ENABLED(tcp_c) || TCP_SACK_ENABLED(tcp_c)) )
+  {
+    frame_options_length = 0;
+    if( TCP_TIMESTAMPS_ENABLED(tcp_c) )
+    { frame_options_length += tcp_format_timestamps_option(tcp_c->netif, tcp_c->ts_recent, negotiated_options);}
+    if( (control_bits == TCP_ACK) && tcp_c->out_of_order_nb && TCP_SACK_ENABLED(tcp_c) )
+    { //Report the segments received after the hole (RFC 2018).
+      frame_options_length += tcp_format_sack_option(tcp_c, negotiated_options + frame_options_length);
+    }
+    frame_options = (frame_options_length)? negotiated_options : NULL;
+  }
   //1.Build the ethernet frame
-  err = tcp_build_control_ethernet_frame (tcp_c, segment, control_bits, options, options_length);
+  err = tcp_build_control_ethernet_frame (tcp_c, segment, control_bits, frame_options, frame_options_length);
   if(!err)
   {
     //2.Send the frame to the network
-    err = netif_send(tcp_c->netif, segment->frame, ETH_IP_TCP_HEADER_SIZE+options_length);
+    err = netif_send(tcp_c->netif, segment->frame, ETH_IP_TCP_HEADER_SIZE+frame_options_length);
   }
   return err;
 }
@@ -1422,6 +2644,9 @@ static err_t tcp_reset (TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment, co
  * \param options_length : [in] TCP options length in bytes.
  * \brief Build a TCP control frame (SYN, ACK, RST...).
  * \note A TCP control frame has no data.
+ * \note If the segment already holds a control frame without options, 
+ * its checksum is updated with the fields that change (RFC1624) instead 
+ * of being calculated again.
  * *******************************************************************/
 err_t tcp_build_control_ethernet_frame (TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment,
        const u8_t control_bits, const u8_t* const options, const u8_t options_length)
@@ -1430,35 +2655,61 @@ err_t tcp_build_control_ethernet_frame (TCP_T* const tcp_c, TCP_SENDING_SEG_T* c
   err_t err = ERR_OK;
   u8_t* frame = segment->frame;
 
-  // Build TCP header :  only update the fields that are not constant
   tcphdr = (TCP_HEADER_T *)(frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T));
-  tcphdr->seqno = htonl(tcp_c->local_seqno);
-  tcphdr->ackno = htonl(tcp_c->remote_seqno);
-  TCP_SET_FLAGS(tcphdr, control_bits);
-  tcphdr->windowsize = htons(tcp_c->local_wnd);// advertise our receive window size in this TCP segment
-  tcphdr->chksum = 0; //reset checksum (because the buffer is not erased before being reused)
-  tcphdr->urgent_ptr = 0;
-  // Copy the options into the header, if they are present.
-  if (options == NULL)
-  { TCP_SET_HEADER_LENGTH(tcphdr, sizeof(TCP_HEADER_T));}
-  else 
-  { 
-    TCP_SET_HEADER_LENGTH(tcphdr, sizeof(TCP_HEADER_T) + options_length);
-    tcp_memcpy(frame + sizeof(TCP_HEADER_T) + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T), options, options_length);
-  }
 
+  if( (options == NULL) && segment->header_only && !TCP_TX_OFFLOAD(tcp_c) )
   {
-    u32_t checksum;
-    checksum = eth_build_pseudo_header( tcp_c->remote_ip, tcp_c->local_ip, options_length, sizeof(TCP_HEADER_T), IP_TCP);
-    checksum += ip_checksum((const u16_t*)tcphdr, sizeof(TCP_HEADER_T) + options_length); // length contains the standard header + the options
-    //Fold 32-bit sum to 16 bits and add carry
-    while( checksum >> 16) {
-      checksum = (checksum & 0xFFFF) + (checksum >> 16);
+    //The previous frame was a complete header without options (an ACK most of the time).
+    //Only the sequence numbers, the flags and the window change: update the checksum with them.
+    u32_t seqno = htonl(tcp_c->snd_nxt);
+    u32_t ackno = htonl(tcp_c->remote_seqno);
+    u16_t windowsize = htons(tcp_advertised_window(tcp_c, control_bits));
+    u16_t data_offset_flags = tcphdr->data_offset_flags;
+    u16_t checksum = tcphdr->chksum;
+
+    checksum = ip_checksum_update32( checksum, tcphdr->seqno, seqno);
+    checksum = ip_checksum_update32( checksum, tcphdr->ackno, ackno);
+    checksum = ip_checksum_update16( checksum, tcphdr->windowsize, windowsize);
+    TCP_SET_FLAGS(tcphdr, control_bits);
+    checksum = ip_checksum_update16( checksum, data_offset_flags, tcphdr->data_offset_flags);
+    tcphdr->seqno = seqno;
+    tcphdr->ackno = ackno;
+    tcphdr->windowsize = windowsize;
+    tcphdr->chksum = checksum;
+  }
+  else
+  {
+    // Build TCP header :  only update the fields that are not constant
+    tcphdr->seqno = htonl(tcp_c->snd_nxt); //The bytes written and not sent yet do not count.
+    tcphdr->ackno = htonl(tcp_c->remote_seqno);
+    TCP_SET_FLAGS(tcphdr, control_bits);
+    tcphdr->windowsize = htons(tcp_advertised_window(tcp_c, control_bits));// advertise our receive window size in this TCP segment
+    tcphdr->chksum = 0; //reset checksum (because the buffer is not erased before being reused)
+    tcphdr->urgent_ptr = 0;
+    // Copy the options into the header, if they are present.
+    if (options == NULL)
+    { TCP_SET_HEADER_LENGTH(tcphdr, sizeof(TCP_HEADER_T));}
+    else 
+    { 
+      TCP_SET_HEADER_LENGTH(tcphdr, sizeof(TCP_HEADER_T) + options_length);
+      tcp_memcpy(frame + sizeof(TCP_HEADER_T) + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T), options, options_length);
     }
 
-    tcphdr->chksum = (~((u16_t)checksum)); //checksum is the one's complement of the calculated ckecksum. Note: checksum and tcphdr->chksum are big endian.
+    if( !TCP_TX_OFFLOAD(tcp_c) ) //Otherwise the adapter inserts the checksum.
+    {
+      u32_t checksum;
+      checksum = ip_pseudo_header_length( tcp_c->pseudo_sum, options_length + sizeof(TCP_HEADER_T));
+      checksum += ip_checksum((const u16_t*)(frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T)), sizeof(TCP_HEADER_T) + options_length); // length contains the standard header + the options
+      //Fold 32-bit sum to 16 bits and add carry
+      while( checksum >> 16) {
+        checksum = (checksum & 0xFFFF) + (checksum >> 16);
+      }
+
+      tcphdr->chksum = (~((u16_t)checksum)); //checksum is the one's complement of the calculated ckecksum. Note: checksum and tcphdr->chksum are big endian.
+    }
+    segment->header_only = (options == NULL);
   }
-  if( tcphdr->chksum == 0 ) // chksum zero must become 0xffff, as zero means 'no checksum' 
+  if( (tcphdr->chksum == 0) && !TCP_TX_OFFLOAD(tcp_c) ) // chksum zero must become 0xffff, as zero means 'no checksum' 
   {
     tcphdr->chksum = (u16_t)0xFFFF;
   }
@@ -1485,216 +2736,541 @@ static void tcp_need_acknowledgment (TCP_SENDING_SEG_T* segment, const u32_t app
 {
   segment->len = app_AND_option_len + sizeof(TCP_HEADER_T) + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T);
 //  segment->state = TCP_SEG_UNACKED; //This is done in "segment_change_state"
-  segment->ack_no = seqno;
+  segment->ack_no = seqno & TCP_SEQ_MASK;
   T_DEBUGF(TCP_DEBUG, ("Registers ACK#0x%x in database\r\n", (unsigned int)seqno));
   return;
 }
 
 /*!
- * Function name: tcp_create_child
- * \return nothing ERR_TCP_MEM, ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER
+ * Function name: tcp_listen_syn
+ * \return ERR_OK, ERR_TCP_MEM, ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER
+ * \param tcp_c : [in] Server tcp_c.
+ * \param ip_frame : [in] SYN beginning with the IP header.
+ * \brief A peer device client connects to a cIPS TCP server. The server
+ * answers with a SYN|ACK and keeps the request in the SYN backlog of the
+ * adapter: no TCP controller is allocated until the final ACK (see 
+ * tcp_listen_ack()). A retransmitted SYN reuses its request. Once the 
+ * backlog is full, the request is encoded in the sequence number of the
+ * SYN|ACK (SYN cookie, TCP_SYN_COOKIES): a burst of SYNs cannot lock the
+ * server out. Without the random secret of netif_syn_secret(), the SYN is
+ * dropped instead.
+ * *******************************************************************/
+static err_t tcp_listen_syn(TCP_T* const tcp_c, const u8_t* const ip_frame)
+{
+  struct NETIF_S* net_adapter = tcp_c->netif;
+  const IP_HEADER_T* iphdr = (const IP_HEADER_T*)ip_frame;
+  const TCP_HEADER_T* tcphdr = (const TCP_HEADER_T*)(ip_frame + IP_GET_HEADER_LENGTH(iphdr));
+  const ETHER_HEADER_T* ethhdr = (const ETHER_HEADER_T*)(ip_frame - sizeof(ETHER_HEADER_T));
+  u32_t remote_ip = ntohl(iphdr->source_addr);
+  u16_t remote_port = ntohs(tcphdr->source_port);
+  TCP_SYN_T cookie;
+  TCP_SYN_T* syn;
+  bool_t new_request = FALSE;
+  u32_t mss_index = 0;
+  u32_t i;
+  err_t err = ERR_OK;
+
+  T_ASSERT(("%s#%d Register a callback with tcp_accept() on TCP controller 0x%lx\r\n",__func__, __LINE__, (u32_t)tcp_c), tcp_c->accept != NULL);
+
+  syn = tcp_syn_lookup(net_adapter, tcp_c, remote_ip, remote_port);
+  if( (syn == NULL) || (syn->irs != ntohl(tcphdr->seqno)) ) //Otherwise the SYN|ACK has been lost: the request is answered again.
+  {
+    new_request = TRUE;
+    if( syn == NULL ) { syn = tcp_syn_alloc(net_adapter);}
+    if( (syn == NULL) && TCP_SYN_COOKIES_ON(net_adapter) ) { syn = &cookie;}
+  }
+  if( syn != NULL )
+  {
+    if( new_request )
+    {
+      syn->server = tcp_c;
+      syn->remote_ip = remote_ip;
+      syn->remote_port = remote_port;
+      for( i = 0; i < MAC_ADDRESS_LENGTH; i++)
+      { syn->remote_mac[i] = ethhdr->source_addr[i];}
+      syn->irs = ntohl(tcphdr->seqno);
+      syn->remote_wnd = ntohs(tcphdr->windowsize);
+      tcp_parse_syn_options(tcphdr, syn);
+      while( (mss_index < TCP_SYN_COOKIE_MSS_MASK) && (tcp_syn_cookie_mss[mss_index + 1] <= syn->remote_mss) )
+      { mss_index++;}
+      syn->iss = (tcp_syn_cookie(net_adapter, tcp_c, remote_ip, remote_port, syn->irs, TCP_SYN_COOKIE_TIME(net_adapter->tcp_clock)) & ~TCP_SYN_COOKIE_MSS_MASK) | mss_index;
+      syn->expiry = net_adapter->tcp_clock + TCP_SYN_RCVD_TIMEOUT;
+      if( syn == &cookie ) //Only the MSS survives in a cookie: the SYN|ACK offers no other option.
+      {
+        syn->peer_options = 0;
+        syn->ts_recent = 0;
+        T_DEBUGF(TCP_DEBUG, ("%s#%d: SYN backlog full, SYN cookie sent\r\n", net_adapter->name, tcp_c->local_port));
+      }
+    }
+    err = tcp_syn_send(tcp_c, syn);
+  }
+  else
+  {
+    T_ERROR( ("tcp_listen_syn: SYN backlog full, SYN dropped. Increase TCP_SYN_BACKLOG (>%d) or give a secret to the SYN cookies (netif_syn_secret())\r\n", TCP_SYN_BACKLOG));
+    err = tcp_store_error( ERR_TCP_MEM, tcp_c, __func__, __LINE__);
+  }
+  return err;
+}
+
+/*!
+ * Function name: tcp_listen_ack
+ * \return ERR_OK, ERR_TCP_MEM, ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER
  * \param tcp_c : [in] Server tcp_c.
  * \param ip_frame : [in] frame beginning with the IP header.
+ * \param tcphdr : [in] TCP header of the frame.
+ * \param app_data_length : [in] Length of application data.
+ * \brief The peer device acknowledges the SYN|ACK of a server: the 
+ * request of the SYN backlog, or the SYN cookie the acknowledgment number
+ * holds, becomes a child controller (tcp_create_child()). The other 
+ * segments are dropped.
+ * *******************************************************************/
+static err_t tcp_listen_ack(TCP_T* const tcp_c, const u8_t* const ip_frame, TCP_HEADER_T* const tcphdr, const u32_t app_data_length)
+{
+  struct NETIF_S* net_adapter = tcp_c->netif;
+  const IP_HEADER_T* iphdr = (const IP_HEADER_T*)ip_frame;
+  const ETHER_HEADER_T* ethhdr = (const ETHER_HEADER_T*)(ip_frame - sizeof(ETHER_HEADER_T));
+  u32_t remote_ip = ntohl(iphdr->source_addr);
+  u16_t remote_port = ntohs(tcphdr->source_port);
+  u32_t iss = (ntohl(tcphdr->ackno) - 1) & TCP_SEQ_MASK;
+  u32_t period = TCP_SYN_COOKIE_TIME(net_adapter->tcp_clock);
+  TCP_SYN_T cookie;
+  TCP_SYN_T* syn;
+  TCP_T* ntcp_c;
+  u32_t i;
+  err_t err = ERR_OK;
+
+  syn = tcp_syn_lookup(net_adapter, tcp_c, remote_ip, remote_port);
+  if( (syn != NULL) && (syn->iss != iss) )
+  { syn = NULL;} //Not the acknowledgment of the SYN|ACK.
+  else if( (syn == NULL) && TCP_SYN_COOKIES_ON(net_adapter) )
+  {
+    cookie.irs = (ntohl(tcphdr->seqno) - 1) & TCP_SEQ_MASK;
+    for( i = 0; (i < 2) && (syn == NULL); i++) //The cookie of this period or of the previous one.
+    {
+      if( ((tcp_syn_cookie(net_adapter, tcp_c, remote_ip, remote_port, cookie.irs, period - i) ^ iss) & ~TCP_SYN_COOKIE_MSS_MASK & TCP_SEQ_MASK) == 0 )
+      { syn = &cookie;}
+    }
+    if( syn != NULL )
+    {
+      cookie.server = tcp_c;
+      cookie.remote_ip = remote_ip;
+      cookie.remote_port = remote_port;
+      for( i = 0; i < MAC_ADDRESS_LENGTH; i++)
+      { cookie.remote_mac[i] = ethhdr->source_addr[i];}
+      cookie.iss = iss;
+      cookie.remote_wnd = ntohs(tcphdr->windowsize); //No window scale with a cookie.
+      cookie.remote_mss = tcp_syn_cookie_mss[iss & TCP_SYN_COOKIE_MSS_MASK];
+      cookie.peer_options = 0;
+      cookie.snd_wnd_scale = 0;
+      cookie.ts_recent = 0;
+    }
+  }
+
+  if( syn != NULL )
+  {
+    ntcp_c = tcp_create_child(tcp_c, syn, &err);
+    if( (err != ERR_TCP_MEM) && (syn != &cookie) ) //Without controller, the request waits for the next ACK.
+    { tcp_syn_free(net_adapter, syn);}
+    if( ntcp_c != NULL )
+    { //SYN_RCVD -> ESTABLISHED
+      if( TCP_GET_HEADER_LENGTH(tcphdr) > sizeof(TCP_HEADER_T) ) { (void)tcp_parse_options(ntcp_c, tcphdr);}
+      err = tcp_process_network_events(ntcp_c, ntohs(tcphdr->data_offset_flags), tcphdr, app_data_length);
+    }
+  }
+  else
+  {
+    net_adapter->unmatched_nb++;
+    T_DEBUGF(TCP_DEBUG, ("%s#%d:TCP: no connection request, frame dropped\r\n", net_adapter->name, tcp_c->local_port));
+  }
+  return err;
+}
+
+/*!
+ * Function name: tcp_create_child
+ * \return the child controller, NULL if none has been created.
+ * \param tcp_c : [in] Server tcp_c.
+ * \param syn : [in] Request completed by the peer device.
+ * \param err : [out] ERR_OK, ERR_TCP_MEM if no controller is free, the
+ * error of the accept callback if the application refuses the client.
  * \brief A peer device client connects to a cIPS TCP server. The TCP server 
- * creates a child controller with tcp_create_child().
+ * creates a child controller with tcp_create_child() once the handshake
+ * completes. The child is in SYN_RCVD: the final ACK moves it to ESTABLISHED.
  * \note tcp_create_child() calls tcp_c->accept() so that the 
- * application can customize and work with the new connection.
+ * application can customize and work with the new connection. If the 
+ * application refuses it, the peer device is reset.
  * *******************************************************************/
-static err_t tcp_create_child(TCP_T *tcp_c, u8_t* ip_frame)
+static TCP_T* tcp_create_child(TCP_T *tcp_c, const TCP_SYN_T* const syn, err_t* const err)
 {
   TCP_T *ntcp_c; //Child tcp_c
-  u32_t options;
-  err_t err = ERR_OK;
-  IP_HEADER_T* iphdr = (IP_HEADER_T*) ip_frame;
-  TCP_HEADER_T* tcphdr = (TCP_HEADER_T *)(ip_frame + sizeof(IP_HEADER_T));
-
-  T_ASSERT(("%s#%d Register a callback with tcp_accept() on TCP controller 0x%lx\r\n",__func__, __LINE__, (u32_t)tcp_c), tcp_c->accept != NULL);
-  (void)tcp_remove_server_child_cs(tcp_c->netif); //garbage collector
 
   ntcp_c = tcp_alloc( tcp_c->netif, TCP_NON_PERSISTENT);
   if(ntcp_c != NULL)
   {
     ntcp_c->local_ip = tcp_c->local_ip;
-    ntcp_c->remote_ip = ntohl(iphdr->source_addr);
+    ntcp_c->remote_ip = syn->remote_ip;
     ntcp_c->state = SYN_RCVD;
     ntcp_c->callback_arg = tcp_c->callback_arg;
     ntcp_c->local_port = tcp_c->local_port;
-    ntcp_c->remote_port = ntohs(tcphdr->source_port); //tcphdr points to the incoming frame which is big endian.
-    ntcp_c->remote_seqno = ntohl(tcphdr->seqno)+1;
-    ntcp_c->remote_wnd = ntohs(tcphdr->windowsize);
-    ntcp_c->remote_mss = 0;
+    ntcp_c->remote_port = syn->remote_port;
+    ntcp_c->remote_seqno = (syn->irs + 1) & TCP_SEQ_MASK;
+    ntcp_c->remote_wnd = syn->remote_wnd;
+    ntcp_c->local_seqno = (syn->iss + 1) & TCP_SEQ_MASK; //Note: increment for TCP_SYN or TCP_FIN but not for TCP_ACK
+    ntcp_c->snd_una = ntcp_c->local_seqno;
+    ntcp_c->snd_nxt = ntcp_c->local_seqno;
+    ntcp_c->recover = ntcp_c->local_seqno;
     ntcp_c->nb_of_500ms = tcp_c->nb_of_500ms;
     ntcp_c->type = TCP_NON_PERSISTENT; //type: TCP_PERSISTENT or TCP_NON_PERSISTENT
+    ntcp_c->cc = tcp_c->cc; //The child inherits the congestion control of the server.
+    tcp_apply_syn_options(ntcp_c, syn);
+    //Initialize fields that are staying constant for the life of the connection
+    (void)segment_init_connection (ntcp_c, syn->remote_mac);
+
+    *err = tcp_c->accept(ntcp_c->callback_arg,ntcp_c);
+    if(!*err)
+    {
+      tcp_register(&(tcp_c->netif->tcp_active_cs), ntcp_c);
+      tcp_state_timer(ntcp_c);
+    }
+    else //The application refuses the client: the peer device is reset and the child goes back to the free controllers.
+    {
+      (void)tcp_send_control (ntcp_c, &ntcp_c->control_segment, TCP_RST, NULL, 0);
+      (void)tcp_remove(&(tcp_c->netif->tcp_active_cs), ntcp_c);
+      ntcp_c = NULL;
+    }
+  }
+  else
+  {
+    T_ERROR( ("tcp_listen_input: could not allocate TCP controller\r\n"));
+    *err =tcp_store_error( ERR_TCP_MEM, tcp_c, __func__, __LINE__);
+  }
+  return ntcp_c;
+}
+
+/*!
+ * Function name: tcp_syn_send
+ * \return ERR_OK, ERR_DEVICE_DRIVER
+ * \param tcp_c : [in] Server tcp_c.
+ * \param syn : [in] Request to answer.
+ * \brief Send the SYN|ACK of a request from the frame of the adapter
+ * ("tcp_syn_frame"): the request has no controller, hence no segment.
+ * *******************************************************************/
+static err_t tcp_syn_send(const TCP_T* const tcp_c, const TCP_SYN_T* const syn)
+{
+  struct NETIF_S* net_adapter = tcp_c->netif;
+  u8_t* frame = net_adapter->tcp_syn_frame;
+  TCP_HEADER_T* tcphdr = (TCP_HEADER_T *)(frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T));
+  u8_t options_length;
+  u32_t checksum;
+  err_t err;
+
+  //1. Ethernet part
+  (void)eth_build_frame( syn->remote_mac, net_adapter->mac_address, arp_get_route(syn->remote_ip, net_adapter->gateway_addr, net_adapter->netmask), tcp_c->local_ip, frame, ETH_ETHERNET);
+  //2. TCP part: the MSS option, and the options that the peer device offered.
+  options_length = tcp_format_syn_options(net_adapter, TCP_LOCAL_MSS, syn->ts_recent, frame + ETH_IP_TCP_HEADER_SIZE, syn->peer_options);
+  tcphdr->source_port = htons(tcp_c->local_port);
+  tcphdr->dest_port = htons(syn->remote_port);
+  tcphdr->seqno = htonl(syn->iss);
+  tcphdr->ackno = htonl(syn->irs + 1);
+  tcphdr->data_offset_flags = 0;
+  TCP_SET_HEADER_LENGTH(tcphdr, sizeof(TCP_HEADER_T) + options_length);
+  TCP_SET_FLAGS(tcphdr, (TCP_SYN | TCP_ACK));
+  tcphdr->windowsize = htons(TCP_SYN_WND);
+  tcphdr->chksum = 0;
+  tcphdr->urgent_ptr = 0;
+  if( !(net_adapter->checksum_offload & NETIF_CHECKSUM_TX_TCP) ) //Otherwise the adapter inserts the checksum.
+  {
+    checksum = ip_pseudo_header_length( ip_pseudo_header_sum(syn->remote_ip, tcp_c->local_ip, IP_TCP), sizeof(TCP_HEADER_T) + options_length);
+    checksum += ip_checksum((const u16_t*)(frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T)), sizeof(TCP_HEADER_T) + options_length);
+    //Fold 32-bit sum to 16 bits and add carry
+    while( checksum >> 16) {
+      checksum = (checksum & 0xFFFF) + (checksum >> 16);
+    }
+    tcphdr->chksum = (~((u16_t)checksum));
+    if( tcphdr->chksum == 0 ) { tcphdr->chksum = (u16_t)0xFFFF;}
+  }
+  //3. IP part
+  (void)eth_build_ip_request( syn->remote_ip, tcp_c->local_ip, frame + sizeof(ETHER_HEADER_T), sizeof(TCP_HEADER_T) + options_length, IP_TCP, FALSE);
+  err = netif_send(net_adapter, frame, ETH_IP_TCP_HEADER_SIZE + options_length);
+  return err;
+}
+
+/*!
+ * Function name: tcp_syn_lookup
+ * \return the request, NULL if none.
+ * \param net_adapter : [in] adapter of interest.
+ * \param tcp_c : [in] Server tcp_c.
+ * \param remote_ip : [in] IP address of the peer device.
+ * \param remote_port : [in] Port of the peer device.
+ * \brief Find the request of a peer device in the SYN backlog. The 
+ * backlog is short (TCP_SYN_BACKLOG): it is browsed.
+ * *******************************************************************/
+static TCP_SYN_T* tcp_syn_lookup(const struct NETIF_S* const net_adapter, const TCP_T* const tcp_c, const u32_t remote_ip, const u16_t remote_port)
+{
+  TCP_SYN_T* syn = net_adapter->tcp_syn_cs;
 
-    { //Initialize fields that are staying constant for the life of the connection
-      ETHER_HEADER_T* ethhdr = (ETHER_HEADER_T*) (ip_frame - sizeof(ETHER_HEADER_T));
-      (void)segment_init_connection (ntcp_c, ethhdr->source_addr);
-    }
+  while( (syn != NULL) && ((syn->server != tcp_c) || (syn->remote_ip != remote_ip) || (syn->remote_port != remote_port)) )
+  { syn = syn->next;}
+  return syn;
+}
+
+/*!
+ * Function name: tcp_syn_alloc
+ * \return a request of the SYN backlog, NULL if it is full.
+ * \param net_adapter : [in/out] adapter of interest.
+ * \brief Take a free request, or else reuse the oldest request whose 
+ * TCP_SYN_RCVD_TIMEOUT has expired. The request joins "tcp_syn_cs".
+ * *******************************************************************/
+static TCP_SYN_T* tcp_syn_alloc(struct NETIF_S* const net_adapter)
+{
+  TCP_SYN_T* syn = net_adapter->tcp_syn_free;
+  TCP_SYN_T** link;
 
-    err = tcp_c->accept(ntcp_c->callback_arg,ntcp_c);
-    if(!err)
+  if( syn != NULL )
+  { net_adapter->tcp_syn_free = syn->next;}
+  else
+  { //The requests are added at the head: the last expired one is the oldest.
+    for( link = &(net_adapter->tcp_syn_cs); *link != NULL; link = &((*link)->next))
     {
-      tcp_register(&(tcp_c->netif->tcp_active_cs), ntcp_c);
-      if(TCP_GET_HEADER_LENGTH(tcphdr) > sizeof(TCP_HEADER_T))
-      {
-        ntcp_c->remote_mss = tcp_parse_options(ip_frame+ sizeof(IP_HEADER_T) + sizeof(TCP_HEADER_T));/* Parse any options in the SYN. */
-        if( ntcp_c->remote_mss >= TCP_MTU) { ntcp_c->remote_mss = TCP_MTU; } //cap to what the adapter can send.
-      }
-      // Build an MSS option.
-      options = tcp_format_max_segment_size_option(ntcp_c->local_mss);
-      // Send a SYN|ACK together with the MSS option.
-      err = tcp_send_control (ntcp_c, &ntcp_c->control_segment, TCP_SYN|TCP_ACK, (u8_t *)&options, sizeof(options));
-      ntcp_c->local_seqno++; //Note: increment for TCP_SYN or TCP_FIN but not for TCP_ACK
+      if( !U32_BEFORE(net_adapter->tcp_clock, (*link)->expiry) ) { syn = *link;}
     }
+    if( syn != NULL ) { tcp_syn_free(net_adapter, syn); net_adapter->tcp_syn_free = syn->next;}
   }
-  else
+  if( syn != NULL )
   {
-    T_ERROR( ("tcp_listen_input: could not allocate TCP controller\r\n"));
-    err =tcp_store_error( ERR_TCP_MEM, tcp_c, __func__, __LINE__);
+    syn->next = net_adapter->tcp_syn_cs;
+    net_adapter->tcp_syn_cs = syn;
   }
-  return err;
+  return syn;
 }
 
-
 /*!
- * Function name: tcp_remove_server_child_cs
- * \return nothing
- * \param net_adapter : [in] Adapter of interest.
- * \brief This is a kind of garbage collector. CIPS reuses
- * the controllers. tcp_remove_server_child_cs() identifies the 
- * controller that are not used anymore. The criteria is the flag 
- * "TCP_SERVER_CHILD" and the state "CLOSED".
+ * Function name: tcp_syn_free
+ * \return nothing.
+ * \param net_adapter : [in/out] adapter of interest.
+ * \param syn : [in/out] Request of "tcp_syn_cs".
+ * \brief The request leaves the SYN backlog: it goes back to "tcp_syn_free".
  * *******************************************************************/
-static void tcp_remove_server_child_cs( struct NETIF_S* net_adapter )
+static void tcp_syn_free(struct NETIF_S* const net_adapter, TCP_SYN_T* const syn)
 {
-  TCP_T *tcp_c_i;
-  int i;
-  TCP_T* tcp_c_list = net_adapter->tcp_c_list;
+  TCP_SYN_T** link = &(net_adapter->tcp_syn_cs);
 
-  for( i = 0; i < MAX_TCP; i++)
+  while( (*link != NULL) && (*link != syn) )
+  { link = &((*link)->next);}
+  if( *link == syn )
   {
-    tcp_c_i = &(tcp_c_list[i]);
-    if( (tcp_c_i->type == TCP_NON_PERSISTENT) && (tcp_c_i->state == CLOSED))
-    {
-      tcp_c_i->id = UNUSED;
-    }
+    *link = syn->next;
+    syn->next = net_adapter->tcp_syn_free;
+    net_adapter->tcp_syn_free = syn;
   }
 }
 
 /*!
- * Function name: tcp_order_active_list
+ * Function name: tcp_syn_cookie
+ * \return a 32-bit hash of the request.
+ * \param net_adapter : [in] adapter of interest ("tcp_syn_secret").
+ * \param tcp_c : [in] Server tcp_c.
+ * \param remote_ip : [in] IP address of the peer device.
+ * \param remote_port : [in] Port of the peer device.
+ * \param irs : [in] Sequence number of the SYN of the peer device.
+ * \param period : [in] TCP_SYN_COOKIE_TIME() of the SYN.
+ * \brief The initial sequence number of a server connection: a keyed 
+ * hash of the request that the peer device cannot guess. The low bits 
+ * (TCP_SYN_COOKIE_MSS_MASK) are replaced by the MSS of a SYN cookie.
+ * *******************************************************************/
+static u32_t tcp_syn_cookie(const struct NETIF_S* const net_adapter, const TCP_T* const tcp_c, const u32_t remote_ip, const u16_t remote_port, const u32_t irs, const u32_t period)
+{
+  u32_t hash = net_adapter->tcp_syn_secret;
+
+  hash = tcp_syn_mix(hash ^ remote_ip);
+  hash = tcp_syn_mix(hash ^ (((u32_t)remote_port << 16) | tcp_c->local_port));
+  hash = tcp_syn_mix(hash ^ irs);
+  hash = tcp_syn_mix(hash ^ period);
+  return hash;
+}
+
+/*!
+ * Function name: tcp_syn_mix
+ * \return the mixed hash, 32-bit.
+ * \param hash : [in] hash to mix.
+ * \brief Spread every bit of "hash" over the 32 bits (multiplicative hash).
+ * *******************************************************************/
+static u32_t tcp_syn_mix(const u32_t hash)
+{
+  u32_t mixed = ((hash & TCP_SEQ_MASK) * 0x9E3779B1UL) & TCP_SEQ_MASK;
+  return mixed ^ (mixed >> 15);
+}
+
+/*!
+ * Function name: tcp_register
  * \return nothing
- * \param tcp_active_cs : [out] List of active tcp controllers.
- * \param net_adapter : [in] Adapter of onterest.
- * \brief Re-order the list of TCP clients per adapter.
- * A network adapter supports several TCP clients. When the peer device 
- * sends a TCP frame to an adapter, the adapter forwards the frame to cIPS,
- * then cIPS browses the list of clients in order to find a match.
- * The browsing is faster if the TCP controllers used are at the 
- * beginning of the list. tcp_order_active_list() puts the TCP
- * controller used at the beginning of the list.
+ * \param tcp_active_cs : [out] List of active controllers ("tcp_active_cs") or of servers ("tcp_server_cs").
+ * \param tcp_c : [in] tcp_c of interest, tcp_c->id must be set to a different value of
+ * UNUSED to register the tcp_c.
+ * \brief Add the controller to the list in O(1) and hash it: on (remote
+ * IP, remote port, local port) for a connection, on the local port for a
+ * server (see tcp_lookup()). An active controller starts its inactivity
+ * check.
  * *******************************************************************/
-static void tcp_order_active_list( TCP_T** tcp_active_cs, const struct NETIF_S* const net_adapter)
+static void tcp_register( TCP_T** tcp_active_cs,  TCP_T* tcp_c )
 {
-  TCP_T *tcp_c_i;
-  int i;
-  int prec;
-  TCP_T* tcp_c_list = (TCP_T*)net_adapter->tcp_c_list;
+  if( tcp_active_cs == &(tcp_c->netif->tcp_server_cs) )
+  { tcp_hash_insert( &(tcp_c->netif->tcp_listen_hash[TCP_LISTEN_HASH(tcp_c->local_port)]), tcp_c);}
+  else
+  { tcp_hash_insert( &(tcp_c->netif->tcp_hash[TCP_HASH(tcp_c->remote_ip, tcp_c->remote_port, tcp_c->local_port)]), tcp_c);}
+  tcp_list_insert( tcp_active_cs, tcp_c);
+  tcp_c->activity = tcp_c->netif->tcp_clock;
+  tcp_check_timer(tcp_c);
+}
+
+/*!
+ * Function name: tcp_remove
+ * \return nothing
+ * \param tcp_active_cs : [out] List of active conrollers.
+ * \param tcp_c : [in] tcp_c of interest.
+ * \brief Close the controller, cancel its timers and unlink it from the
+ * list in O(1). A controller of type TCP_NON_PERSISTENT is freed at once:
+ * it goes to the list of free controllers ("tcp_free_cs").
+ * *******************************************************************/
+static void tcp_remove( TCP_T** tcp_active_cs,  TCP_T* tcp_c )
+{
+  u32_t i;
 
-  //look for first elt.
-  prec = UNUSED;
-  for( i = 0; i < MAX_TCP; i++)
+  tcp_c->state = CLOSED;
+  (void)segment_init_resource(tcp_c); //reset segments (note: this is also done when the socket is re-allocated)
+  tcp_c->out_of_order_nb = 0;
+  tcp_return_rcv_ring(tcp_c);
+  tcp_c->snd_queued = 0;
+  tcp_return_snd_ring(tcp_c);
+  tcp_hash_remove(tcp_c);
+  for( i = 0; i < TCP_TIMER_NB; i++)
   {
-    tcp_c_i = &(tcp_c_list[i]);
-    if( (tcp_c_i->id != UNUSED) && (tcp_c_i->state != CLOSED))
-    {
-      prec = i; //current elt becomes precedent elt.
-      i = MAX_TCP; // exit loop
-    }
+    tcp_timer_cancel(tcp_c, (tcp_timer_kind)i);
+  }
+  if( tcp_c->list == tcp_active_cs )
+  { tcp_list_remove(tcp_c);}
+  if( (tcp_c->type == TCP_NON_PERSISTENT) && (tcp_c->list == NULL) )
+  { //A child of a server (or a client deleted by tcp_delete()) is not used anymore: cIPS can reuse it.
+    tcp_c->id = UNUSED;
+    tcp_list_insert( &(tcp_c->netif->tcp_free_cs), tcp_c);
   }
+}
 
-  //Set the "active list" to the first elt.
-  *tcp_active_cs = (prec != UNUSED) ? &(tcp_c_list[prec]) : NULL;
+/*!
+ * Function name: tcp_list_insert
+ * \return nothing
+ * \param list : [in/out] "tcp_server_cs", "tcp_active_cs" or "tcp_free_cs" of the adapter.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Put the controller at the head of "list". If it is in another 
+ * list, it leaves it first.
+ * *******************************************************************/
+static void tcp_list_insert( TCP_T** list, TCP_T* tcp_c )
+{
+  tcp_list_remove(tcp_c);
+  tcp_c->prev = NULL;
+  tcp_c->next = *list;
+  if( *list != NULL ) { (*list)->prev = tcp_c;}
+  *list = tcp_c;
+  tcp_c->list = list;
+}
 
-  //build active connection list.
-  for( i = prec+1; i < MAX_TCP; i++)
+/*!
+ * Function name: tcp_list_remove
+ * \return nothing
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Unlink the controller from its list. Nothing happens if it is in
+ * no list. "tcp_c->next" is kept so that a loop that removes the 
+ * controller it processes can go on.
+ * *******************************************************************/
+static void tcp_list_remove( TCP_T* tcp_c )
+{
+  if( tcp_c->list != NULL )
   {
-    tcp_c_i = &(tcp_c_list[i]);
-    if( (tcp_c_i->id != UNUSED) && (tcp_c_i->state != CLOSED))
-    {
-      tcp_c_list[prec].next = tcp_c_i;
-      prec = i; //current elt becomes precedent elt.
-    }
+    if( tcp_c->prev != NULL ) { tcp_c->prev->next = tcp_c->next;}
+    else { *(tcp_c->list) = tcp_c->next;}
+    if( tcp_c->next != NULL ) { tcp_c->next->prev = tcp_c->prev;}
+    tcp_c->prev = NULL;
+    tcp_c->list = NULL;
   }
-  //last elt
-  tcp_c_list[prec].next = NULL;
+}
 
-#ifdef TCP_DEBUG
-  {
-  u32_t unused =0;
-  u32_t used_and_closed =0;
-  u32_t used = 0;
-  int max_display = 7; //Note: Restrict the display to "max_display" in order to limit traces taken by this function.
+/*!
+ * Function name: tcp_hash_insert
+ * \return nothing
+ * \param bucket : [in/out] Bucket of "netif->tcp_hash" or "netif->tcp_listen_hash".
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Put the controller at the head of the chain of "bucket". If it is
+ * already hashed, it leaves its previous bucket first.
+ * *******************************************************************/
+static void tcp_hash_insert( TCP_T** bucket, TCP_T* tcp_c )
+{
+  tcp_hash_remove(tcp_c);
+  tcp_c->hash_next = *bucket;
+  tcp_c->hash_bucket = bucket;
+  *bucket = tcp_c;
+}
 
-  if( MAX_TCP < max_display) { max_display = MAX_TCP;}
+/*!
+ * Function name: tcp_hash_remove
+ * \return nothing
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Unlink the controller from the chain of its bucket. Nothing 
+ * happens if it is not hashed.
+ * *******************************************************************/
+static void tcp_hash_remove( TCP_T* tcp_c )
+{
+  TCP_T** link = tcp_c->hash_bucket;
 
-  T_DEBUGF(TCP_DEBUG, ("TCP pbs : %d elts [index,used ,type]: \r\n",MAX_TCP));
-  for( i = 0; i < max_display; i++)
+  if( link != NULL )
   {
-    T_DEBUGF(TCP_DEBUG, ("[%d,",i));
-    tcp_c_i = &(tcp_c_list[i]);
-    if( tcp_c_i->id == UNUSED)
-    {
-       unused++;
-       T_DEBUGF(TCP_DEBUG, (" UNUSED,"));
-    }
-    else
+    while( (*link != NULL) && (*link != tcp_c) )
     {
-       T_DEBUGF(TCP_DEBUG, (" USED#%d-%d (",tcp_c_i->local_port,tcp_c_i->remote_port));
-       tcp_debug_print_state(tcp_c_i->state);
-       T_DEBUGF(TCP_DEBUG, ("),"));
-      if(tcp_c_i->state == CLOSED)
-      {
-        used_and_closed++;
-      }
-      used++;
+      link = &((*link)->hash_next);
     }
-    if( tcp_c_i->type == TCP_PERSISTENT)
-    { T_DEBUGF(TCP_DEBUG, (" PERS]\r\n"));}
-    else
-    { T_DEBUGF(TCP_DEBUG, (" UNPERS]\r\n"));}
-  }
-    T_DEBUGF(TCP_DEBUG, ("TCP controllers: unused=%ld used_and_closed=%ld used=%ld\r\n",unused,used_and_closed, used));
+    if( *link == tcp_c ) { *link = tcp_c->hash_next;}
+    tcp_c->hash_next = NULL;
+    tcp_c->hash_bucket = NULL;
   }
-#endif //TCP_DEBUG
-  return;
 }
 
 /*!
- * Function name: tcp_register
- * \return nothing
- * \param tcp_active_cs : [out] List of active controllers.
- * \param tcp_c : [in] tcp_c of interest, tcp_c->id must be set to a different value of
- * UNUSED to register the tcp_c.
- * \brief Add the new server to the list of active TCP connections.
+ * Function name: tcp_lookup
+ * \return the connection matching the segment, NULL otherwise.
+ * \param net_adapter : [in] Adapter of interest.
+ * \param remote_ip : [in] Source IP address of the segment.
+ * \param remote_port : [in] Source port of the segment.
+ * \param local_port : [in] Destination port of the segment.
+ * \brief Find the connection of an incoming segment in "net_adapter->tcp_hash".
+ * Only the controllers hashed in the same bucket are compared, whatever 
+ * the number of connections.
  * *******************************************************************/
-static void tcp_register( TCP_T** tcp_active_cs,  TCP_T* tcp_c )
+static TCP_T* tcp_lookup( const struct NETIF_S* const net_adapter, const u32_t remote_ip, const u16_t remote_port, const u16_t local_port)
 {
-  (void) tcp_order_active_list( tcp_active_cs, tcp_c->netif);
+  TCP_T* tcp_c = net_adapter->tcp_hash[TCP_HASH(remote_ip, remote_port, local_port)];
+
+  while( (tcp_c != NULL) && !((tcp_c->local_port == local_port) && (tcp_c->remote_port == remote_port) &&
+         (tcp_c->remote_ip == remote_ip) && (tcp_c->state != CLOSED)) )
+  {
+    tcp_c = tcp_c->hash_next;
+  }
+  return tcp_c;
 }
 
 /*!
- * Function name: tcp_remove
- * \return nothing
- * \param tcp_active_cs : [out] List of active conrollers.
- * \param tcp_c : [in] tcp_c of interest, tcp_c->state must be set to CLOSED to remove the tcp_c.
- * \brief Remove the new server from the list of Tcp listeners by rebuilding the list.
+ * Function name: tcp_lookup_listener
+ * \return the server listening on "local_port", NULL otherwise.
+ * \param net_adapter : [in] Adapter of interest.
+ * \param local_port : [in] Destination port of the segment.
+ * \brief Find the TCP server of an incoming SYN in "net_adapter->tcp_listen_hash".
  * *******************************************************************/
-static void tcp_remove( TCP_T** tcp_active_cs,  TCP_T* tcp_c )
+static TCP_T* tcp_lookup_listener( const struct NETIF_S* const net_adapter, const u16_t local_port)
 {
-  tcp_c->state = CLOSED; //Condition to reorder the active list.
-  (void)segment_init_resource(tcp_c); //reset segments (note: this is also done when the socket is re-allocated)
-  (void) tcp_order_active_list( tcp_active_cs, tcp_c->netif);
+  TCP_T* tcp_c = net_adapter->tcp_listen_hash[TCP_LISTEN_HASH(local_port)];
+
+  while( (tcp_c != NULL) && !((tcp_c->local_port == local_port) && (tcp_c->state != CLOSED)) )
+  {
+    tcp_c = tcp_c->hash_next;
+  }
+  return tcp_c;
 }
 
 /*!
@@ -1721,25 +3297,17 @@ static err_t tcp_store_error( const err_t err, TCP_T* const tcp_c, const s8_t* c
  * \brief A network adapter has a list of TCP controller. Some are used,
  * some are not or not yet. When CIPS creates a TCP controller on an 
  * adpater it calls malloc_tcp_c() in order to find a TCP controller 
- * available. So calls malloc_tcp_c() books a tcp_c in the list of TCP 
- * controllers and returns a reference to it.
+ * available. malloc_tcp_c() takes the first controller of the free list
+ * ("tcp_free_cs"), books it and returns a reference to it.
  * *******************************************************************/
 static TCP_T* malloc_tcp_c( struct NETIF_S* net_adapter)
 {
-  TCP_T *tcp_c_i;
-  TCP_T* free_tcp_c = NULL;
-  TCP_T* tcp_c_list = net_adapter->tcp_c_list;
-  int i=0;
+  TCP_T* free_tcp_c = net_adapter->tcp_free_cs;
 
-  for( i = 0; i < MAX_TCP; i++)
+  if( free_tcp_c != NULL )
   {
-    tcp_c_i = &(tcp_c_list[i]);
-    if( tcp_c_i->id == UNUSED)
-    {
-      free_tcp_c = tcp_c_i;
-      tcp_c_i->id = i;
-      i = MAX_TCP; // exit loop
-    }
+    tcp_list_remove(free_tcp_c);
+    free_tcp_c->id = (s32_t)(free_tcp_c - net_adapter->tcp_c_list);
   }
   return free_tcp_c;
 }
@@ -1750,19 +3318,23 @@ static TCP_T* malloc_tcp_c( struct NETIF_S* net_adapter)
  * \param tcp_c: [in/out] TCP controller of interest.
  * \brief Outgoing data can be larger than the TCP payload. Segments 
  * exits to split the data on multiple TCP frames.
- * segment_init_resource() initializes the segment of a TCP controller.
+ * segment_init_resource() initializes the segment of a TCP controller and
+ * gives their frames back to the adapter.
  * *******************************************************************/
 static void segment_init_resource(TCP_T* tcp_c)
 {
   int i;
   for ( i = 0; i <MAX_TCP_SEG ; i++)
   {
+    segment_return_frame(tcp_c, &(tcp_c->segment[i]));
     tcp_c->segment[i].state = TCP_SEG_UNUSED;
     tcp_c->segment[i].frame_initialized = FALSE;
-    tcp_c->segment[i].retransmission_timer_slice = 0;
+    tcp_c->segment[i].header_only = FALSE;
+    tcp_c->segment[i].sacked = FALSE;
+    tcp_c->segment[i].retransmitted = FALSE;
   }
+  tcp_c->control_segment.header_only = FALSE;
   tcp_c->seg_nb[TCP_SEG_UNUSED] = MAX_TCP_SEG;
-  tcp_c->seg_nb[TCP_SEG_UNSENT] = 0;
   tcp_c->seg_nb[TCP_SEG_UNACKED] = 0;
 }
 
@@ -1801,28 +3373,100 @@ static void segment_init_connection (TCP_T* const tcp_c, const u8_t* const dest_
   tcphdr->dest_port = htons(tcp_c->remote_port);
 
   tcp_c->control_segment.frame_initialized = TRUE;
+  tcp_c->control_segment.header_only = FALSE; //The ports or the addresses have changed.
+  tcp_c->pseudo_sum = ip_pseudo_header_sum( tcp_c->remote_ip, tcp_c->local_ip, IP_TCP);
+
+  //The "data segments" copy the "control segment" when they borrow a frame (see segment_borrow_frame()).
+  return;
+}
+
+/*!
+ * Function name: segment_borrow_frame
+ * \return TRUE if the segment holds a frame, FALSE if the pool is empty.
+ * \param tcp_c: [in/out] TCP controller of interest.
+ * \param segment: [in/out] segment about to be built: the SYN or a data segment.
+ * \brief A segment borrows a frame from the adapter (TCP_FRAME_POOL) while
+ * it is built and sent. The fields that are constant for the life of the connection
+ * are copied from the "control segment" (see segment_init_connection()).
+ * *******************************************************************/
+static bool_t segment_borrow_frame(TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment)
+{
+  #define CONSTANT_HEADER_LENGTH 10
+  struct NETIF_S* net_adapter = tcp_c->netif;
+  u32_t* src;
+  u32_t* dst;
+  u32_t j = 0;
 
-  //Once the "control segment" is initialized, copy it to each "data segment"
-  //Note: the copy is optimized by copying 32 bits at a time. They are 10 times 32 bits from the fisrt item (ETHER_HEADER_T:destination_addr) to the last (TCP_HEADER_T:dest_port).
+  if( (segment->buffer == NULL) && (net_adapter->tcp_frame_free != NULL) )
   {
-    #define CONSTANT_HEADER_LENGTH 10
-    int i;
-    int j;
-    u32_t* src;
-    u32_t* dst;
-    i = 0;
+    segment->buffer = net_adapter->tcp_frame_free;
+    net_adapter->tcp_frame_free = segment->buffer->next;
+    net_adapter->tcp_frame_free_nb--;
+    segment->frame = segment->buffer->frame;
+    segment->frame_initialized = FALSE;
+    segment->header_only = FALSE;
+    //Note: the copy is optimized by copying 32 bits at a time. They are 10 times 32 bits from the fisrt item (ETHER_HEADER_T:destination_addr) to the last (TCP_HEADER_T:dest_port).
+    src = (u32_t*)tcp_c->control_segment.frame;
+    dst = (u32_t*)segment->frame;
     do{
-      j= 0;
-      src = (u32_t*)frame;
-      dst = (u32_t*)tcp_c->segment[i].frame;
-      do{
-        *dst++ = *src++;
-      }while( ++j < CONSTANT_HEADER_LENGTH);
-      tcp_c->control_segment.frame_initialized = TRUE;
-    } while(++i<MAX_TCP_SEG);
+      *dst++ = *src++;
+    }while( ++j < CONSTANT_HEADER_LENGTH);
   }
+  return (segment->buffer != NULL)? TRUE : FALSE;
+}
 
-  return;
+/*!
+ * Function name: segment_return_frame
+ * \return nothing.
+ * \param tcp_c: [in/out] TCP controller of interest.
+ * \param segment: [in/out] segment sent, or going back to TCP_SEG_UNUSED.
+ * \brief The frame of the segment goes back to the adapter: the other 
+ * connections can borrow it.
+ * *******************************************************************/
+static void segment_return_frame(TCP_T* const tcp_c, TCP_SENDING_SEG_T* const segment)
+{
+  if( segment->buffer != NULL )
+  {
+    segment->buffer->next = tcp_c->netif->tcp_frame_free;
+    tcp_c->netif->tcp_frame_free = segment->buffer;
+    tcp_c->netif->tcp_frame_free_nb++;
+    segment->buffer = NULL;
+    segment->frame = NULL;
+  }
+}
+
+/*!
+ * Function name: tcp_return_rcv_ring
+ * \return nothing.
+ * \param tcp_c: [in/out] TCP controller of interest.
+ * \brief No segment waits out of order any more: the receive ring goes 
+ * back to the adapter.
+ * *******************************************************************/
+static void tcp_return_rcv_ring(TCP_T* const tcp_c)
+{
+  if( tcp_c->rcv_ring != NULL )
+  {
+    tcp_c->rcv_ring->next = tcp_c->netif->tcp_rcv_ring_free;
+    tcp_c->netif->tcp_rcv_ring_free = tcp_c->rcv_ring;
+    tcp_c->rcv_ring = NULL;
+  }
+}
+
+/*!
+ * Function name: tcp_return_snd_ring
+ * \return nothing.
+ * \param tcp_c: [in/out] TCP controller of interest.
+ * \brief No byte is unsent or unacknowledged any more: the send ring 
+ * goes back to the adapter. The next tcp_write() borrows one again.
+ * *******************************************************************/
+static void tcp_return_snd_ring(TCP_T* const tcp_c)
+{
+  if( tcp_c->snd_ring != NULL )
+  {
+    tcp_c->snd_ring->next = tcp_c->netif->tcp_snd_ring_free;
+    tcp_c->netif->tcp_snd_ring_free = tcp_c->snd_ring;
+    tcp_c->snd_ring = NULL;
+  }
 }
 
 /*!
@@ -1848,32 +3492,77 @@ static TCP_SENDING_SEG_T * segment_get_first( TCP_T* tcp_c, const seg_state stat
 }
 
 /*!
- * Function name: segment_get_first_unused_after_unacked
- * \return a pointer to the segment found. NULL otherwise.
+ * Function name: segment_get_oldest_unacked
+ * \return a pointer to the unacknowledged segment starting at "snd_una" or
+ * the first unacknowledged one if none starts there. NULL if there is no 
+ * unacknowledged segment.
  * \param tcp_c: [in/out] TCP controller of interest
- * \param state: [in] state of interest
- * \brief CIPS uses segments in order to send messages larger than the TCP payload
- * or to accumulate tcp_write() if the network is slower than the CPU.
- * Most of the time, the network is faster than the flow of tcp_write().
- * But when it is not then cIPS must keeps the order of the frames.
- * To do so, if looks for the first UNUSED segment after the last UNACKED (which is the last UNACKED).
+ * \brief The unacknowledged segments are not always stored in sequence 
+ * order. cIPS retransmits the oldest one.
  * *******************************************************************/
-static TCP_SENDING_SEG_T * segment_get_first_unused_after_unacked( TCP_T* tcp_c, const seg_state state)
+static TCP_SENDING_SEG_T * segment_get_oldest_unacked( TCP_T* tcp_c)
 {
-  seg_state last_state = TCP_SEG_UNUSED;
   u32_t i = 0;
   TCP_SENDING_SEG_T *elt = tcp_c->segment;
 
-  //TCP_SEG_UNUSED
-  while ( (!((last_state == TCP_SEG_UNACKED) && (elt->state == TCP_SEG_UNUSED))) && (i != MAX_TCP_SEG))
+  while ( (i != MAX_TCP_SEG) && !((elt->state == TCP_SEG_UNACKED) && (TCP_SEGMENT_SEQNO(tcp_c, elt) == tcp_c->snd_una)) )
   {
-    last_state = elt->state;
     elt++;
     i++;
   }
+  return (i != MAX_TCP_SEG)?elt:segment_get_first( tcp_c, TCP_SEG_UNACKED);
+}
 
-  return (i != MAX_TCP_SEG)?elt:NULL;
+/*!
+ * Function name: segment_get_next_hole
+ * \return a pointer to the oldest unacknowledged segment that is missing
+ * at the peer device and not retransmitted yet. NULL if there is none.
+ * \param tcp_c: [in/out] TCP controller of interest
+ * \brief The SACK blocks mark the segments that the peer device holds.
+ * A segment that is not marked and that precedes a marked one is a hole.
+ * *******************************************************************/
+static TCP_SENDING_SEG_T * segment_get_next_hole( TCP_T* tcp_c)
+{
+  u32_t i;
+  u32_t highest_sacked = tcp_c->snd_una; //End of the last segment marked.
+  TCP_SENDING_SEG_T *elt = tcp_c->segment;
+  TCP_SENDING_SEG_T *hole = NULL;
+
+  for( i = 0; i < MAX_TCP_SEG; i++)
+  {
+    if( (elt[i].state == TCP_SEG_UNACKED) && elt[i].sacked && TCP_SEQ_GT(elt[i].ack_no, highest_sacked) )
+    { highest_sacked = elt[i].ack_no;}
+  }
+  for( i = 0; i < MAX_TCP_SEG; i++)
+  {
+    if( (elt[i].state == TCP_SEG_UNACKED) && !elt[i].sacked && !elt[i].retransmitted &&
+        TCP_SEQ_LT(TCP_SEGMENT_SEQNO(tcp_c, &elt[i]), highest_sacked) &&
+        ((hole == NULL) || TCP_SEQ_LT(TCP_SEGMENT_SEQNO(tcp_c, &elt[i]), TCP_SEGMENT_SEQNO(tcp_c, hole))) )
+    { hole = &elt[i];}
+  }
+  return hole;
+}
+
+/*!
+ * Function name: segment_reset_scoreboard
+ * \return nothing
+ * \param tcp_c: [in/out] TCP controller of interest
+ * \brief On a retransmission time out, cIPS forgets the SACK blocks (the 
+ * peer device may have discarded the data, RFC 2018) and the 
+ * retransmissions of the previous loss episode.
+ * *******************************************************************/
+static void segment_reset_scoreboard( TCP_T* tcp_c)
+{
+  u32_t i;
+
+  for( i = 0; i < MAX_TCP_SEG; i++)
+  {
+    tcp_c->segment[i].sacked = FALSE;
+    tcp_c->segment[i].retransmitted = FALSE;
+  }
+  return;
 }
+
 /*!
  * Function name: segment_change_state
  * \return nothing
@@ -1891,9 +3580,12 @@ static void segment_change_state(TCP_T* tcp_c, TCP_SENDING_SEG_T *elt, const seg
   (tcp_c->seg_nb[elt->state])--;
   elt->state = new_state;
   (tcp_c->seg_nb[new_state])++;
+  if( new_state == TCP_SEG_UNUSED ) { segment_return_frame(tcp_c, elt);} //Acknowledged: the frame goes back to the adapter.
+  elt->sacked = FALSE; //A new frame, or one acknowledged.
+  elt->retransmitted = FALSE;
 
   T_DEBUGF(TCP_DEBUG, ("%s#%d: Segments: ",tcp_c->netif->name, tcp_c->local_port));
-  T_DEBUGF(TCP_DEBUG, ("unused=%ld, unsent=%ld unacked=%ld\r\n",tcp_c->seg_nb[TCP_SEG_UNUSED],tcp_c->seg_nb[TCP_SEG_UNSENT],tcp_c->seg_nb[TCP_SEG_UNACKED]));
+  T_DEBUGF(TCP_DEBUG, ("unused=%ld, unacked=%ld\r\n",tcp_c->seg_nb[TCP_SEG_UNUSED],tcp_c->seg_nb[TCP_SEG_UNACKED]));
 
   return;
 }
@@ -1924,15 +3616,12 @@ static void tcp_lookup_segment_by_acknowledge_no(TCP_T* const tcp_c, const u32_t
   i =0;
   do {
     if((tcp_c->segment[i].state == TCP_SEG_UNACKED) && 
-       ((tcp_c->segment[i].ack_no <= ack_no) || // cIPS acknowleges segments with an ack_no lower than the one received.
-        ((ack_no < tcp_c->last_ack_no) && //But the received ack_no rolls over when it is bigger than 0xFFFFFFFF. last_ack_no handles the rollover situation.
-         (tcp_c->segment[i].ack_no >= tcp_c->last_ack_no))))
+       !TCP_SEQ_GT(tcp_c->segment[i].ack_no, ack_no)) // cIPS acknowleges segments with an ack_no lower than the one received (modulo 2^32).
     {
       (void)segment_change_state( tcp_c, &(tcp_c->segment[i]), TCP_SEG_UNUSED);
     }
     i++;
   } while ((tcp_c->seg_nb[TCP_SEG_UNACKED]) && (i< MAX_TCP_SEG)); //Note: segment_change_state() decrements tcp_c->seg_nb[TCP_SEG_UNACKED]
-  tcp_c->last_ack_no = ack_no; //update in case if the next "ack_no" rolls over.
 
 #ifdef TCP_DEBUG
   if(i== MAX_TCP_SEG)
@@ -2008,51 +3697,296 @@ static u8_t* tcp_memcpy(u8_t* output, const u8_t* input, const u32_t length)
 }
 /*!
  * Function name: tcp_parse_options
- * \return the remote maximum segment size.
- * \param option : [in] pointer to the option field.
- * \brief Parses the TCP options to get the Max segment size.
- * *******************************************************************/
-static u32_t tcp_parse_options(const u8_t* const option)
-{
-  #define END_OF_OPTION_LIST_KIND 0x00 //See RFC793
-  #define NO_OPERATION_KIND 0x01 //See RFC793
-  #define MAX_SEG_SIZE_KIND 0x02 //See RFC793
-  u16_t mss = 0;
-  switch(*option)
-  {
-    case MAX_SEG_SIZE_KIND:
-      //Get the Max segment size.
-      //Note: The MSS is the last 2 bytes of the 4 bytes of the option field.
-      //"Option" points to the incoming frame which is big endian.
-      //So cIPS gets the MSS field by pointing to the last 2 bytes of the "option"
-      //field of the big endian tcp frame.
-      //It gets a big endian value. If the platform is little endian, it gets the
-      //the right value in the register by applying ntohs() .
-      mss = ntohs(*(u16_t*)(option + sizeof(u16_t))); //get the Max segment size.
-    break;
-    case END_OF_OPTION_LIST_KIND:
-    case NO_OPERATION_KIND:
-    default:
-      mss = 0;
-    break;
-  };
-  return mss;
+ * \return FALSE if PAWS rejects the segment (RFC 7323, 5.3): its timestamp
+ * is older than "ts_recent". TRUE otherwise.
+ * \param tcp_c : [in] TCP controller of interest.
+ * \param tcphdr : [in] header of the incoming segment (big endian).
+ * \brief Parses the TCP options. cIPS skips the options it does not know
+ * and stops at the first malformed one.
+ * - In a SYN: gets the maximum segment size of the peer device and the 
+ * options it offers (window scale, SACK permitted, timestamps). An option 
+ * applies only if both devices send it (RFC 7323, RFC 2018). cIPS offers 
+ * TCP_OFFERED_OPTIONS in its SYN and answers only those in its SYN|ACK. 
+ * So both devices agree once the peer device SYN is parsed.
+ * - In the other segments: the timestamp of the peer device is echoed from 
+ * now on if the segment does not start after "remote_seqno". The echoed 
+ * timestamp of an ACK for new data measures the round trip time. Once the
+ * segment passes PAWS, the segments that its SACK blocks cover are marked
+ * (see tcp_sack_mark()).
+ * *******************************************************************/
+static bool_t tcp_parse_options(TCP_T* const tcp_c, const TCP_HEADER_T* const tcphdr)
+{
+  const u8_t* option = (const u8_t*)tcphdr + sizeof(TCP_HEADER_T);
+  const u8_t* const end = (const u8_t*)tcphdr + TCP_GET_HEADER_LENGTH(tcphdr);
+  const bool_t syn = ((TCP_GET_FLAGS(tcphdr) & TCP_SYN) == TCP_SYN);
+  const u32_t ackno = ntohl(tcphdr->ackno);
+  TCP_SYN_T request;
+  bool_t timestamps = FALSE;
+  bool_t accepted = TRUE;
+  u32_t ts_val = 0;
+  u32_t ts_ecr = 0;
+  const u8_t* sack = NULL; //SACK option: applied once the segment passes PAWS.
+  u32_t sack_length = 0;
+  u32_t length;
+  u32_t i;
+
+  if( syn )
+  {
+    tcp_parse_syn_options(tcphdr, &request);
+    tcp_apply_syn_options(tcp_c, &request);
+  }
+  while( !syn && (option < end) && (*option != TCP_OPTION_END) )
+  {
+    if( *option == TCP_OPTION_NOP )
+    { length = 1;}
+    else
+    {
+      length = (option + 1 < end)? option[1] : 0;
+      if( (length < 2) || (option + length > end) )
+      { break;} //Malformed option: ignore the remaining ones.
+      switch(*option)
+      {
+        case TCP_OPTION_SACK:
+          if( TCP_SACK_ENABLED(tcp_c) && (((length - 2) % 8) == 0) )
+          {
+            sack = option;
+            sack_length = length;
+          }
+        break;
+        case TCP_OPTION_TIMESTAMPS:
+          if( length == TCP_OPTION_TIMESTAMPS_LENGTH )
+          {
+            timestamps = TRUE;
+            ts_val = TCP_OPTION_GET32(option + 2);
+            ts_ecr = TCP_OPTION_GET32(option + 6);
+          }
+        break;
+        default: //Unknown option or option of a SYN: skip it.
+        break;
+      };
+    }
+    option += length;
+  }
+  if( timestamps && TCP_TIMESTAMPS_ENABLED(tcp_c) )
+  {
+    if( TCP_SEQ_LT(ts_val, tcp_c->ts_recent) )
+    { accepted = FALSE;} //PAWS: an old duplicate, its sequence number may have wrapped.
+    else
+    {
+      if( !TCP_SEQ_GT(ntohl(tcphdr->seqno), tcp_c->remote_seqno) )
+      { tcp_c->ts_recent = ts_val;}
+      if( ((TCP_GET_FLAGS(tcphdr) & TCP_ACK) == TCP_ACK) && (ts_ecr != 0) &&
+          TCP_SEQ_GT(ackno, tcp_c->snd_una) && !TCP_SEQ_GT(ackno, tcp_c->snd_nxt) )
+      { tcp_rtt_sample(tcp_c, U32_DIFF(tcp_c->netif->tcp_clock, ts_ecr));}
+    }
+  }
+  if( accepted && (sack != NULL) ) //An old duplicate does not mark the segments sent since.
+  {
+    for( i = 2; i < sack_length; i += 8)
+    { tcp_sack_mark(tcp_c, TCP_OPTION_GET32(sack + i), TCP_OPTION_GET32(sack + i + 4));}
+  }
+  return accepted;
+}
+
+/*!
+ * Function name: tcp_parse_syn_options
+ * \return nothing.
+ * \param tcphdr : [in] header of the incoming SYN (big endian).
+ * \param syn : [out] "remote_mss", "peer_options", "snd_wnd_scale" and 
+ * "ts_recent" of the request.
+ * \brief Gets the maximum segment size of the peer device and the 
+ * options it offers (window scale, SACK permitted, timestamps) that cIPS
+ * offers too (TCP_OFFERED_OPTIONS). cIPS skips the options it does not 
+ * know and stops at the first malformed one.
+ * *******************************************************************/
+static void tcp_parse_syn_options(const TCP_HEADER_T* const tcphdr, TCP_SYN_T* const syn)
+{
+  const u8_t* option = (const u8_t*)tcphdr + sizeof(TCP_HEADER_T);
+  const u8_t* const end = (const u8_t*)tcphdr + TCP_GET_HEADER_LENGTH(tcphdr);
+  u32_t length;
+
+  syn->remote_mss = 0;
+  syn->peer_options = 0;
+  syn->snd_wnd_scale = 0;
+  syn->ts_recent = 0;
+  while( (option < end) && (*option != TCP_OPTION_END) )
+  {
+    if( *option == TCP_OPTION_NOP )
+    { length = 1;}
+    else
+    {
+      length = (option + 1 < end)? option[1] : 0;
+      if( (length < 2) || (option + length > end) )
+      { break;} //Malformed option: ignore the remaining ones.
+      switch(*option)
+      {
+        case TCP_OPTION_MSS:
+          //Note: "option" points to the incoming frame which is big endian.
+          if( length == TCP_OPTION_MSS_LENGTH )
+          { syn->remote_mss = ((u32_t)option[2] << 8) | option[3];}
+        break;
+        case TCP_OPTION_WND_SCALE:
+          if( length == TCP_OPTION_WND_SCALE_LENGTH )
+          {
+            syn->snd_wnd_scale = (option[2] < TCP_MAX_WND_SCALE)? option[2] : TCP_MAX_WND_SCALE;
+            syn->peer_options |= TCP_PEER_WND_SCALE;
+          }
+        break;
+        case TCP_OPTION_SACK_PERMITTED:
+          if( length == TCP_OPTION_SACK_PERMITTED_LENGTH )
+          { syn->peer_options |= TCP_PEER_SACK_PERMITTED;}
+        break;
+        case TCP_OPTION_TIMESTAMPS:
+          if( length == TCP_OPTION_TIMESTAMPS_LENGTH )
+          {
+            syn->ts_recent = TCP_OPTION_GET32(option + 2);
+            syn->peer_options |= TCP_PEER_TIMESTAMPS;
+          }
+        break;
+        default: //Unknown option: skip it.
+        break;
+      };
+    }
+    option += length;
+  }
+  syn->peer_options &= TCP_OFFERED_OPTIONS;
+  if( !(syn->peer_options & TCP_PEER_WND_SCALE) ) { syn->snd_wnd_scale = 0;}
+  if( !(syn->peer_options & TCP_PEER_TIMESTAMPS) ) { syn->ts_recent = 0;}
+}
+
+/*!
+ * Function name: tcp_apply_syn_options
+ * \return nothing.
+ * \param tcp_c : [in/out] TCP controller of interest.
+ * \param syn : [in] options of the SYN of the peer device (see tcp_parse_syn_options()).
+ * \brief An option applies only if both devices send it (RFC 7323, 
+ * RFC 2018). cIPS offers TCP_OFFERED_OPTIONS in its SYN and answers only 
+ * those in its SYN|ACK. So both devices agree once the peer device SYN is
+ * parsed. Without MSS option, "remote_mss" is not changed.
+ * *******************************************************************/
+static void tcp_apply_syn_options(TCP_T* const tcp_c, const TCP_SYN_T* const syn)
+{
+  if( syn->remote_mss )
+  { tcp_c->remote_mss = (syn->remote_mss < TCP_MTU)? syn->remote_mss : TCP_MTU;} //cap to what the adapter can send.
+  tcp_c->peer_options = syn->peer_options;
+  if( tcp_c->peer_options & TCP_PEER_WND_SCALE )
+  {
+    tcp_c->snd_wnd_scale = syn->snd_wnd_scale;
+    tcp_c->rcv_wnd_scale = tcp_window_scale();
+  }
+  else
+  {
+    tcp_c->snd_wnd_scale = 0;
+    tcp_c->rcv_wnd_scale = 0;
+  }
+  tcp_c->options_length = (TCP_TIMESTAMPS_ENABLED(tcp_c))? TCP_TIMESTAMPS_LENGTH : 0;
+  tcp_c->ts_recent = syn->ts_recent;
+}
+
+/*!
+ * Function name: tcp_format_syn_options
+ * \return the length of the options in bytes.
+ * \param net_adapter : [in] adapter sending the SYN ("tcp_clock").
+ * \param local_mss : [in] maximum segment size of cIPS.
+ * \param ts_recent : [in] timestamp of the peer device to echo.
+ * \param options : [out] TCP_SYN_OPTIONS_LENGTH bytes receiving the options.
+ * \param offered : [in] TCP_PEER_* options to append.
+ * \brief Generates the options of a SYN: the maximum segment size and
+ * optionally SACK permitted (RFC 2018), the window scale and the 
+ * timestamps (RFC 7323).
+ * *******************************************************************/
+static u8_t tcp_format_syn_options(const struct NETIF_S* const net_adapter, const u32_t local_mss, const u32_t ts_recent, u8_t* const options, const u32_t offered)
+{
+  u8_t length = 0;
+
+  options[length++] = TCP_OPTION_MSS; //The frame is big endian.
+  options[length++] = TCP_OPTION_MSS_LENGTH;
+  options[length++] = (u8_t)(local_mss >> 8);
+  options[length++] = (u8_t)(local_mss & 0xFF);
+  if( offered & TCP_PEER_SACK_PERMITTED )
+  {
+    options[length++] = TCP_OPTION_NOP; //Aligns the header on 32 bits.
+    options[length++] = TCP_OPTION_NOP;
+    options[length++] = TCP_OPTION_SACK_PERMITTED;
+    options[length++] = TCP_OPTION_SACK_PERMITTED_LENGTH;
+  }
+  if( offered & TCP_PEER_WND_SCALE )
+  {
+    options[length++] = TCP_OPTION_NOP; //Aligns the header on 32 bits.
+    options[length++] = TCP_OPTION_WND_SCALE;
+    options[length++] = TCP_OPTION_WND_SCALE_LENGTH;
+    options[length++] = tcp_window_scale();
+  }
+  if( offered & TCP_PEER_TIMESTAMPS )
+  { length += tcp_format_timestamps_option(net_adapter, ts_recent, options + length);}
+  return length;
 }
 
 /*!
- * Function name: tcp_format_max_segment_size_option
- * \return the remote maximum segment size (in big endian).
- * \param mss : [in] local naximum segment size.
- * \brief Generates the "options" field.
+ * Function name: tcp_format_timestamps_option
+ * \return the length of the option in bytes, NOPs included: TCP_TIMESTAMPS_LENGTH.
+ * \param net_adapter : [in] adapter sending the segment ("tcp_clock").
+ * \param ts_recent : [in] timestamp of the peer device to echo.
+ * \param options : [out] TCP_TIMESTAMPS_LENGTH bytes receiving the option.
+ * \brief Generates the timestamps option (RFC 7323): the TCP clock and
+ * the last timestamp of the peer device. tcp_refresh_acknowledgment()
+ * updates them when a data segment leaves.
  * *******************************************************************/
-static u32_t tcp_format_max_segment_size_option(const u16_t mss)
+static u8_t tcp_format_timestamps_option(const struct NETIF_S* const net_adapter, const u32_t ts_recent, u8_t* const options)
 {
-  u32_t options;
-  const u32_t MAX_SEG_SIZE_OPTION_MASK = 0x2040000; //See RFC793
-  const u32_t MAX_SEG_SIZE_MASK = 0xFFFF;
-  options = MAX_SEG_SIZE_OPTION_MASK | (mss & MAX_SEG_SIZE_MASK);
+  options[0] = TCP_OPTION_NOP; //Aligns the timestamps on 32 bits.
+  options[1] = TCP_OPTION_NOP;
+  options[2] = TCP_OPTION_TIMESTAMPS;
+  options[3] = TCP_OPTION_TIMESTAMPS_LENGTH;
+  tcp_option_put32(options + 4, net_adapter->tcp_clock);
+  tcp_option_put32(options + 8, ts_recent);
+  return TCP_TIMESTAMPS_LENGTH;
+}
+
+/*!
+ * Function name: tcp_option_put32
+ * \return nothing
+ * \param option : [out] 4 bytes of an option field.
+ * \param value : [in] Value to write in big endian.
+ * \brief Options are not aligned on 32 bits: write them byte by byte.
+ * *******************************************************************/
+static void tcp_option_put32(u8_t* const option, const u32_t value)
+{
+  option[0] = (u8_t)(value >> 24);
+  option[1] = (u8_t)(value >> 16);
+  option[2] = (u8_t)(value >> 8);
+  option[3] = (u8_t)value;
+  return;
+}
 
-  return htonl(options);
+/*!
+ * Function name: tcp_window_scale
+ * \return the shift cIPS applies to its receive window.
+ * \brief Returns the smallest shift that lets the 16-bit window field
+ * advertise the whole "rcv_ring" (TCP_WND).
+ * *******************************************************************/
+static u8_t tcp_window_scale(void)
+{
+  u8_t scale = 0;
+  while( (((u32_t)TCP_WND >> scale) > 0xFFFF) && (scale < TCP_MAX_WND_SCALE) )
+  { scale++;}
+  return scale;
+}
+
+/*!
+ * Function name: tcp_advertised_window
+ * \return the window field of the outgoing segment (host order).
+ * \param tcp_c : [in] TCP controller sending the segment.
+ * \param control_bits : [in] flags of the segment.
+ * \brief Scales "local_wnd" down by "rcv_wnd_scale". The window of a
+ * SYN is never scaled (RFC 7323).
+ * *******************************************************************/
+static u16_t tcp_advertised_window(const TCP_T* const tcp_c, const u8_t control_bits)
+{
+  u32_t window = tcp_c->local_wnd;
+  if( (control_bits & TCP_SYN) == 0 )
+  { window >>= tcp_c->rcv_wnd_scale;}
+  return (window > 0xFFFF)? 0xFFFF : (u16_t)window;
 }
 
 #if TCP_DEBUG
@@ -0,0 +1,341 @@
+/* Copyright (c) 2010,  Jean-Marc David
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without 
+* modification, are permitted provided that the following conditions 
+* are met:
+*  * Redistributions of source code must retain the above copyright 
+* notice, this list of conditions and the following disclaimer.
+*  * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the 
+* documentation and/or other materials provided with the distribution.
+*  * Neither the name of the author nor the names of its contributors 
+* may be used to endorse or promote products derived from this software
+* without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR 
+* IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+* OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+* IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, 
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+*  AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+* Author: Jean-Marc David jmdavid1789<at>googlemail.com
+* http://sourceforge.net/projects/cipsuite/ <br>
+*/
+/*!
+* \namespace tcp_cc
+* \file tcp_cc.c
+* \brief  Module Description: TCP congestion control (NewReno and CUBIC).
+* The TCP layer calls the hooks of the algorithm selected for each 
+* connection (see tcp_congestion_control()). The hooks update the congestion 
+* window "cwnd" that tcp_output() respects.
+* \note The arithmetic is 32-bit integer only (MicroBlaze).
+***************************************************/
+
+#include "basic_c_types.h"
+#include "nw_protocols.h"
+#include "netif.h"
+#include "debug.h"
+#include "tcp.h"
+
+#define TCP_CC_INFINITE_SSTHRESH 0xFFFFFFFFUL //!< No slow start threshold yet: slow start until the first loss.
+#define TCP_CC_MAX_CWND (1UL << 30) //!< Bound of the congestion window. It keeps the arithmetic below 2^32.
+#define TCP_CC_CUBIC_MAX_OFFSET 1600 //!< CUBIC: bound of |t - K| in 10 ms. 1600^3 < 2^32.
+#define TCP_CC_CUBIC_MAX_K_SEGMENTS 428 //!< CUBIC: bound of (W_max - cwnd) in segments for K. (428 + 1) * 25 * 100000 < 2^30.
+
+static void tcp_cc_slow_start(TCP_T* const tcp_c, const u32_t acked, const u32_t mss);
+static u32_t tcp_cc_initial_window(const u32_t mss);
+static u32_t tcp_cc_cbrt(u32_t x);
+static void tcp_newreno_init(TCP_T* tcp_c);
+static void tcp_newreno_on_ack(TCP_T* tcp_c, u32_t acked, u32_t now);
+static void tcp_newreno_on_loss(TCP_T* tcp_c);
+static void tcp_newreno_on_rto(TCP_T* tcp_c);
+static void tcp_cubic_init(TCP_T* tcp_c);
+static void tcp_cubic_on_ack(TCP_T* tcp_c, u32_t acked, u32_t now);
+static void tcp_cubic_reduce(TCP_T* tcp_c);
+static void tcp_cubic_on_loss(TCP_T* tcp_c);
+static void tcp_cubic_on_rto(TCP_T* tcp_c);
+
+const TCP_CC_T tcp_cc_newreno = { "newreno", tcp_newreno_init, tcp_newreno_on_ack, tcp_newreno_on_loss, tcp_newreno_on_rto};
+const TCP_CC_T tcp_cc_cubic = { "cubic", tcp_cubic_init, tcp_cubic_on_ack, tcp_cubic_on_loss, tcp_cubic_on_rto};
+
+/*!
+ * Function name: tcp_cc_mss
+ * \return the segment size (in bytes) the congestion window counts in.
+ * \param tcp_c : [in] tcp_c of interest.
+ * \brief The MSS of the peer device or TCP_MSS if the peer device did not 
+ * send one.
+ * *******************************************************************/
+u32_t tcp_cc_mss(const TCP_T* const tcp_c)
+{
+  return (tcp_c->remote_mss)? tcp_c->remote_mss : TCP_MSS;
+}
+
+/*!
+ * Function name: tcp_cc_initial_window
+ * \return the initial congestion window in bytes.
+ * \param mss : [in] segment size.
+ * \brief min(4*MSS, max(2*MSS, 4380 bytes)) (RFC 3390).
+ * *******************************************************************/
+static u32_t tcp_cc_initial_window(const u32_t mss)
+{
+  u32_t window = (2 * mss > 4380)? 2 * mss : 4380;
+  return (window > 4 * mss)? 4 * mss : window;
+}
+
+/*!
+ * Function name: tcp_cc_slow_start
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param acked : [in] Bytes newly acknowledged.
+ * \param mss : [in] segment size.
+ * \brief The congestion window grows by the bytes acknowledged, at most
+ * one segment per ACK (RFC 3465, L=1).
+ * *******************************************************************/
+static void tcp_cc_slow_start(TCP_T* const tcp_c, const u32_t acked, const u32_t mss)
+{
+  tcp_c->cwnd += (acked < mss)? acked : mss;
+  if( tcp_c->cwnd > TCP_CC_MAX_CWND ) { tcp_c->cwnd = TCP_CC_MAX_CWND;}
+  return;
+}
+
+/*!
+ * Function name: tcp_cc_cbrt
+ * \return the integer cube root of "x".
+ * \param x : [in] value lower than 2^30.
+ * \brief Bit by bit cube root (no floating point).
+ * *******************************************************************/
+static u32_t tcp_cc_cbrt(u32_t x)
+{
+  u32_t y = 0;
+  u32_t b;
+  s32_t s;
+
+  for( s = 27; s >= 0; s -= 3)
+  {
+    y <<= 1;
+    b = (3 * y * (y + 1) + 1) << s;
+    if( x >= b )
+    {
+      x -= b;
+      y++;
+    }
+  }
+  return y;
+}
+
+/*!
+ * Function name: tcp_newreno_init
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Initial window and slow start until the first loss.
+ * *******************************************************************/
+static void tcp_newreno_init(TCP_T* tcp_c)
+{
+  tcp_c->cwnd = tcp_cc_initial_window( tcp_cc_mss(tcp_c));
+  tcp_c->ssthresh = TCP_CC_INFINITE_SSTHRESH;
+  tcp_c->cc_state.bytes_acked = 0;
+  return;
+}
+
+/*!
+ * Function name: tcp_newreno_on_ack
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param acked : [in] Bytes newly acknowledged.
+ * \param now : [in] Time in ms (unused).
+ * \brief Slow start below "ssthresh", then congestion avoidance: one 
+ * segment more per window of bytes acknowledged (RFC 5681).
+ * *******************************************************************/
+static void tcp_newreno_on_ack(TCP_T* tcp_c, u32_t acked, u32_t now)
+{
+  u32_t mss = tcp_cc_mss(tcp_c);
+  (void)now;
+
+  if( tcp_c->cwnd < tcp_c->ssthresh )
+  {
+    tcp_cc_slow_start(tcp_c, acked, mss);
+  }
+  else
+  {
+    tcp_c->cc_state.bytes_acked += acked;
+    if( tcp_c->cc_state.bytes_acked >= tcp_c->cwnd )
+    {
+      tcp_c->cc_state.bytes_acked -= tcp_c->cwnd;
+      if( tcp_c->cwnd < TCP_CC_MAX_CWND ) { tcp_c->cwnd += mss;}
+    }
+  }
+  return;
+}
+
+/*!
+ * Function name: tcp_newreno_on_loss
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Halve the flight (RFC 5681, equation 4).
+ * *******************************************************************/
+static void tcp_newreno_on_loss(TCP_T* tcp_c)
+{
+  u32_t mss = tcp_cc_mss(tcp_c);
+  u32_t half_flight = ((tcp_c->snd_nxt - tcp_c->snd_una) & TCP_SEQ_MASK) / 2;
+
+  tcp_c->ssthresh = (half_flight > 2 * mss)? half_flight : 2 * mss;
+  tcp_c->cwnd = tcp_c->ssthresh;
+  tcp_c->cc_state.bytes_acked = 0;
+  return;
+}
+
+/*!
+ * Function name: tcp_newreno_on_rto
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Halve the flight and restart from one segment (loss window).
+ * *******************************************************************/
+static void tcp_newreno_on_rto(TCP_T* tcp_c)
+{
+  tcp_newreno_on_loss(tcp_c);
+  tcp_c->cwnd = tcp_cc_mss(tcp_c);
+  return;
+}
+
+/*!
+ * Function name: tcp_cubic_init
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Initial window and slow start until the first loss.
+ * *******************************************************************/
+static void tcp_cubic_init(TCP_T* tcp_c)
+{
+  tcp_newreno_init(tcp_c);
+  tcp_c->cc_state.w_max = 0;
+  tcp_c->cc_state.origin = 0;
+  tcp_c->cc_state.k = 0;
+  tcp_c->cc_state.epoch_start = 0;
+  tcp_c->cc_state.w_est = 0;
+  return;
+}
+
+/*!
+ * Function name: tcp_cubic_on_ack
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \param acked : [in] Bytes newly acknowledged.
+ * \param now : [in] Time in ms.
+ * \brief Slow start below "ssthresh", then the window follows the cubic
+ * function W(t) = C*(t-K)^3 + W_max (C = 0.4 segment/s^3) and never grows
+ * slower than NewReno would (TCP friendly region, RFC 9438).
+ * \note The time is counted in 10 ms so that (t-K)^3 holds on 32 bits.
+ * *******************************************************************/
+static void tcp_cubic_on_ack(TCP_T* tcp_c, u32_t acked, u32_t now)
+{
+  TCP_CC_STATE_T* cubic = &tcp_c->cc_state;
+  u32_t mss = tcp_cc_mss(tcp_c);
+  u32_t t;
+  u32_t offset;
+  u32_t delta;
+  u32_t target;
+
+  if( tcp_c->cwnd < tcp_c->ssthresh )
+  {
+    tcp_cc_slow_start(tcp_c, acked, mss);
+  }
+  else
+  {
+    if( cubic->epoch_start == 0 ) //First ACK of a congestion avoidance epoch.
+    {
+      cubic->epoch_start = (now)? now : 1; //0 means no epoch.
+      cubic->w_est = tcp_c->cwnd;
+      if( tcp_c->cwnd < cubic->w_max )
+      { //K = cbrt((W_max - cwnd) / C) in 10 ms.
+        u32_t gap = cubic->w_max - tcp_c->cwnd;
+        u32_t segments = gap / mss; //Divide first: "gap * 25" overflows 32 bits for a large W_max.
+        u32_t x;
+        if( segments > TCP_CC_CUBIC_MAX_K_SEGMENTS ) { segments = TCP_CC_CUBIC_MAX_K_SEGMENTS; gap = segments * mss;}
+        x = (segments * 25 + (gap % mss) * 25 / mss) * 100000;
+        cubic->k = tcp_cc_cbrt(x);
+        cubic->origin = cubic->w_max;
+      }
+      else
+      {
+        cubic->k = 0;
+        cubic->origin = tcp_c->cwnd;
+      }
+    }
+
+    //Window of the cubic function at "now".
+    t = U32_DIFF(now, cubic->epoch_start) / 10;
+    offset = (t > cubic->k)? t - cubic->k : cubic->k - t;
+    if( offset > TCP_CC_CUBIC_MAX_OFFSET ) { offset = TCP_CC_CUBIC_MAX_OFFSET;}
+    delta = ((offset * offset * offset) / 10000) * 4 * mss / 1000; //C*(t-K)^3 in bytes.
+    if( t > cubic->k )
+    { target = cubic->origin + delta;}
+    else
+    { target = (cubic->origin > delta)? cubic->origin - delta : 0;}
+    if( target > tcp_c->cwnd + tcp_c->cwnd / 2 ) { target = tcp_c->cwnd + tcp_c->cwnd / 2;}
+
+    //TCP friendly region: NewReno with the CUBIC reduction grows by 0.529 segment per window.
+    cubic->w_est += ((acked * mss) / tcp_c->cwnd) * 529 / 1000;
+    if( cubic->w_est > target ) { target = cubic->w_est;}
+
+    if( target > tcp_c->cwnd )
+    {
+      delta = tcp_c->cwnd / acked;
+      tcp_c->cwnd += (target - tcp_c->cwnd) / ((delta)? delta : 1);
+      if( tcp_c->cwnd > TCP_CC_MAX_CWND ) { tcp_c->cwnd = TCP_CC_MAX_CWND;}
+    }
+  }
+  return;
+}
+
+/*!
+ * Function name: tcp_cubic_reduce
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Remember the window before the loss (less if the previous loss
+ * happened higher: fast convergence) and reduce "ssthresh" by beta = 0.7.
+ * *******************************************************************/
+static void tcp_cubic_reduce(TCP_T* tcp_c)
+{
+  TCP_CC_STATE_T* cubic = &tcp_c->cc_state;
+  u32_t mss = tcp_cc_mss(tcp_c);
+
+  cubic->epoch_start = 0;
+  if( tcp_c->cwnd < cubic->w_max )
+  { cubic->w_max = tcp_c->cwnd / 20 * 17;} //Fast convergence: (1 + beta) / 2.
+  else
+  { cubic->w_max = tcp_c->cwnd;}
+  tcp_c->ssthresh = tcp_c->cwnd / 10 * 7;
+  if( tcp_c->ssthresh < 2 * mss ) { tcp_c->ssthresh = 2 * mss;}
+  return;
+}
+
+/*!
+ * Function name: tcp_cubic_on_loss
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Multiplicative decrease by beta = 0.7.
+ * *******************************************************************/
+static void tcp_cubic_on_loss(TCP_T* tcp_c)
+{
+  tcp_cubic_reduce(tcp_c);
+  tcp_c->cwnd = tcp_c->ssthresh;
+  return;
+}
+
+/*!
+ * Function name: tcp_cubic_on_rto
+ * \return nothing.
+ * \param tcp_c : [in/out] tcp_c of interest.
+ * \brief Multiplicative decrease of "ssthresh" and restart from one segment.
+ * *******************************************************************/
+static void tcp_cubic_on_rto(TCP_T* tcp_c)
+{
+  tcp_cubic_reduce(tcp_c);
+  tcp_c->cwnd = tcp_cc_mss(tcp_c);
+  return;
+}
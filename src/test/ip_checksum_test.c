@@ -0,0 +1,179 @@
+/* Copyright (c) 2010,  Jean-Marc David
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without 
+* modification, are permitted provided that the following conditions 
+* are met:
+*  * Redistributions of source code must retain the above copyright 
+* notice, this list of conditions and the following disclaimer.
+*  * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the 
+* documentation and/or other materials provided with the distribution.
+*  * Neither the name of the author nor the names of its contributors 
+* may be used to endorse or promote products derived from this software
+* without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR 
+* IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+* OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+* IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, 
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+*  AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+* Author: Jean-Marc David jmdavid1789<at>googlemail.com
+* http://sourceforge.net/projects/cipsuite/ <br>
+*/
+/*!
+* \namespace ip_checksum_test
+* \file ip_checksum_test.c
+* \brief  Host test of the checksum kernels (make check). Every kernel 
+* compiled into ip.c, ip_checksum() and ip_copy_checksum() are compared 
+* to ip_checksum_reference() for each length up to 2KB (odd ones included),
+* a few long buffers and each byte alignment of a 32-byte line (odd start 
+* addresses included). The startup self-check (ip_checksum_check()) only 
+* covers the 16-bit alignments that the MicroBlaze can load.
+* \note ip.c is included to reach its static kernels.
+***************************************************/
+
+#include <stdio.h>
+#include <string.h> //for memcmp
+#include "../ip.c"
+
+#define TEST_MAX_SHORT_LENGTH 2048 //!< Every length up to this one is checked.
+#define TEST_ALIGNMENTS 32 //!< Byte offsets checked: a full AVX2 line.
+#define TEST_BUFFER_SIZE (131070 + TEST_ALIGNMENTS) //!< Longest buffer (ip_checksum_tail() sums less than 128KB) and its offsets.
+
+static const u32_t test_long_lengths[] = {4095, 4096, 32767, 32768, 65535, 65536, 131069, 131070}; //!< Around the fold limits of the SIMD kernels.
+
+static u8_t test_pattern[TEST_BUFFER_SIZE + sizeof(u32_t)];
+static u8_t test_copy[TEST_BUFFER_SIZE + sizeof(u32_t)];
+
+/*!
+ * Function name: test_fill
+ * \return nothing.
+ * \param all_ones : [in] TRUE to fill with 0xFF (a carry at every addition).
+ * \brief Fill "test_pattern" with pseudo random bytes and runs of 0xFF.
+ * *******************************************************************/
+static void test_fill(bool_t all_ones)
+{
+  u32_t seed = 0x12345678;
+  u32_t i;
+
+  for( i = 0; i < sizeof(test_pattern); i++)
+  {
+    seed = (seed * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+    test_pattern[i] = (all_ones || ((i % 11) < 3))? (u8_t)0xFF : (u8_t)(seed >> 16);
+  }
+}
+
+/*!
+ * Function name: test_kernel
+ * \return the number of mismatches.
+ * \param name : [in] kernel name for the report.
+ * \param kernel : [in] checksum kernel to compare to ip_checksum_reference().
+ * \brief Compare "kernel" to the reference for every length and alignment.
+ * *******************************************************************/
+static u32_t test_kernel(const char* name, u16_t (*kernel)(const u16_t*, u32_t))
+{
+  u32_t errors = 0;
+  u32_t offset;
+  u32_t length;
+  u32_t i;
+  const u16_t* buffer;
+
+  for( offset = 0; offset < TEST_ALIGNMENTS; offset++)
+  {
+    buffer = (const u16_t*)(test_pattern + offset);
+    for( length = 0; length <= TEST_MAX_SHORT_LENGTH; length++)
+    {
+      if( kernel(buffer, length) != ip_checksum_reference(buffer, length) )
+      {
+        if( errors++ < 10 ) { printf("%s: offset %lu length %lu differs\n", name, (unsigned long)offset, (unsigned long)length);}
+      }
+    }
+    for( i = 0; i < sizeof(test_long_lengths)/sizeof(test_long_lengths[0]); i++)
+    {
+      length = test_long_lengths[i];
+      if( kernel(buffer, length) != ip_checksum_reference(buffer, length) )
+      {
+        if( errors++ < 10 ) { printf("%s: offset %lu length %lu differs\n", name, (unsigned long)offset, (unsigned long)length);}
+      }
+    }
+  }
+  return errors;
+}
+
+/*!
+ * Function name: test_copy_checksum
+ * \return the number of mismatches.
+ * \brief Compare ip_copy_checksum() to the reference and check the copy,
+ * for every length, byte alignment of the input and 16-bit alignment of 
+ * the output.
+ * *******************************************************************/
+static u32_t test_copy_checksum(void)
+{
+  u32_t errors = 0;
+  u32_t in_offset;
+  u32_t out_offset;
+  u32_t length;
+  u8_t* output;
+
+  for( in_offset = 0; in_offset < TEST_ALIGNMENTS; in_offset++)
+  {
+    for( out_offset = 0; out_offset < TEST_ALIGNMENTS; out_offset += sizeof(u16_t))
+    {
+      output = test_copy + out_offset;
+      for( length = 0; length <= TEST_MAX_SHORT_LENGTH; length += (length < 256)? 1 : 7)
+      {
+        if( (ip_copy_checksum(output, test_pattern + in_offset, length) != ip_checksum_reference((const u16_t*)output, length)) ||
+            memcmp(output, test_pattern + in_offset, length) )
+        {
+          if( errors++ < 10 ) { printf("ip_copy_checksum: input offset %lu output offset %lu length %lu differs\n", (unsigned long)in_offset, (unsigned long)out_offset, (unsigned long)length);}
+        }
+      }
+    }
+  }
+  return errors;
+}
+
+/*!
+ * Function name: test_all
+ * \return the number of mismatches.
+ * \brief Run every test on the current "test_pattern".
+ * *******************************************************************/
+static u32_t test_all(void)
+{
+  u32_t errors = 0;
+
+  errors += test_kernel("ip_checksum_word", ip_checksum_word);
+#ifdef IP_CHECKSUM_SSE2
+  errors += test_kernel("ip_checksum_sse2", ip_checksum_sse2);
+#endif
+#ifdef IP_CHECKSUM_AVX2
+  if( __builtin_cpu_supports("avx2") ) { errors += test_kernel("ip_checksum_avx2", ip_checksum_avx2);}
+  else { printf("ip_checksum_avx2: not supported by the processor, skipped\n");}
+#endif
+#ifdef IP_CHECKSUM_NEON
+  errors += test_kernel("ip_checksum_neon", ip_checksum_neon);
+#endif
+  errors += test_kernel("ip_checksum", ip_checksum);
+  errors += test_copy_checksum();
+  return errors;
+}
+
+int main(void)
+{
+  u32_t errors;
+
+  ip_checksum_init();
+  test_fill(FALSE);
+  errors = test_all();
+  test_fill(TRUE);
+  errors += test_all();
+  printf("checksum kernels: %lu mismatch(es)\n", (unsigned long)errors);
+  return (errors == 0)? 0 : 1;
+}
@@ -0,0 +1,305 @@
+/* Copyright (c) 2010,  Jean-Marc David
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*  * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*  * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*  * Neither the name of the author nor the names of its contributors
+* may be used to endorse or promote products derived from this software
+* without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+* IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+* OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+* IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+*  AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+* Author: Jean-Marc David jmdavid1789<at>googlemail.com
+* http://sourceforge.net/projects/cipsuite/ <br>
+*/
+/*!
+* \namespace tcp_test
+* \file tcp_test.c
+* \brief  Host test of the TCP logic (make check):
+* - the 32-bit sequence number and clock arithmetic around the roll-over,
+* with the u32_t of the host (64-bit on LP64 hosts);
+* - the SYN cookie round trip: once the SYN backlog is full, the SYN|ACK
+* of a server carries the request and its final ACK creates the connection.
+* Forged or expired cookies are dropped.
+* \note tcp.c is included to reach its static functions. The SYN cookie
+* test builds frames: it only runs if the headers have the layout of the
+* network (u32_t of 32 bits, see the Makefile).
+***************************************************/
+
+#include <stdio.h>
+#include <string.h> //for memset, memcpy
+#include "../tcp.c"
+
+#define TEST_LOCAL_IP 0xC0A80001UL //!< Address of the adapter under test.
+#define TEST_REMOTE_IP 0xC0A80002UL //!< Address of the simulated peer device.
+#define TEST_PORT 80 //!< Port of the server under test.
+#define TEST_MASK 0xFFFFFFFFUL //!< 32-bit sequence numbers.
+
+static const u8_t test_local_mac[MAC_ADDRESS_LENGTH] = {0x00, 0x0A, 0x35, 0x00, 0x00, 0x01};
+static const u8_t test_remote_mac[MAC_ADDRESS_LENGTH] = {0x00, 0x0A, 0x35, 0x00, 0x00, 0x02};
+
+static u8_t test_frame[NETWORK_MTU]; //!< Segment of the peer device, from the Ethernet header.
+static u8_t test_sent[NETWORK_MTU]; //!< Last frame sent by the adapter.
+static u32_t test_sent_length;
+static u32_t test_accepted;
+static TCP_T* test_child;
+
+/*!
+ * Function name: test_check
+ * \return 1 if "condition" is FALSE, 0 otherwise.
+ * \param condition : [in] result of the check.
+ * \param what : [in] description for the report.
+ * \brief Report a failed check.
+ * *******************************************************************/
+static u32_t test_check(bool_t condition, const char* what)
+{
+  if( !condition ) { printf("FAILED: %s\n", what);}
+  return (condition)? 0 : 1;
+}
+
+/*!
+ * Function name: test_sequence_numbers
+ * \return the number of failed checks.
+ * \brief Compare sequence numbers and clocks across the roll-over of 2^32,
+ * including values that carry past bit 31 where u32_t is wider.
+ * *******************************************************************/
+static u32_t test_sequence_numbers(void)
+{
+  u32_t errors = 0;
+  u32_t before = 0xFFFFFFF0UL;
+  u32_t after = 0x10UL;
+  u32_t sum = before + 0x20UL; //Not masked: 0x100000010 where u32_t is 64-bit.
+  TCP_T tcp_c;
+
+  errors += test_check(U32_BEFORE(before, after), "0xFFFFFFF0 is before 0x10");
+  errors += test_check(!U32_BEFORE(after, before), "0x10 is not before 0xFFFFFFF0");
+  errors += test_check(!U32_BEFORE(sum, after) && !U32_BEFORE(after, sum), "an unmasked sum equals its 32-bit value");
+  errors += test_check(!U32_BEFORE(after, after), "a number is not before itself");
+  errors += test_check(U32_BEFORE(0x7FFFFFFFUL, 0xFFFFFFFEUL) && !U32_BEFORE(0xFFFFFFFEUL, 0x7FFFFFFFUL), "2^31 - 1 apart");
+  errors += test_check(TCP_SEQ_LT(before, after) && TCP_SEQ_GT(after, before), "TCP_SEQ_LT and TCP_SEQ_GT across the roll-over");
+  errors += test_check(!TCP_SEQ_GT(sum, after) && !TCP_SEQ_LT(sum, after), "TCP_SEQ_GT on an unmasked sum");
+  errors += test_check(U32_DIFF(after, before) == 0x20UL, "U32_DIFF across the roll-over");
+  errors += test_check(U32_DIFF(sum, before) == 0x20UL, "U32_DIFF of an unmasked sum");
+  errors += test_check(U32_DIFF(before, after) == 0xFFFFFFE0UL, "U32_DIFF stays on 32 bits");
+  errors += test_check(((before - after) & TCP_SEQ_MASK) == 0xFFFFFFE0UL, "TCP_SEQ_MASK");
+
+  memset(&tcp_c, 0, sizeof(tcp_c));
+  tcp_c.snd_ring_base = before;
+  errors += test_check(TCP_SND_RING_INDEX(&tcp_c, after) == (0x20UL % TCP_SND_BUF), "index of the send ring across the roll-over");
+  tcp_c.snd_una = before;
+  tcp_c.snd_nxt = after;
+  tcp_c.snd_queued = 0;
+  errors += test_check(TCP_SND_SPACE(&tcp_c) == TCP_SND_BUF - 0x20UL, "free space of the send ring across the roll-over");
+  errors += test_check((tcp_syn_mix(0xFFFFFFFFUL) & ~TEST_MASK) == 0, "tcp_syn_mix() stays on 32 bits");
+  return errors;
+}
+
+/*!
+ * Function name: test_driver_send
+ * \return ERR_OK.
+ * \brief Device driver of the adapter under test: keep the last frame.
+ * *******************************************************************/
+static err_t test_driver_send(void* arg, u8_t* frame, u32_t frame_length)
+{
+  memcpy(test_sent, frame, frame_length);
+  test_sent_length = frame_length;
+  return ERR_OK;
+}
+
+/*!
+ * Function name: test_driver_recv
+ * \return 0: the frames are given to tcp_listen_syn() and tcp_listen_ack().
+ * *******************************************************************/
+static u32_t test_driver_recv(void* arg, u8_t* frame)
+{
+  return 0;
+}
+
+/*!
+ * Function name: test_accept
+ * \return ERR_OK.
+ * \brief Server callback: count the connections created.
+ * *******************************************************************/
+static err_t test_accept(void* arg, TCP_T* tcp_c)
+{
+  test_accepted++;
+  test_child = tcp_c;
+  return ERR_OK;
+}
+
+/*!
+ * Function name: test_segment
+ * \return the TCP header of "test_frame".
+ * \param remote_port : [in] port of the peer device.
+ * \param seqno : [in] sequence number.
+ * \param ackno : [in] acknowledgment number.
+ * \param flags : [in] TCP_SYN or TCP_ACK.
+ * \param mss : [in] MSS option, 0 for none.
+ * \brief Build a segment of the peer device to the server.
+ * *******************************************************************/
+static TCP_HEADER_T* test_segment(u16_t remote_port, u32_t seqno, u32_t ackno, u16_t flags, u16_t mss)
+{
+  ETHER_HEADER_T* ethhdr = (ETHER_HEADER_T*)test_frame;
+  IP_HEADER_T* iphdr = (IP_HEADER_T*)(test_frame + sizeof(ETHER_HEADER_T));
+  TCP_HEADER_T* tcphdr = (TCP_HEADER_T*)(test_frame + sizeof(ETHER_HEADER_T) + sizeof(IP_HEADER_T));
+  u8_t* options = test_frame + ETH_IP_TCP_HEADER_SIZE;
+  u32_t options_length = 0;
+
+  memset(test_frame, 0, sizeof(test_frame));
+  memcpy(ethhdr->destination_addr, test_local_mac, MAC_ADDRESS_LENGTH);
+  memcpy(ethhdr->source_addr, test_remote_mac, MAC_ADDRESS_LENGTH);
+  ethhdr->frame_type = htons(ETHERTYPE_IP);
+  if( mss )
+  {
+    options[0] = TCP_OPTION_MSS;
+    options[1] = 4;
+    options[2] = (u8_t)(mss >> 8);
+    options[3] = (u8_t)mss;
+    options_length = 4;
+  }
+  iphdr->version_head_length = 0x45;
+  iphdr->length = htons(sizeof(IP_HEADER_T) + sizeof(TCP_HEADER_T) + options_length);
+  iphdr->protocol = IP_TCP;
+  iphdr->source_addr = htonl((u32_t)TEST_REMOTE_IP);
+  iphdr->dest_addr = htonl((u32_t)TEST_LOCAL_IP);
+  tcphdr->source_port = htons(remote_port);
+  tcphdr->dest_port = htons(TEST_PORT);
+  tcphdr->seqno = htonl(seqno & TEST_MASK);
+  tcphdr->ackno = htonl(ackno & TEST_MASK);
+  TCP_SET_HEADER_LENGTH(tcphdr, sizeof(TCP_HEADER_T) + options_length);
+  TCP_SET_FLAGS(tcphdr, flags);
+  tcphdr->windowsize = htons(8192);
+  return tcphdr;
+}
+
+/*!
+ * Function name: test_syn
+ * \return the sequence number of the SYN|ACK, 0 if the server sent none.
+ * \param server : [in] server under test.
+ * \param remote_port : [in] port of the peer device.
+ * \param irs : [in] sequence number of the SYN.
+ * \param mss : [in] MSS option of the SYN.
+ * \brief Send a SYN to the server and read the ISS of its SYN|ACK.
+ * *******************************************************************/
+static u32_t test_syn(TCP_T* server, u16_t remote_port, u32_t irs, u16_t mss)
+{
+  const TCP_HEADER_T* synack = (const TCP_HEADER_T*)(test_sent + sizeof(ETHER_HEADER_T) + sizeof(IP_HEADER_T));
+
+  (void)test_segment(remote_port, irs, 0, TCP_SYN, mss);
+  test_sent_length = 0;
+  (void)tcp_listen_syn(server, test_frame + sizeof(ETHER_HEADER_T));
+  if( (test_sent_length == 0) || (TCP_GET_FLAGS(synack) != (TCP_SYN | TCP_ACK)) || (ntohl(synack->ackno) != ((irs + 1) & TEST_MASK)) )
+  { return 0;}
+  return ntohl(synack->seqno);
+}
+
+/*!
+ * Function name: test_ack
+ * \return TRUE if the ACK created a connection.
+ * \param server : [in] server under test.
+ * \param remote_port : [in] port of the peer device.
+ * \param irs : [in] sequence number of the SYN.
+ * \param iss : [in] sequence number of the SYN|ACK acknowledged.
+ * \brief Send the final ACK of the three-way handshake to the server.
+ * *******************************************************************/
+static bool_t test_ack(TCP_T* server, u16_t remote_port, u32_t irs, u32_t iss)
+{
+  TCP_HEADER_T* tcphdr = test_segment(remote_port, irs + 1, iss + 1, TCP_ACK, 0);
+  u32_t accepted = test_accepted;
+
+  test_child = NULL;
+  (void)tcp_listen_ack(server, test_frame + sizeof(ETHER_HEADER_T), tcphdr, 0);
+  return (test_accepted != accepted);
+}
+
+/*!
+ * Function name: test_syn_cookies
+ * \return the number of failed checks.
+ * \brief Fill the SYN backlog then connect with SYN cookies: the MSS is
+ * restored, a forged cookie and a cookie older than two periods are dropped.
+ * *******************************************************************/
+static u32_t test_syn_cookies(void)
+{
+  u32_t errors = 0;
+  NETIF_T* adapter;
+  TCP_T* server;
+  err_t err = ERR_OK;
+  u32_t iss;
+  u32_t expired_iss;
+  u32_t i;
+
+  netif_init();
+  adapter = netif_new((u8_t*)test_local_mac, TEST_LOCAL_IP, 0xFFFFFF00UL, 0, "T0", FALSE, test_driver_recv, test_driver_send, NULL, &err);
+  if( test_check(adapter != NULL, "netif_new") ) { return 1;}
+  netif_syn_secret(adapter, 0x5EC2E7UL);
+  server = tcp_new(TEST_LOCAL_IP, TEST_PORT, &err);
+  if( test_check(server != NULL, "tcp_new") ) { return 1;}
+  tcp_accept(server, test_accept);
+  (void)tcp_listen(server);
+
+  for( i = 0; i < TCP_SYN_BACKLOG; i++) //Fill the backlog: the next requests get a cookie.
+  { errors += test_check(test_syn(server, (u16_t)(1000 + i), 1000 * i, 1460) != 0, "SYN|ACK of a request of the backlog");}
+
+  //Round trip, with a sequence number of the SYN that rolls over at the ACK.
+  iss = test_syn(server, 2000, 0xFFFFFFFFUL, 1460);
+  errors += test_check(iss != 0, "SYN|ACK of a cookie");
+  errors += test_check(tcp_syn_lookup(adapter, server, TEST_REMOTE_IP, 2000) == NULL, "a cookie takes no room in the backlog");
+  errors += test_check(test_ack(server, 2000, 0xFFFFFFFFUL, iss ^ 0x100UL) == FALSE, "a forged cookie is dropped");
+  errors += test_check(test_ack(server, 2000, 0xFFFFFFFFUL, iss) == TRUE, "the cookie creates the connection");
+  if( test_child != NULL )
+  {
+    errors += test_check(test_child->remote_mss == 1460, "the cookie restores the MSS");
+    errors += test_check(test_child->remote_seqno == 0, "the connection acknowledges the SYN across the roll-over");
+    errors += test_check(test_child->snd_una == ((iss + 1) & TEST_MASK), "the SYN|ACK is acknowledged");
+  }
+
+  //The MSS is rounded down to a value of "tcp_syn_cookie_mss".
+  iss = test_syn(server, 2001, 0x12345678UL, 1000);
+  errors += test_check(test_ack(server, 2001, 0x12345678UL, iss) == TRUE, "the cookie of a small MSS creates the connection");
+  if( test_child != NULL ) { errors += test_check(test_child->remote_mss == 536, "the small MSS is rounded down");}
+
+  //A cookie is valid during its period and the next one. Both are sent
+  //before the requests of the backlog expire.
+  iss = test_syn(server, 2002, 0x7FFFFFFFUL, 1460);
+  expired_iss = test_syn(server, 2003, 0x80000000UL, 1460);
+  errors += test_check(tcp_syn_lookup(adapter, server, TEST_REMOTE_IP, 2003) == NULL, "SYN|ACK of a cookie");
+  adapter->tcp_clock += 1UL << 16;
+  errors += test_check(test_ack(server, 2002, 0x7FFFFFFFUL, iss) == TRUE, "the cookie of the previous period is valid");
+  adapter->tcp_clock += 1UL << 16;
+  errors += test_check(test_ack(server, 2003, 0x80000000UL, expired_iss) == FALSE, "an expired cookie is dropped");
+  return errors;
+}
+
+int main(void)
+{
+  u32_t errors;
+
+  errors = test_sequence_numbers();
+  printf("sequence numbers (u32_t of %lu bits): %lu failure(s)\n", (unsigned long)(8 * sizeof(u32_t)), (unsigned long)errors);
+  if( (sizeof(TCP_HEADER_T) == 20) && (sizeof(IP_HEADER_T) == 20) )
+  {
+    u32_t cookie_errors = test_syn_cookies();
+    printf("SYN cookies: %lu failure(s)\n", (unsigned long)cookie_errors);
+    errors += cookie_errors;
+  }
+  else
+  {
+    printf("SYN cookies: the headers do not have the network layout with this u32_t, skipped\n");
+  }
+  return (errors == 0)? 0 : 1;
+}
@@ -45,6 +45,7 @@
 #include "udp.h"
 
 #define ETH_IP_UDP_HEADER_SIZE ( sizeof(ETHER_HEADER_T) + sizeof(IP_HEADER_T) + sizeof(UDP_HEADER_T) )
+#define UDP_MTU (NETWORK_MTU - (ETH_IP_UDP_HEADER_SIZE + ETHER_CRC_LENGTH)) //Max data in a frame
 
 /*!UDP states
 UDP_UNUSED: the udp_c is free.
@@ -61,8 +62,11 @@ static u16_t udp_new_port( NETIF_T* net_adapter);
 static UDP_T* udp_malloc(NETIF_T *net_adapter);
 static void udp_remove_controller( UDP_T** udp_cs,  UDP_T* udp_c );
 static void udp_register( UDP_T** udp_cs,  UDP_T* udp_c );
-static void udp_order_active_list( UDP_T** udp_cs, const NETIF_T* const net_adapter);
+static void udp_list_insert( UDP_T** list, UDP_T* udp_c );
+static void udp_list_remove( UDP_T* udp_c );
 static void udp_init_connection (UDP_T* const udp_c, const u8_t* const dest_mac_addr);
+static UDP_CYCLIC_T* udp_cyclic_lookup( NETIF_T* net_adapter, const UDP_T* const udp_c);
+static void udp_build_frame(UDP_T *udp_c, u32_t data_length);
 
 
 /*!
@@ -70,12 +74,13 @@ static void udp_init_connection (UDP_T* const udp_c, const u8_t* const dest_mac_
  * \return ERR_OK or ERR_CHECKSUM.
  * \param ip_frame : [in] IP frame.
  * \param ip_frame_length : Value of (IP header + UDP header + app_data).
+ * \param rx_checksum : [in] NETIF_CHECKSUM_RX_* checksums already verified by the adapter.
  * \param net_adapter : [in] network adapter.
  * \brief The application opens some UDP ports (see udp_new()).
  * An UDP frame comes in, udp_parse() looks for the open port matching
  * the incoming frame.
  * *******************************************************************/
-err_t udp_parse(u8_t* ip_frame, u32_t ip_frame_length, NETIF_T *net_adapter)
+err_t udp_parse(u8_t* ip_frame, u32_t ip_frame_length, u32_t rx_checksum, NETIF_T *net_adapter)
 {
   UDP_T *udp_c;
   UDP_HEADER_T* udphdr;
@@ -100,11 +105,15 @@ err_t udp_parse(u8_t* ip_frame, u32_t ip_frame_length, NETIF_T *net_adapter)
     u32_t udp_length;
     u16_t pseudo_checksum;
 
-    //Verify UDP checksum.
-    if( udphdr->chksum )
+    //Verify UDP checksum (unless the adapter did it).
+    if( udphdr->chksum && !(rx_checksum & NETIF_CHECKSUM_RX_UDP) )
     {
       udp_length = ip_frame_length - ip_header_length;
-      pseudo_checksum = eth_build_pseudo_header( ntohl(iphdr->dest_addr) , ntohl(iphdr->source_addr), udp_length - sizeof(UDP_HEADER_T), sizeof(UDP_HEADER_T), IP_UDP);
+      if( udp_c->frame_initialized && (udp_c->remote_ip == ntohl(iphdr->source_addr)) && (udp_c->local_ip == ntohl(iphdr->dest_addr)) ) {
+        pseudo_checksum = ip_pseudo_header_length( udp_c->pseudo_sum, udp_length); //The frame comes from the connected peer.
+      } else {
+        pseudo_checksum = eth_build_pseudo_header( ntohl(iphdr->dest_addr) , ntohl(iphdr->source_addr), udp_length - sizeof(UDP_HEADER_T), sizeof(UDP_HEADER_T), IP_UDP);
+      }
       if(pseudo_checksum != udphdr->chksum){
         checksum = ip_checksum( (const u16_t*)udphdr, udp_length);
         checksum += (u32_t)pseudo_checksum;
@@ -150,6 +159,10 @@ err_t udp_parse(u8_t* ip_frame, u32_t ip_frame_length, NETIF_T *net_adapter)
       err =adapter_store_error( ERR_CHECKSUM, net_adapter, __func__, __LINE__);
     }
   }
+  else //No open port: the frame is dropped before its checksum is verified.
+  {
+    net_adapter->unmatched_nb++;
+  }
   return err;
 }
 
@@ -179,6 +192,7 @@ void udp_recv (UDP_T *udp_c, err_t (* recv)(void *arg, UDP_T *udp_c, void* data,
  * *******************************************************************/
 void udp_delete(UDP_T *udp_c)
 {
+  udp_cyclic_remove(udp_c);
   udp_c->state = UDP_UNUSED;
  (void) udp_remove_controller( &(udp_c->netif->udp_cs), udp_c );
 }
@@ -258,6 +272,7 @@ err_t udp_connect(UDP_T* udp_c, u32_t ipaddr, u16_t port)
       udp_c->remote_ip = ipaddr;
       udp_c->remote_port = port;
       udp_c->state = UDP_KNOWN_TARGET;
+      udp_c->frame_initialized = FALSE; //The headers and the speudo header sum hold the previous peer (if any).
       T_DEBUGF(UDP_DEBUG, ("udp_connect: connected to %ld.%ld.%ld.%ld, port %d\r\n",
                  (udp_c->remote_ip >> 24 & 0xff), (udp_c->remote_ip >> 16 & 0xff), (udp_c->remote_ip >> 8 & 0xff), (udp_c->remote_ip & 0xff), udp_c->remote_port));
       (void)udp_register(&(udp_c->netif->udp_cs), udp_c);
@@ -286,6 +301,7 @@ err_t udp_send(UDP_T *udp_c, void* data, u32_t data_length, bool_t reuse)
 {
   u32_t length;
   UDP_HEADER_T *udphdr;
+  u32_t data_checksum = 0;
   err_t err = ERR_OK;
 
   T_ASSERT(("%s#%d UDP socket is not created.\r\n",__func__, __LINE__), udp_c != NULL);
@@ -298,12 +314,16 @@ err_t udp_send(UDP_T *udp_c, void* data, u32_t data_length, bool_t reuse)
     udphdr = (UDP_HEADER_T *)(udp_c->frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T));
 
     if( data != NULL) {//if ( data == NULL) then data are inserted directly into the frame as they are gathered. "udp_get_data_pointer" is used.
-      //Insert data into the frame
-      u8_t* psrc = (u8_t*)data;
-      u8_t* pdst = udp_c->app_data;
-      u32_t i = data_length;
-      while(i--) {
-        *(pdst++) = *(psrc++);
+      //Insert data into the frame and sum them in the same pass.
+      if( udp_c->netif->checksum_offload & NETIF_CHECKSUM_TX_UDP ) { //The adapter sums the data.
+        u8_t* psrc = (u8_t*)data;
+        u8_t* pdst = udp_c->app_data;
+        u32_t i = data_length;
+        while(i--) {
+          *(pdst++) = *(psrc++);
+        }
+      } else {
+        data_checksum = ip_copy_checksum(udp_c->app_data, (const u8_t*)data, data_length);
       }
     }
     //cIPs limits the calculation. 
@@ -311,24 +331,23 @@ err_t udp_send(UDP_T *udp_c, void* data, u32_t data_length, bool_t reuse)
     //The structure has a fixed length. If the length is constant and the peer device always the same
     //then cIPS does not need to update a few fields. The fields in the following case:
     if( (!reuse) || (!udp_c->frame_initialized)) { //constant length: do not update the length and speudo-cheksum.
-      udphdr->length = htons(length);
-      if( !udp_c->point_to_point ) {
-        udp_c->chksum_len = eth_build_pseudo_header( udp_c->remote_ip , udp_c->local_ip, data_length, sizeof(UDP_HEADER_T), IP_UDP);
-      } else {
-        udphdr->chksum = 0; // "udphdr->chksum" stays at zero if there is no checksum required (point to point case). Otherwise, cIPS resets it before calculating the checksum ip_checksum().
-      }
-      (void)eth_build_ip_request(udp_c->remote_ip, udp_c->local_ip, udp_c->frame + sizeof(ETHER_HEADER_T),data_length + sizeof(UDP_HEADER_T), IP_UDP, udp_c->frame_initialized);
-      (void)udp_init_connection (udp_c, udp_c->target_mac_addr);
+      udp_build_frame(udp_c, data_length);
     }
 
     //Another optimization. If the connection to the peer device is point-to-point
     //many checksums certifiy the frame (MAC, IP, UDP). It is not true anymore if the frame goes
     //through a gateway. The following case saves the UDP checksum calculation
-    if( !udp_c->point_to_point ) {
+    if( udp_c->netif->checksum_offload & NETIF_CHECKSUM_TX_UDP ) {
+      udphdr->chksum = 0; //The adapter inserts the checksum.
+    } else if( !udp_c->point_to_point ) {
       u32_t checksum;
       udphdr->chksum = 0; //The checksum calculation ip_checksum() adds "udphdr->chksum" and requires that it is set to zero.
       checksum = udp_c->chksum_len; //"checksum" is big endian. "udp_c->chksum_len" is big endian because it is the return of eth_build_pseudo_header() which is big endian.
-      checksum += ip_checksum((const u16_t*)udphdr, length); // ones complement cksum of struct
+      if( data != NULL) { //The application data are already summed.
+        checksum += data_checksum + ip_checksum((const u16_t*)(udp_c->frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T)), sizeof(UDP_HEADER_T));
+      } else {
+        checksum += ip_checksum((const u16_t*)(udp_c->frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T)), length); // ones complement cksum of struct
+      }
       //Fold 32-bit sum to 16 bits and add carry
       while( checksum >> 16) {
         checksum = (checksum & 0xFFFF) + (checksum >> 16);
@@ -346,6 +365,30 @@ err_t udp_send(UDP_T *udp_c, void* data, u32_t data_length, bool_t reuse)
   return err;
 }
 
+/*!
+ * Function name: udp_build_frame
+ * \return nothing.
+ * \param udp_c : [in/out] connected udp_c (udp_c->remote_ip is set).
+ * \param data_length : [in] Application data length in bytes.
+ * \brief Build the Ethernet, IP and UDP headers of udp_c->frame and the
+ * pseudo-header sum for "data_length" bytes of application data.
+ * udp_send() only rebuilds them if the length or the peer changes.
+ * *******************************************************************/
+static void udp_build_frame(UDP_T *udp_c, u32_t data_length)
+{
+  u32_t length = sizeof(UDP_HEADER_T) + data_length;
+  UDP_HEADER_T *udphdr = (UDP_HEADER_T *)(udp_c->frame + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T));
+
+  udphdr->length = htons(length);
+  (void)eth_build_ip_request(udp_c->remote_ip, udp_c->local_ip, udp_c->frame + sizeof(ETHER_HEADER_T),data_length + sizeof(UDP_HEADER_T), IP_UDP, udp_c->frame_initialized);
+  (void)udp_init_connection (udp_c, udp_c->target_mac_addr);
+  if( !udp_c->point_to_point ) {
+    udp_c->chksum_len = ip_pseudo_header_length( udp_c->pseudo_sum, length);
+  } else {
+    udphdr->chksum = 0; // "udphdr->chksum" stays at zero if there is no checksum required (point to point case). Otherwise, cIPS resets it before calculating the checksum ip_checksum().
+  }
+}
+
 /*!
  * Function name: udp_get_data_pointer
  * \return A pointer to the data part of an UDP frame.
@@ -368,135 +411,236 @@ u8_t* udp_get_data_pointer( UDP_T* udp_c )
 }
 
 /*!
- * Function name: udp_store_error
- * \return nothing
- * \param err : [in] error number.
- * \param udp_c : [in/out] udp_c sending the error.
- * \param function_name : [in] function name where the error is happening.
- * \param line_number : [in] line number where the error is happening.
- * \brief Format a string to report a UDP error.
+ * Function name: udp_cyclic_register
+ * \return ERR_OK, ERR_VAL if the period is zero or ERR_UDP_MEM if more
+ * than MAX_UDP_CYCLIC streams already exist on the adapter.
+ * \param udp_c : [in/out] udp_c sending the stream. It must be connected (see udp_connect()).
+ * \param period : [in] Period of the stream in ticks of the application timer.
+ * \param phase : [in] Offset of the stream in ticks (phase < period).
+ * \param data_length : [in] Length of the application data when "fill" is NULL.
+ * \param fill : [in] Callback filling the application data in place or NULL.
+ * \param fill_arg : [in] argument associated to the "fill" callback.
+ * \brief Register a time-triggered UDP stream sent by udp_cyclic_timer().
  * *******************************************************************/
-static err_t udp_store_error( const err_t err, UDP_T* const udp_c, const s8_t* const function_name, const u32_t line_number)
+err_t udp_cyclic_register(UDP_T *udp_c, u32_t period, u32_t phase, u32_t data_length,
+    u32_t (* fill)(void *arg, UDP_T *udp_c, u8_t *app_data, u32_t max_length), void *fill_arg)
 {
-  ERROR_REPORT_T* last_error = &(udp_c->netif->last_error);
-  last_error->err_nb = err;
-  snprintf(last_error->formated_error,MAX_FORMATED_ERROR_SIZE,"%s#%d-%d: UDP error: %s (fct %s #%ld)",udp_c->netif->name, udp_c->local_port, udp_c->remote_port, decode_err(err), function_name, line_number);
+  err_t err = ERR_OK;
+  UDP_CYCLIC_T* stream;
+
+  T_ASSERT(("%s#%d UDP socket is not created.\r\n",__func__, __LINE__), udp_c != NULL);
+
+  if( period == 0 ) {
+    err = udp_store_error( ERR_VAL, udp_c, __func__, __LINE__);
+  } else {
+    //A socket has one stream at most: re-use its entry if it is already registered.
+    stream = udp_cyclic_lookup(udp_c->netif, udp_c);
+    if( stream == NULL ) {
+      stream = udp_cyclic_lookup(udp_c->netif, NULL);
+    }
+    if( stream != NULL ) {
+      NETIF_LOCK(); //udp_cyclic_timer() may run in the timer ISR.
+      stream->udp_c = NULL; //Hide the entry while it is updated.
+      stream->period = period;
+      stream->phase = phase % period;
+      stream->next_release = 0;
+      stream->armed = FALSE; //The first call to udp_cyclic_timer() aligns the release times on the phase.
+      stream->data_length = (data_length < UDP_MTU)? data_length: UDP_MTU;
+      stream->last_length = ~0; //Force udp_send() to build the frame the first time.
+      if( udp_c->state == UDP_KNOWN_TARGET ) { //Prebuild the frame so the timer tick only fills and sums the data.
+        udp_build_frame(udp_c, stream->data_length);
+        stream->last_length = stream->data_length;
+      }
+      stream->fill = fill;
+      stream->fill_arg = fill_arg;
+      stream->sent_nb = 0;
+      stream->missed_nb = 0;
+      stream->last_lateness = 0;
+      stream->max_lateness = 0;
+      stream->udp_c = udp_c;
+      NETIF_UNLOCK();
+      T_DEBUGF(UDP_DEBUG,("%s#%d: cyclic stream every %ld ticks (phase %ld)\r\n",udp_c->netif->name, udp_c->local_port, period, stream->phase));
+    } else {
+      T_ERROR(("Cannot register a cyclic UDP stream. Increase MAX_UDP_CYCLIC (>%d)\r\n",MAX_UDP_CYCLIC));
+      err = udp_store_error( ERR_UDP_MEM, udp_c, __func__, __LINE__);
+    }
+  }
   return err;
 }
 
+/*!
+ * Function name: udp_cyclic_remove
+ * \return nothing.
+ * \param udp_c : [in/out] udp_c of interest.
+ * \brief Stop the cyclic stream of udp_c if any.
+ * *******************************************************************/
+void udp_cyclic_remove(UDP_T *udp_c)
+{
+  UDP_CYCLIC_T* stream = udp_cyclic_lookup(udp_c->netif, udp_c);
+
+  if( stream != NULL ) {
+    NETIF_LOCK(); //udp_cyclic_timer() may run in the timer ISR.
+    stream->udp_c = NULL;
+    NETIF_UNLOCK();
+  }
+}
 
 /*!
- * Function name: udp_malloc
- * \return free_udp_c: a pointer to a new udp_c.
- * \param net_adapter : [in] network adapter.
- * \brief cIPS works with static memory. cIPS has a finite list (or array)
- * of MAX_UDP UDP connection. udp_malloc() books a udp_c in the list 
- * of UDP controllers and returns a
- * reference to it.
+ * Function name: udp_cyclic_timer
+ * \return ERR_OK, ERR_MAC_ADDR_UNKNOWN, ERR_DEVICE_DRIVER.
+ * \param net_adapter : [in/out] adapter of interest.
+ * \param now : [in] Current tick of the application timer (it may roll over).
+ * \brief Send the cyclic UDP streams that are due.
+ * \note The frame is built once then reused (see udp_send()) as long as the
+ * data length does not change, so each period only costs the data fill,
+ * the UDP checksum and the device driver call.
  * *******************************************************************/
-static UDP_T* udp_malloc(NETIF_T *net_adapter)
+err_t udp_cyclic_timer(NETIF_T *net_adapter, u32_t now)
 {
-  UDP_T* free_udp_c = NULL;
-  UDP_T* udp_c_list = net_adapter->udp_c_list;
+  err_t err = ERR_OK;
+  UDP_CYCLIC_T* stream = net_adapter->udp_cyclic_list;
   u32_t i;
 
-  for( i = 0; i < MAX_UDP; i++)
+  for( i = 0; i < MAX_UDP_CYCLIC; i++, stream++)
   {
-    if( udp_c_list[i].state == UDP_UNUSED)
-    { //Configure the new connection
-      free_udp_c = &udp_c_list[i];
-      free_udp_c->local_ip = 0;
-      free_udp_c->remote_ip = 0;
-      free_udp_c->next = NULL;
-      free_udp_c->local_port = 0;
-      free_udp_c->remote_port = 0;
-      free_udp_c->chksum_len = 0;
-      free_udp_c->app_data = free_udp_c->frame + sizeof(UDP_HEADER_T) + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T);
-      free_udp_c->frame_initialized = FALSE;
-      free_udp_c->netif = net_adapter;
-      free_udp_c->state = UDP_ANY_TARGET;
-      free_udp_c->recv = NULL;
-      free_udp_c->recv_arg = NULL;
-      i = MAX_UDP; // exit loop
+    if( stream->udp_c != NULL ) {
+      if( !stream->armed ) { //Release times are the ticks "t" such as (t % period) == phase.
+        //"now - phase" would wrap when now < phase and break the slot if the period does not divide 2^32.
+        u32_t offset = ((now % stream->period) + stream->period - stream->phase) % stream->period;
+        stream->next_release = ((offset)? now + (stream->period - offset): now) & 0xFFFFFFFF;
+        stream->armed = TRUE;
+      }
+
+      if( !U32_BEFORE(now, stream->next_release) ) { //"now" may have rolled over.
+        UDP_T* udp_c = stream->udp_c;
+        u32_t lateness = (now - stream->next_release) & 0xFFFFFFFF; //u32_t may be 64-bit wide.
+        u32_t length = stream->data_length;
+        err_t send_err = ERR_OK;
+
+        //The application called udp_cyclic_timer() more than one period late.
+        //Skip the missed release times instead of sending them in a burst.
+        if( lateness >= stream->period ) {
+          u32_t skipped = lateness / stream->period;
+          stream->missed_nb += skipped;
+          stream->next_release = (stream->next_release + skipped * stream->period) & 0xFFFFFFFF;
+          lateness -= skipped * stream->period;
+        }
+        stream->next_release = (stream->next_release + stream->period) & 0xFFFFFFFF;
+
+        if( udp_c->state == UDP_KNOWN_TARGET ) {
+          if( stream->fill ) {
+            length = stream->fill( stream->fill_arg, udp_c, udp_c->app_data, UDP_MTU);
+            if( length > UDP_MTU ) { length = UDP_MTU;}
+          }
+          send_err = udp_send( udp_c, NULL, length, (length == stream->last_length));
+          stream->last_length = length;
+          stream->sent_nb++;
+          stream->last_lateness = lateness;
+          if( lateness > stream->max_lateness ) { stream->max_lateness = lateness;}
+        } else { //Not connected yet (see udp_connect()).
+          stream->missed_nb++;
+        }
+        if( send_err ) { err = send_err;}
+      }
     }
   }
+  return err;
+}
 
-  return free_udp_c;
+/*!
+ * Function name: udp_cyclic_statistics
+ * \return ERR_OK or ERR_VAL if udp_c has no cyclic stream.
+ * \param udp_c : [in] udp_c of interest.
+ * \param sent_nb : [out] Number of frames sent.
+ * \param missed_nb : [out] Number of release times skipped.
+ * \param max_lateness : [out] Worst lateness in ticks (send jitter).
+ * \brief Report the timing of a cyclic UDP stream.
+ * *******************************************************************/
+err_t udp_cyclic_statistics(UDP_T *udp_c, u32_t *sent_nb, u32_t *missed_nb, u32_t *max_lateness)
+{
+  err_t err = ERR_OK;
+  UDP_CYCLIC_T* stream = udp_cyclic_lookup(udp_c->netif, udp_c);
+
+  if( stream != NULL ) {
+    *sent_nb = stream->sent_nb;
+    *missed_nb = stream->missed_nb;
+    *max_lateness = stream->max_lateness;
+  } else {
+    err = ERR_VAL;
+  }
+  return err;
 }
 
 /*!
- * Function name: udp_order_active_list
- * \return nothing
- * \param udp_cs : [out] List of active UDP connections.
- * \param net_adapter : [in] network adapter.
- * \brief When an ethernet frame comes, cIPS tries to match it with an
- * existing connection. The match is done by looking up the UDP list.
- * It is more efficient if the list is small and ordered. 
- * udp_order_active_list() re-order the list of UDP connections. It
- * puts the open connection at the beginning of the list
+ * Function name: udp_cyclic_lookup
+ * \return the cyclic stream entry found, NULL otherwise.
+ * \param net_adapter : [in] adapter of interest.
+ * \param udp_c : [in] udp_c of interest. NULL looks for a free entry.
+ * \brief Find the cyclic stream entry of a UDP controller.
  * *******************************************************************/
-static void udp_order_active_list( UDP_T** udp_cs, const NETIF_T* const net_adapter)
+static UDP_CYCLIC_T* udp_cyclic_lookup(NETIF_T *net_adapter, const UDP_T* const udp_c)
 {
-#ifdef UDP_DEBUG
-  u32_t unused, client, server;
-#endif //UDP_DEBUG
-  UDP_T *udp_c_i;
+  UDP_CYCLIC_T* stream = NULL;
   u32_t i;
-  u32_t prec;
-  UDP_T* udp_c_list = (UDP_T*)net_adapter->udp_c_list;
 
-  //look for first elt.
-  prec = UDP_UNUSED;
-  for( i = 0; i < MAX_UDP; i++)
+  for( i = 0; i < MAX_UDP_CYCLIC; i++)
   {
-    udp_c_i = &(udp_c_list[i]);
-    if( udp_c_i->state != UDP_UNUSED)
-    {
-      prec = i; //current elt becomes precedent elt.
-      i = MAX_UDP; // exit loop
+    if( net_adapter->udp_cyclic_list[i].udp_c == udp_c ) {
+      stream = &(net_adapter->udp_cyclic_list[i]);
+      i = MAX_UDP_CYCLIC; //exit loop
     }
   }
+  return stream;
+}
 
-  //Set the "active list" to the first elt.
-  *udp_cs = (prec != UDP_UNUSED) ? &(udp_c_list[prec]) : NULL;
-
-  //build active connection list.
-  for( i = prec+1; i < MAX_UDP; i++)
-  {
-    udp_c_i = &(udp_c_list[i]);
-    if( (udp_c_i->state != UDP_UNUSED) )
-    {
-      udp_c_list[prec].next = udp_c_i;
-      prec = i; //current elt becomes precedent elt.
-    }
-  }
-  //last elt
-  udp_c_list[prec].next = NULL;
+/*!
+ * Function name: udp_store_error
+ * \return nothing
+ * \param err : [in] error number.
+ * \param udp_c : [in/out] udp_c sending the error.
+ * \param function_name : [in] function name where the error is happening.
+ * \param line_number : [in] line number where the error is happening.
+ * \brief Format a string to report a UDP error.
+ * *******************************************************************/
+static err_t udp_store_error( const err_t err, UDP_T* const udp_c, const s8_t* const function_name, const u32_t line_number)
+{
+  ERROR_REPORT_T* last_error = &(udp_c->netif->last_error);
+  last_error->err_nb = err;
+  snprintf(last_error->formated_error,MAX_FORMATED_ERROR_SIZE,"%s#%d-%d: UDP error: %s (fct %s #%ld)",udp_c->netif->name, udp_c->local_port, udp_c->remote_port, decode_err(err), function_name, line_number);
+  return err;
+}
 
-#ifdef UDP_DEBUG
-  unused =0;
-  client =0;
-  server=0;
 
-  for( i = 0; i < MAX_UDP; i++)
-  {
-    udp_c_i = &(udp_c_list[i]);
-    switch( udp_c_i->state)
-    {
-      case UDP_UNUSED:
-        unused++;
-      break;
-      case UDP_KNOWN_TARGET:
-        client++;
-      break;
-      case UDP_ANY_TARGET:
-        server++;
-      break;
-    }
+/*!
+ * Function name: udp_malloc
+ * \return free_udp_c: a pointer to a new udp_c.
+ * \param net_adapter : [in] network adapter.
+ * \brief cIPS works with static memory. cIPS has a finite list (or array)
+ * of MAX_UDP UDP connection. udp_malloc() takes the first udp_c of the 
+ * free list ("udp_free_cs"), books it and returns a reference to it.
+ * *******************************************************************/
+static UDP_T* udp_malloc(NETIF_T *net_adapter)
+{
+  UDP_T* free_udp_c = net_adapter->udp_free_cs;
+
+  if( free_udp_c != NULL )
+  { //Configure the new connection
+    udp_list_remove(free_udp_c);
+    free_udp_c->local_ip = 0;
+    free_udp_c->remote_ip = 0;
+    free_udp_c->local_port = 0;
+    free_udp_c->remote_port = 0;
+    free_udp_c->chksum_len = 0;
+    free_udp_c->pseudo_sum = 0;
+    free_udp_c->app_data = free_udp_c->frame + sizeof(UDP_HEADER_T) + sizeof(IP_HEADER_T) + sizeof(ETHER_HEADER_T);
+    free_udp_c->frame_initialized = FALSE;
+    free_udp_c->netif = net_adapter;
+    free_udp_c->state = UDP_ANY_TARGET;
+    free_udp_c->recv = NULL;
+    free_udp_c->recv_arg = NULL;
   }
-    T_DEBUGF(UDP_DEBUG, ("UDP controllers: unused=%ld client=%ld server=%ld\r\n",unused, client, server));
-#endif //UDP_DEBUG
-  return;
+
+  return free_udp_c;
 }
 
 /*!
@@ -505,12 +649,13 @@ static void udp_order_active_list( UDP_T** udp_cs, const NETIF_T* const net_adap
  * \param udp_cs : [out] List of active UDP controllers.
  * \param udp_c : [in] udp_c of interest, udp_c->state must be set to a different value of
  * UNUSED to register the udp_c.
- * \brief Add the new connection to the list of active UDP connections.
- * It also rebuilds the list.
+ * \brief Add the new connection to the list of active UDP connections in
+ * O(1). Nothing changes if it is already in the list.
  * *******************************************************************/
 static void udp_register( UDP_T** udp_cs, UDP_T* udp_c )
 {
-  (void) udp_order_active_list( udp_cs, udp_c->netif);
+  if( udp_c->list != udp_cs )
+  { udp_list_insert( udp_cs, udp_c);}
 }
 
 /*!
@@ -518,12 +663,51 @@ static void udp_register( UDP_T** udp_cs, UDP_T* udp_c )
  * \return nothing
  * \param udp_cs : [out] List of active UDP controllers.
  * \param udp_c : [in] udp_c of interest.
- * \brief Remove a connection to the list of UDP connections.
- * It also rebuilds the list.
+ * \brief Remove a connection from the list of UDP connections in O(1).
+ * It goes to the list of free controllers ("udp_free_cs").
  * *******************************************************************/
 static void udp_remove_controller( UDP_T** udp_cs,  UDP_T* udp_c )
 {
-  (void) udp_order_active_list( udp_cs, udp_c->netif);
+  if( udp_c->list == udp_cs )
+  { udp_list_insert( &(udp_c->netif->udp_free_cs), udp_c);}
+}
+
+/*!
+ * Function name: udp_list_insert
+ * \return nothing
+ * \param list : [in/out] "udp_cs" or "udp_free_cs" of the adapter.
+ * \param udp_c : [in/out] udp_c of interest.
+ * \brief Put the controller at the head of "list". If it is in another 
+ * list, it leaves it first.
+ * *******************************************************************/
+static void udp_list_insert( UDP_T** list, UDP_T* udp_c )
+{
+  udp_list_remove(udp_c);
+  udp_c->prev = NULL;
+  udp_c->next = *list;
+  if( *list != NULL ) { (*list)->prev = udp_c;}
+  *list = udp_c;
+  udp_c->list = list;
+}
+
+/*!
+ * Function name: udp_list_remove
+ * \return nothing
+ * \param udp_c : [in/out] udp_c of interest.
+ * \brief Unlink the controller from its list. Nothing happens if it is in
+ * no list.
+ * *******************************************************************/
+static void udp_list_remove( UDP_T* udp_c )
+{
+  if( udp_c->list != NULL )
+  {
+    if( udp_c->prev != NULL ) { udp_c->prev->next = udp_c->next;}
+    else { *(udp_c->list) = udp_c->next;}
+    if( udp_c->next != NULL ) { udp_c->next->prev = udp_c->prev;}
+    udp_c->prev = NULL;
+    udp_c->next = NULL;
+    udp_c->list = NULL;
+  }
 }
 
 /*!
@@ -592,6 +776,7 @@ static void udp_init_connection (UDP_T* const udp_c, const u8_t* const dest_mac_
     udphdr->source_port = htons(udp_c->local_port);
     udphdr->dest_port = htons(udp_c->remote_port);
 
+    udp_c->pseudo_sum = ip_pseudo_header_sum( udp_c->remote_ip, udp_c->local_ip, IP_UDP);
     udp_c->frame_initialized = TRUE;
   }
 